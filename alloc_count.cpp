@@ -0,0 +1,44 @@
+// -------------------------------------------------------------------------------------
+// alloc_count.cpp - replacement global operator new/delete counting the allocations
+// of the calling thread in alloc_count() (alloc_count.h)
+//
+// + link into a test or benchmark only (planner_alloc_test, planner_bench), the
+//   planner itself never includes it
+// + plain, array, nothrow and sized forms, all on malloc/free
+// -------------------------------------------------------------------------------------
+
+#include <stdlib.h>
+#include <new>
+#include "alloc_count.h"
+
+static void *counted_alloc(size_t size) {
+  alloc_count()++;
+  return malloc(size ? size : 1);
+}
+
+void *operator new(size_t size) {
+  void *p = counted_alloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](size_t size) {
+  void *p = counted_alloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size);
+}
+
+void operator delete(void *p) noexcept                              { free(p); }
+void operator delete[](void *p) noexcept                            { free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept      { free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept    { free(p); }
+void operator delete(void *p, size_t) noexcept                      { free(p); }
+void operator delete[](void *p, size_t) noexcept                    { free(p); }
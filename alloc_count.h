@@ -0,0 +1,17 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+// -------------------------------------------------------------------------------------
+// allocation counting hook
+//
+// + every heap allocation of the calling thread is counted in alloc_count() when the
+//   program is linked with alloc_count.cpp (replacement operator new/delete)
+// + without it alloc_count() stays 0 and nothing is replaced
+// -------------------------------------------------------------------------------------
+
+inline long &alloc_count() {
+  static thread_local long count = 0;
+  return count;
+}
+
+#endif /* ALLOC_COUNT_H */
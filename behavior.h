@@ -0,0 +1,268 @@
+#ifndef BEHAVIOR_H
+#define BEHAVIOR_H
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "collision.h"
+#include "fusion.h"
+#include "map.h"
+#include "prediction.h"
+#include "task_pool.h"
+#include "telemetry.h"
+#include "trajectory.h"
+
+// candidate grid per lane: target speed steps (x velocity step) and spline spacings
+// (x ref distance)
+const int    CANDIDATE_SPEEDS[]   = { 1, 0, -1, -3 };
+const double CANDIDATE_SPACINGS[] = { 1.0, 1.5, 2.0 };
+const int    CANDIDATE_SPEED_NUM   = sizeof(CANDIDATE_SPEEDS)/sizeof(CANDIDATE_SPEEDS[0]);
+const int    CANDIDATE_SPACING_NUM = sizeof(CANDIDATE_SPACINGS)/sizeof(CANDIDATE_SPACINGS[0]);
+
+// safety distances
+const double JERK_MAX         = 10.0;   // m/s^3
+const double ACC_MAX          = 10.0;   // m/s^2
+const int    JERK_STRIDE      = 5;      // trajectory points between curvature samples
+const double BUFFER_REFS      = 3.0;    // look ahead for the car in front, x ref distance
+const double BUFFER_TIME      = 4.0;    // s, closing speed x time compared to the gap
+
+// "infinite" cost of a candidate not evaluated within the budget
+const double COST_SKIPPED = 1e30;
+
+
+// -------------------------------------------------------------------------------------
+// struct CostWeights
+//
+// + weights of the candidate costs, every cost term is normalized to ~[0,1]
+// -------------------------------------------------------------------------------------
+
+struct CostWeights {
+  double collision   = 1e6;   // predicted overlap with a car within the trajectory
+  double buffer      = 1e3;   // gap to the car ahead / behind in the target lane
+  double jerk        = 1e2;   // jerk / acceleration over the new trajectory points
+  double speed       = 10.0;  // below the speed limit
+  double lane_speed  = 10.0;  // traffic ahead in the target lane slower than the limit
+  double lane_change = 1.0;   // per lane crossed
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct Candidate
+//
+// + one maneuver: target lane, target velocity (mph), spline spacing - the
+//   trajectory, its time to collision and the cost are filled in by the evaluation
+// -------------------------------------------------------------------------------------
+
+struct Candidate {
+  int        lane;
+  double     velocity;
+  double     spacing;
+  double     cost;
+  double     ttc;
+  Trajectory trajectory;
+};
+
+
+// -------------------------------------------------------------------------------------
+// class CostBehavior
+//
+// + behavior layer of the cost planner, shared read-only by all planners: number of
+//   lanes, cost weights, pool for the evaluation and time budget per tick
+// + generate: every lane x CANDIDATE_SPEEDS x CANDIDATE_SPACINGS, the current lane
+//   and velocity first - the budget cuts from the end of the list
+// + evaluate: trajectory + cost of all candidates in parallel on the pool, candidates
+//   started after the deadline are skipped (the first one is always evaluated) - the
+//   candidate continuing PLAN (last trajectory sent) extends it instead of a rebuild
+// + CONFIG = tuning policy of the planner, see planner_config.h
+// -------------------------------------------------------------------------------------
+
+class CostBehavior {
+
+ public:
+
+  CostBehavior(int lanes, TaskPool *pool = nullptr, double budget_ms = 5.0)
+    : lanes(lanes), pool(pool), budget_ms(budget_ms) {}
+
+  template <class Config>
+  void generate(const Config &config, int lane, double velocity, std::vector<Candidate> &candidates) const {
+
+    int num = 0;
+    for (int k=0;k<2*lanes;++k) {
+
+      // current lane first, then by distance to it, left before right
+      int l = lane+((k%2) ? -1 : 1)*((k+1)/2);
+      if (l<0 || l>=lanes) continue;
+
+      for (int v=0;v<CANDIDATE_SPEED_NUM;++v) {
+        for (int p=0;p<CANDIDATE_SPACING_NUM;++p) {
+
+          double target = std::min(velocity+CANDIDATE_SPEEDS[v]*config.velocity_step(),config.velocity_max());
+          if (target<=0) continue;
+
+          if (num==(int)candidates.size()) candidates.push_back(Candidate());
+          Candidate &c = candidates[num++];
+          c.lane     = l;
+          c.velocity = target;
+          c.spacing  = CANDIDATE_SPACINGS[p]*config.ref_distance();
+          c.cost     = COST_SKIPPED;
+        }
+      }
+    }
+    candidates.resize(num);
+  }
+
+  // index of the cheapest candidate
+  template <class Config>
+  int evaluate(const Config &config, const HighwayMap &map, const ReferenceLine *line, const Telemetry &t,
+               const CollisionChecker &collisions, const FusionTable &fusion, const FrenetState &start,
+               TrajectoryBackend backend, const TrajectoryPlan *plan, int lane, double velocity,
+               std::vector<Candidate> &candidates) const {
+
+    Tick<Config> tick = { config, map, line, t, collisions, fusion, start, backend, plan, lane, velocity, candidates,
+                  std::chrono::steady_clock::now()+std::chrono::microseconds(long(budget_ms*1000)) };
+
+    // two pointers of capture fit into the function's inline storage - no malloc
+    Tick<Config> *p = &tick;
+    std::function<void(int)> task = [this,p](int i) {
+      if (i>0 && std::chrono::steady_clock::now()>p->deadline) return;
+      Candidate &c = p->candidates[i];
+      if (p->plan && can_extend(p->config,*p->plan,p->t,p->backend,c.lane,c.velocity,c.spacing)) {
+        extend_trajectory(p->config,p->map,*p->plan,p->t,c.trajectory);
+      }
+      else build_trajectory(p->config,p->backend,p->map,p->t,p->start,c.lane,c.velocity,c.spacing,c.trajectory,
+                            p->line);
+      c.ttc  = p->collisions.check(p->t,p->start.s,c.trajectory.next_x_vals,c.trajectory.next_y_vals).ttc;
+      c.cost = cost(p->config,p->t,p->fusion,p->start.s,p->lane,p->velocity,c);
+    };
+
+    if (pool) pool->run(candidates.size(),task);
+    else      for (int i=0;i<(int)candidates.size();++i) task(i);
+
+    int best = 0;
+    for (int i=1;i<(int)candidates.size();++i) {
+      if (candidates[i].cost<candidates[best].cost) best = i;
+    }
+    return best;
+  }
+
+  // -----------------------------------------------------------------------------------
+  // cost of one candidate, weighted sum of
+  //   collision   - contact of the new trajectory points with any predicted vehicle
+  //                 (CollisionChecker), 1..2 - the earlier the time to collision
+  //                 within the trajectory the higher
+  //   buffer      - closing in on the car ahead in the target lane (closing speed x
+  //                 BUFFER_TIME vs gap at the end of the previous path), or a car
+  //                 behind closer than ref distance x back distance on a lane change
+  //   jerk        - speed change of the tick, lateral acceleration / jerk of the new
+  //                 points relative to ACC_MAX / JERK_MAX, +1 above the limits
+  //   speed       - distance to the speed limit
+  //   lane_speed  - slowest car within 2 x ref distance ahead in the target lane
+  //   lane_change - lanes crossed
+  // -----------------------------------------------------------------------------------
+
+  template <class Config>
+  double cost(const Config &config, const Telemetry &t, const FusionTable &fusion, double car_s, int lane,
+              double velocity, const Candidate &c) const {
+
+    double ref_distance = config.ref_distance();
+    double velocity_max = config.velocity_max();
+    double dt_point     = config.points_per_sec();
+
+    const std::vector<double> &x = c.trajectory.next_x_vals;
+    const std::vector<double> &y = c.trajectory.next_y_vals;
+
+    int prev_size = t.previous_path_x.size();
+    int lo        = std::min(lane,c.lane);
+    int hi        = std::max(lane,c.lane);
+
+    // collision within the trajectory, time to collision from the checker
+    double horizon   = std::max((int)x.size(),1)*dt_point;
+    double collision = (c.ttc<TTC_NONE) ? 2-std::min(c.ttc/horizon,1.0) : 0;
+
+    // buffer to the cars around the end of the previous path
+    double buffer = 0;
+    int    ahead  = fusion.nearest_ahead(c.lane,car_s);
+    if (ahead<fusion.end(c.lane)) {
+      double gap     = fusion.s[ahead]-car_s;
+      double closing = c.velocity/MPH_TO_MS-fusion.speed[ahead];
+      if (closing>0 && gap<BUFFER_REFS*ref_distance) buffer = std::min(1.0,closing*BUFFER_TIME/std::max(gap,1e-3));
+    }
+    if (c.lane!=lane) {
+      int behind = fusion.nearest_behind(c.lane,car_s);
+      if (behind>=0 && car_s-fusion.s[behind]<ref_distance*config.back_distance()) buffer = 1;
+    }
+
+    // longitudinal: speed change of the tick beyond one velocity step, 1 for the
+    // emergency break
+    double step      = config.velocity_step();
+    double jerk_cost = std::max(fabs(c.velocity-velocity)-step,0.0)/(2*step);
+
+    // lateral: acceleration v^2*k from the curvature of the path every JERK_STRIDE
+    // points over the new part, jerk from the change between two samples
+    double v_ms   = c.velocity/MPH_TO_MS;
+    double acc    = 0;
+    double jerk   = 0;
+    double acc_0  = 0;
+    int    first  = std::max(prev_size-1,JERK_STRIDE);
+    for (int i=first;i+JERK_STRIDE<(int)x.size();i+=JERK_STRIDE) {
+      double a   = distance(x[i-JERK_STRIDE],y[i-JERK_STRIDE],x[i],y[i]);
+      double b   = distance(x[i],y[i],x[i+JERK_STRIDE],y[i+JERK_STRIDE]);
+      double e   = distance(x[i-JERK_STRIDE],y[i-JERK_STRIDE],x[i+JERK_STRIDE],y[i+JERK_STRIDE]);
+      double abe = a*b*e;
+      if (abe<=0) continue;
+      double cross = (x[i]-x[i-JERK_STRIDE])*(y[i+JERK_STRIDE]-y[i])-(y[i]-y[i-JERK_STRIDE])*(x[i+JERK_STRIDE]-x[i]);
+      double acc_i = v_ms*v_ms*2*cross/abe;
+      if (i>first) jerk = std::max(jerk,fabs(acc_i-acc_0)/(JERK_STRIDE*dt_point));
+      acc   = std::max(acc,fabs(acc_i));
+      acc_0 = acc_i;
+    }
+    jerk_cost += acc/ACC_MAX+jerk/JERK_MAX;
+    if (acc>ACC_MAX || jerk>JERK_MAX) jerk_cost += 1;
+
+    // speed
+    double speed = (velocity_max-c.velocity)/velocity_max;
+
+    // traffic ahead in the target lane
+    double lane_speed = 0;
+    int    end        = fusion.end(c.lane);
+    for (int k=ahead;k<end && fusion.s[k]-car_s<2*ref_distance;++k) {
+      double v   = std::min(fusion.speed[k]*MPH_TO_MS,velocity_max);
+      lane_speed = std::max(lane_speed,(velocity_max-v)/velocity_max);
+    }
+
+    return weights.collision*collision
+          +weights.buffer*buffer
+          +weights.jerk*jerk_cost
+          +weights.speed*speed
+          +weights.lane_speed*lane_speed
+          +weights.lane_change*(hi-lo);
+  }
+
+  int         lanes;
+  TaskPool   *pool;
+  double      budget_ms;
+  CostWeights weights;
+
+ private:
+
+  // arguments of one evaluate() call, shared by the tasks
+  template <class Config>
+  struct Tick {
+    const Config                          &config;
+    const HighwayMap                      &map;
+    const ReferenceLine                   *line;
+    const Telemetry                       &t;
+    const CollisionChecker                &collisions;
+    const FusionTable                     &fusion;
+    const FrenetState                     &start;
+    TrajectoryBackend                      backend;
+    const TrajectoryPlan                  *plan;
+    int                                    lane;
+    double                                 velocity;
+    std::vector<Candidate>                &candidates;
+    std::chrono::steady_clock::time_point  deadline;
+  };
+};
+
+#endif /* BEHAVIOR_H */
@@ -0,0 +1,265 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "prediction.h"
+#include "telemetry.h"
+
+// footprint of every vehicle (ego and traffic): box of VEHICLE_LENGTH x VEHICLE_WIDTH
+// covered by two circles on the long axis, grown by COLLISION_MARGIN - two cars side
+// by side in the centers of neighbouring lanes stay apart
+const double VEHICLE_LENGTH   = 4.8;
+const double VEHICLE_WIDTH    = 2.0;
+const double COLLISION_MARGIN = 0.2;
+const double FOOTPRINT_OFFSET = VEHICLE_LENGTH/4;                       // circle centers
+const double FOOTPRINT_RADIUS = sqrt(FOOTPRINT_OFFSET*FOOTPRINT_OFFSET+
+                                     VEHICLE_WIDTH*VEHICLE_WIDTH/4)+COLLISION_MARGIN;
+const double FOOTPRINT_BOUND  = FOOTPRINT_OFFSET+FOOTPRINT_RADIUS;       // both circles
+
+// time to collision of a free trajectory
+const double TTC_NONE = 1e30;
+
+
+// -------------------------------------------------------------------------------------
+// struct Collision
+//
+// + first contact of a trajectory: time from the telemetry (s) and fusion index of the
+//   vehicle hit, TTC_NONE / -1 if the trajectory is free
+// -------------------------------------------------------------------------------------
+
+struct Collision {
+  double ttc;
+  int    vehicle;
+};
+
+
+// -------------------------------------------------------------------------------------
+// class CollisionChecker
+//
+// + continuous collision check of trajectories against the PredictionTable, prepared
+//   once per tick and shared read-only by all candidates (threads) of the tick
+// + sample i of a trajectory is driven at row i+1 of the prediction; the samples the
+//   trajectory adds to the previous path are checked, from the last point of the
+//   previous path (the car position if there is none) on - the previous path is the
+//   same for every candidate and was checked when it was added
+// + broad phase: s interval of every vehicle over the predicted rows, sorted by its
+//   start - the ego interval (start s + length of the new path, grown by the reach
+//   of two footprints) selects the vehicles with a binary search, also one lap ahead
+//   and behind for the wrap at max_s
+// + narrow phase per pair of consecutive samples: ego and vehicle move linearly
+//   between them, first the bounding circles, then the two footprint circles of each
+//   side are swept against each other - the earliest contact over all vehicles is the
+//   time to collision
+// + headings: ego from consecutive trajectory points, vehicles from consecutive
+//   predicted positions (the road direction while a vehicle stands)
+// -------------------------------------------------------------------------------------
+
+class CollisionChecker {
+
+ public:
+
+  CollisionChecker() : n(0), first(0), last(-1), dt(0), max_s(0), max_extent(0) {}
+
+  // PREDICTION with x/y (predict_xy) on MAP
+  void prepare(const PredictionTable &prediction, const HighwayMap &map) {
+
+    n     = prediction.vehicles();
+    first = prediction.first_step();
+    last  = prediction.last_step();
+    dt    = prediction.step_dt();
+    max_s = map.max_s;
+
+    // footprint circles per row x vehicle
+    int rows = last-first+1;
+    front_x.resize(rows*n);
+    front_y.resize(rows*n);
+    rear_x.resize(rows*n);
+    rear_y.resize(rows*n);
+    for (int k=first;k<=last;++k) {
+      const double *x  = prediction.x_at(k);
+      const double *y  = prediction.y_at(k);
+      const double *x1 = prediction.x_at((k<last) ? k+1 : std::max(k-1,first));
+      const double *y1 = prediction.y_at((k<last) ? k+1 : std::max(k-1,first));
+      double        dir = (k<last) ? 1 : -1;
+      int           row = (k-first)*n;
+      for (int i=0;i<n;++i) {
+        double hx = dir*(x1[i]-x[i]);
+        double hy = dir*(y1[i]-y[i]);
+        double h  = sqrt(hx*hx+hy*hy);
+        if (h<1e-6) {
+          double s = prediction.s_at(k)[i], d = prediction.d_at(k)[i], ax, ay;
+          map.getXY(s,d,ax,ay);
+          map.getXY(s+1,d,hx,hy);
+          hx -= ax;
+          hy -= ay;
+          h   = sqrt(hx*hx+hy*hy);
+        }
+        double ux = hx/h;
+        double uy = hy/h;
+        front_x[row+i] = x[i]+FOOTPRINT_OFFSET*ux;
+        front_y[row+i] = y[i]+FOOTPRINT_OFFSET*uy;
+        rear_x[row+i]  = x[i]-FOOTPRINT_OFFSET*ux;
+        rear_y[row+i]  = y[i]-FOOTPRINT_OFFSET*uy;
+      }
+    }
+
+    // broad phase, s is non decreasing over the rows
+    s_lo.resize(n);
+    s_hi.resize(n);
+    order.resize(n);
+    max_extent = 0;
+    for (int i=0;i<n;++i) {
+      s_lo[i]    = prediction.s_at(first)[i];
+      s_hi[i]    = prediction.s_at(last)[i];
+      max_extent = std::max(max_extent,s_hi[i]-s_lo[i]);
+      order[i]   = i;
+    }
+    std::sort(order.begin(),order.end(),[this](int a, int b) { return s_lo[a]<s_lo[b]; });
+    sorted_lo.resize(n);
+    for (int i=0;i<n;++i) sorted_lo[i] = s_lo[order[i]];
+  }
+
+  // -----------------------------------------------------------------------------------
+  // first contact of the trajectory X/Y after the previous path of T, START_S = s of
+  // the last previous path point (the car if none)
+  // -----------------------------------------------------------------------------------
+
+  Collision check(const Telemetry &t, double start_s, const std::vector<double> &x, const std::vector<double> &y) const {
+
+    Collision hit = { TTC_NONE, -1 };
+
+    int prev_size = t.previous_path_x.size();
+    int end       = std::min((int)x.size(),last);   // sample i needs row i+1
+    if (n==0 || prev_size>=end || prev_size<first) return hit;
+
+    // ego s interval
+    double length = 0;
+    for (int i=prev_size;i<end;++i) length += distance(sample_x(t,x,i-1),sample_y(t,y,i-1),x[i],y[i]);
+    double lo = start_s-2*FOOTPRINT_BOUND;
+    double hi = start_s+length+2*FOOTPRINT_BOUND;
+
+    for (int lap=-1;lap<=1;++lap) {
+      double shift = lap*max_s;
+      int    k     = std::lower_bound(sorted_lo.begin(),sorted_lo.end(),lo+shift-max_extent)-sorted_lo.begin();
+      for (;k<n && sorted_lo[k]<=hi+shift;++k) {
+        int car = order[k];
+        if (s_hi[car]<lo+shift) continue;
+        double ttc = sweep(t,x,y,prev_size,end,car,hit.ttc);
+        if (ttc<hit.ttc) {
+          hit.ttc     = ttc;
+          hit.vehicle = car;
+        }
+      }
+    }
+    return hit;
+  }
+
+ private:
+
+  // trajectory sample I, -1 = car position
+  static double sample_x(const Telemetry &t, const std::vector<double> &x, int i) { return (i<0) ? t.car_x : x[i]; }
+  static double sample_y(const Telemetry &t, const std::vector<double> &y, int i) { return (i<0) ? t.car_y : y[i]; }
+
+  // unit heading of the ego at sample I
+  static void heading(const Telemetry &t, const std::vector<double> &x, const std::vector<double> &y, int i,
+                      double &ux, double &uy) {
+    double hx = 0, hy = 0;
+    if (i>=0) {
+      int a = (i>0) ? i-1 : -1;
+      hx = x[i]-sample_x(t,x,a);
+      hy = y[i]-sample_y(t,y,a);
+    }
+    double h = sqrt(hx*hx+hy*hy);
+    if (h<1e-6) {
+      double yaw = deg2rad(t.car_yaw);
+      ux = cos(yaw);
+      uy = sin(yaw);
+      return;
+    }
+    ux = hx/h;
+    uy = hy/h;
+  }
+
+  // earliest tau in [0,1] with |r0+tau*(r1-r0)| <= R, 2 if none
+  static double contact(double r0x, double r0y, double r1x, double r1y, double r) {
+    double c = r0x*r0x+r0y*r0y-r*r;
+    if (c<=0) return 0;
+    double dx = r1x-r0x;
+    double dy = r1y-r0y;
+    double a  = dx*dx+dy*dy;
+    double b  = r0x*dx+r0y*dy;
+    if (b>=0 || a<=0) return 2;
+    double disc = b*b-a*c;
+    if (disc<0) return 2;
+    double tau = (-b-sqrt(disc))/a;
+    return (tau<=1) ? tau : 2;
+  }
+
+  // time of the first contact with vehicle CAR between the samples [from-1,to), below
+  // LIMIT, else TTC_NONE
+  double sweep(const Telemetry &t, const std::vector<double> &x, const std::vector<double> &y, int from, int to, int car,
+               double limit) const {
+
+    const double R  = 2*FOOTPRINT_RADIUS;
+    const double RB = 2*FOOTPRINT_BOUND;
+
+    double ux0, uy0;
+    heading(t,x,y,from-1,ux0,uy0);
+
+    for (int i=from-1;i+1<to;++i) {
+
+      // interval [sample i, sample i+1] = rows [i+1, i+2]
+      double t0 = (i+1)*dt;
+      if (t0>=limit) break;
+
+      int    r0  = (i+1-first)*n+car;
+      int    r1  = r0+n;
+      double ex0 = sample_x(t,x,i),   ey0 = sample_y(t,y,i);
+      double ex1 = x[i+1],            ey1 = y[i+1];
+      double ux1, uy1;
+      heading(t,x,y,i+1,ux1,uy1);
+
+      // bounding circles, centers of the vehicles
+      double vx0 = (front_x[r0]+rear_x[r0])/2, vy0 = (front_y[r0]+rear_y[r0])/2;
+      double vx1 = (front_x[r1]+rear_x[r1])/2, vy1 = (front_y[r1]+rear_y[r1])/2;
+      if (contact(ex0-vx0,ey0-vy0,ex1-vx1,ey1-vy1,RB)<=1) {
+
+        // footprint circles: ego front/rear x vehicle front/rear
+        double first_tau = 2;
+        for (int e=-1;e<=1;e+=2) {
+          double ax0 = ex0+e*FOOTPRINT_OFFSET*ux0, ay0 = ey0+e*FOOTPRINT_OFFSET*uy0;
+          double ax1 = ex1+e*FOOTPRINT_OFFSET*ux1, ay1 = ey1+e*FOOTPRINT_OFFSET*uy1;
+          first_tau = std::min(first_tau,contact(ax0-front_x[r0],ay0-front_y[r0],ax1-front_x[r1],ay1-front_y[r1],R));
+          first_tau = std::min(first_tau,contact(ax0-rear_x[r0],ay0-rear_y[r0],ax1-rear_x[r1],ay1-rear_y[r1],R));
+        }
+        if (first_tau<=1) return std::min(t0+first_tau*dt,limit);
+      }
+      ux0 = ux1;
+      uy0 = uy1;
+    }
+    return TTC_NONE;
+  }
+
+  int    n;
+  int    first;
+  int    last;
+  double dt;
+  double max_s;
+
+  // footprint circle centers, rows first..last x vehicles
+  std::vector<double> front_x;
+  std::vector<double> front_y;
+  std::vector<double> rear_x;
+  std::vector<double> rear_y;
+
+  // broad phase: s interval per vehicle, vehicles sorted by interval start
+  std::vector<double> s_lo;
+  std::vector<double> s_hi;
+  std::vector<int>    order;
+  std::vector<double> sorted_lo;
+  double              max_extent;
+};
+
+#endif /* COLLISION_H */
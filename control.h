@@ -0,0 +1,382 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// -------------------------------------------------------------------------------------
+// shortest round-trip double formatting (Grisu2, F. Loitsch "Printing Floating-Point
+// Numbers Quickly and Accurately with Integers", 2010)
+//
+// + same digit generation and number layout as json::dump, so the control frame
+//   text does not change; integer arithmetic only, no snprintf/strtod
+// -------------------------------------------------------------------------------------
+
+namespace grisu {
+
+// 64 bit significand, binary exponent
+struct diyfp {
+
+  uint64_t f;
+  int      e;
+
+  diyfp(uint64_t f_, int e_) : f(f_), e(e_) {}
+
+  static diyfp sub(const diyfp &x, const diyfp &y) {
+    return diyfp(x.f-y.f,x.e);
+  }
+
+  // x * y, upper 64 bits of the 128 bit product rounded
+  static diyfp mul(const diyfp &x, const diyfp &y) {
+
+    uint64_t u_lo = x.f & 0xFFFFFFFFu;
+    uint64_t u_hi = x.f >> 32;
+    uint64_t v_lo = y.f & 0xFFFFFFFFu;
+    uint64_t v_hi = y.f >> 32;
+
+    uint64_t p0 = u_lo*v_lo;
+    uint64_t p1 = u_lo*v_hi;
+    uint64_t p2 = u_hi*v_lo;
+    uint64_t p3 = u_hi*v_hi;
+
+    uint64_t q = (p0 >> 32)+(p1 & 0xFFFFFFFFu)+(p2 & 0xFFFFFFFFu);
+    q += uint64_t(1) << 31;
+
+    return diyfp(p3+(p2 >> 32)+(p1 >> 32)+(q >> 32),x.e+y.e+64);
+  }
+
+  static diyfp normalize(diyfp x) {
+    while ((x.f >> 63)==0) {
+      x.f <<= 1;
+      x.e--;
+    }
+    return x;
+  }
+
+  static diyfp normalize_to(const diyfp &x, int target_e) {
+    return diyfp(x.f << (x.e-target_e),target_e);
+  }
+};
+
+// v and its rounding boundaries m-, m+
+struct boundaries {
+  diyfp w;
+  diyfp minus;
+  diyfp plus;
+};
+
+inline boundaries compute_boundaries(double value) {
+
+  const int      kBias      = 1075;  // 1023 + 52
+  const int      kMinExp    = 1-kBias;
+  const uint64_t kHiddenBit = uint64_t(1) << 52;
+
+  uint64_t bits;
+  memcpy(&bits,&value,sizeof(bits));
+
+  uint64_t E = bits >> 52;
+  uint64_t F = bits & (kHiddenBit-1);
+
+  diyfp v = (E==0) ? diyfp(F,kMinExp) : diyfp(F+kHiddenBit,int(E)-kBias);
+
+  // the lower boundary is closer if the significand is a power of two
+  bool lower_closer = (F==0 && E>1);
+
+  diyfp m_plus  = diyfp(2*v.f+1,v.e-1);
+  diyfp m_minus = lower_closer ? diyfp(4*v.f-1,v.e-2) : diyfp(2*v.f-1,v.e-1);
+
+  diyfp w_plus  = diyfp::normalize(m_plus);
+  diyfp w_minus = diyfp::normalize_to(m_minus,w_plus.e);
+
+  boundaries b = { diyfp::normalize(v), w_minus, w_plus };
+  return b;
+}
+
+struct cached_power {
+  uint64_t f;
+  int      e;
+  int      k;
+};
+
+// normalized 10^k, k = -300,-292,...,324 - puts the scaled exponent into [alpha,gamma]
+inline cached_power cached_power_for(int e) {
+
+  static const cached_power kCachedPowers[] = {
+    { 0xAB70FE17C79AC6CA, -1060, -300 },
+    { 0xFF77B1FCBEBCDC4F, -1034, -292 },
+    { 0xBE5691EF416BD60C, -1007, -284 },
+    { 0x8DD01FAD907FFC3C,  -980, -276 },
+    { 0xD3515C2831559A83,  -954, -268 },
+    { 0x9D71AC8FADA6C9B5,  -927, -260 },
+    { 0xEA9C227723EE8BCB,  -901, -252 },
+    { 0xAECC49914078536D,  -874, -244 },
+    { 0x823C12795DB6CE57,  -847, -236 },
+    { 0xC21094364DFB5637,  -821, -228 },
+    { 0x9096EA6F3848984F,  -794, -220 },
+    { 0xD77485CB25823AC7,  -768, -212 },
+    { 0xA086CFCD97BF97F4,  -741, -204 },
+    { 0xEF340A98172AACE5,  -715, -196 },
+    { 0xB23867FB2A35B28E,  -688, -188 },
+    { 0x84C8D4DFD2C63F3B,  -661, -180 },
+    { 0xC5DD44271AD3CDBA,  -635, -172 },
+    { 0x936B9FCEBB25C996,  -608, -164 },
+    { 0xDBAC6C247D62A584,  -582, -156 },
+    { 0xA3AB66580D5FDAF6,  -555, -148 },
+    { 0xF3E2F893DEC3F126,  -529, -140 },
+    { 0xB5B5ADA8AAFF80B8,  -502, -132 },
+    { 0x87625F056C7C4A8B,  -475, -124 },
+    { 0xC9BCFF6034C13053,  -449, -116 },
+    { 0x964E858C91BA2655,  -422, -108 },
+    { 0xDFF9772470297EBD,  -396, -100 },
+    { 0xA6DFBD9FB8E5B88F,  -369,  -92 },
+    { 0xF8A95FCF88747D94,  -343,  -84 },
+    { 0xB94470938FA89BCF,  -316,  -76 },
+    { 0x8A08F0F8BF0F156B,  -289,  -68 },
+    { 0xCDB02555653131B6,  -263,  -60 },
+    { 0x993FE2C6D07B7FAC,  -236,  -52 },
+    { 0xE45C10C42A2B3B06,  -210,  -44 },
+    { 0xAA242499697392D3,  -183,  -36 },
+    { 0xFD87B5F28300CA0E,  -157,  -28 },
+    { 0xBCE5086492111AEB,  -130,  -20 },
+    { 0x8CBCCC096F5088CC,  -103,  -12 },
+    { 0xD1B71758E219652C,   -77,   -4 },
+    { 0x9C40000000000000,   -50,    4 },
+    { 0xE8D4A51000000000,   -24,   12 },
+    { 0xAD78EBC5AC620000,     3,   20 },
+    { 0x813F3978F8940984,    30,   28 },
+    { 0xC097CE7BC90715B3,    56,   36 },
+    { 0x8F7E32CE7BEA5C70,    83,   44 },
+    { 0xD5D238A4ABE98068,   109,   52 },
+    { 0x9F4F2726179A2245,   136,   60 },
+    { 0xED63A231D4C4FB27,   162,   68 },
+    { 0xB0DE65388CC8ADA8,   189,   76 },
+    { 0x83C7088E1AAB65DB,   216,   84 },
+    { 0xC45D1DF942711D9A,   242,   92 },
+    { 0x924D692CA61BE758,   269,  100 },
+    { 0xDA01EE641A708DEA,   295,  108 },
+    { 0xA26DA3999AEF774A,   322,  116 },
+    { 0xF209787BB47D6B85,   348,  124 },
+    { 0xB454E4A179DD1877,   375,  132 },
+    { 0x865B86925B9BC5C2,   402,  140 },
+    { 0xC83553C5C8965D3D,   428,  148 },
+    { 0x952AB45CFA97A0B3,   455,  156 },
+    { 0xDE469FBD99A05FE3,   481,  164 },
+    { 0xA59BC234DB398C25,   508,  172 },
+    { 0xF6C69A72A3989F5C,   534,  180 },
+    { 0xB7DCBF5354E9BECE,   561,  188 },
+    { 0x88FCF317F22241E2,   588,  196 },
+    { 0xCC20CE9BD35C78A5,   614,  204 },
+    { 0x98165AF37B2153DF,   641,  212 },
+    { 0xE2A0B5DC971F303A,   667,  220 },
+    { 0xA8D9D1535CE3B396,   694,  228 },
+    { 0xFB9B7CD9A4A7443C,   720,  236 },
+    { 0xBB764C4CA7A44410,   747,  244 },
+    { 0x8BAB8EEFB6409C1A,   774,  252 },
+    { 0xD01FEF10A657842C,   800,  260 },
+    { 0x9B10A4E5E9913129,   827,  268 },
+    { 0xE7109BFBA19C0C9D,   853,  276 },
+    { 0xAC2820D9623BF429,   880,  284 },
+    { 0x80444B5E7AA7CF85,   907,  292 },
+    { 0xBF21E44003ACDD2D,   933,  300 },
+    { 0x8E679C2F5E44FF8F,   960,  308 },
+    { 0xD433179D9C8CB841,   986,  316 },
+    { 0x9E19DB92B4E31BA9,  1013,  324 }
+  };
+
+  const int kAlpha     = -60;
+  const int kMinDecExp = -300;
+  const int kDecStep   = 8;
+
+  int f     = kAlpha-e-1;
+  int k     = (f*78913)/(1 << 18)+(f>0);
+  int index = (-kMinDecExp+k+(kDecStep-1))/kDecStep;
+
+  return kCachedPowers[index];
+}
+
+// largest power of ten <= n, returns its number of digits
+inline int largest_pow10(uint32_t n, uint32_t &pow10) {
+  pow10 = 1000000000;
+  int k = 10;
+  while (k>1 && n<pow10) {
+    pow10 /= 10;
+    --k;
+  }
+  return k;
+}
+
+inline void round_weed(char *buf, int len, uint64_t dist, uint64_t delta, uint64_t rest, uint64_t ten_k) {
+  // move the last digit towards w while still inside the boundaries
+  while (rest<dist && delta-rest>=ten_k && (rest+ten_k<dist || dist-rest>rest+ten_k-dist)) {
+    buf[len-1]--;
+    rest += ten_k;
+  }
+}
+
+inline void digit_gen(char *buf, int &len, int &exp10, diyfp M_minus, diyfp w, diyfp M_plus) {
+
+  uint64_t delta = diyfp::sub(M_plus,M_minus).f;
+  uint64_t dist  = diyfp::sub(M_plus,w).f;
+
+  diyfp one(uint64_t(1) << -M_plus.e,M_plus.e);
+
+  uint32_t p1 = uint32_t(M_plus.f >> -one.e);
+  uint64_t p2 = M_plus.f & (one.f-1);
+
+  // integral part
+  uint32_t pow10;
+  int      n = largest_pow10(p1,pow10);
+
+  while (n>0) {
+    buf[len++] = char('0'+p1/pow10);
+    p1 %= pow10;
+    n--;
+
+    uint64_t rest = (uint64_t(p1) << -one.e)+p2;
+    if (rest<=delta) {
+      exp10 += n;
+      round_weed(buf,len,dist,delta,rest,uint64_t(pow10) << -one.e);
+      return;
+    }
+    pow10 /= 10;
+  }
+
+  // fractional part
+  int m = 0;
+  for (;;) {
+    p2 *= 10;
+    buf[len++] = char('0'+(p2 >> -one.e));
+    p2 &= one.f-1;
+    m++;
+
+    delta *= 10;
+    dist  *= 10;
+    if (p2<=delta) break;
+  }
+  exp10 -= m;
+
+  round_weed(buf,len,dist,delta,p2,one.f);
+}
+
+// digits of value>0 in buf, value = buf * 10^exp10
+inline void grisu2(char *buf, int &len, int &exp10, double value) {
+
+  boundaries b = compute_boundaries(value);
+
+  cached_power cached = cached_power_for(b.plus.e);
+  diyfp        c_minus_k(cached.f,cached.e);
+
+  diyfp w       = diyfp::mul(b.w,c_minus_k);
+  diyfp w_minus = diyfp::mul(b.minus,c_minus_k);
+  diyfp w_plus  = diyfp::mul(b.plus,c_minus_k);
+
+  // shrink the interval by one unit so the result is safe
+  diyfp M_minus(w_minus.f+1,w_minus.e);
+  diyfp M_plus(w_plus.f-1,w_plus.e);
+
+  len   = 0;
+  exp10 = -cached.k;
+  digit_gen(buf,len,exp10,M_minus,w,M_plus);
+}
+
+}  // namespace grisu
+
+
+// -------------------------------------------------------------------------------------
+// function append_double
+//
+// + appends x to msg in the number format of json::dump:
+//     decimal point if the exponent is in [-4,15), "1.0" for integral values,
+//     else d.ddde+XX, "null" for nan/inf
+// -------------------------------------------------------------------------------------
+
+inline void append_double(std::string &msg, double x) {
+
+  if (!isfinite(x)) {
+    msg.append("null",4);
+    return;
+  }
+  if (x==0) {
+    if (signbit(x)) msg.append("-0.0",4);
+    else            msg.append("0.0",3);
+    return;
+  }
+  if (x<0) {
+    msg.push_back('-');
+    x = -x;
+  }
+
+  char digits[24];
+  int  k;
+  int  exp10;
+  grisu::grisu2(digits,k,exp10,x);
+
+  // v = digits * 10^(n-k), n = position of the decimal point
+  int n = k+exp10;
+
+  if (k<=n && n<=15) {
+    // digits[000].0
+    msg.append(digits,k);
+    msg.append(n-k,'0');
+    msg.append(".0",2);
+  }
+  else if (0<n && n<=15) {
+    // dig.its
+    msg.append(digits,n);
+    msg.push_back('.');
+    msg.append(digits+n,k-n);
+  }
+  else if (-4<n && n<=0) {
+    // 0.[000]digits
+    msg.append("0.",2);
+    msg.append(-n,'0');
+    msg.append(digits,k);
+  }
+  else {
+    // d.igitse+XX
+    msg.push_back(digits[0]);
+    if (k>1) {
+      msg.push_back('.');
+      msg.append(digits+1,k-1);
+    }
+    int e = n-1;
+    msg.push_back('e');
+    msg.push_back((e<0) ? '-' : '+');
+    if (e<0) e = -e;
+    if (e>=100) msg.push_back(char('0'+e/100));
+    msg.push_back(char('0'+(e/10)%10));
+    msg.push_back(char('0'+e%10));
+  }
+}
+
+inline void append_array(std::string &msg, const std::vector<double> &values) {
+  msg.push_back('[');
+  for (int i=0;i<(int)values.size();++i) {
+    if (i>0) msg.push_back(',');
+    append_double(msg,values[i]);
+  }
+  msg.push_back(']');
+}
+
+
+// -------------------------------------------------------------------------------------
+// function write_control
+//
+// + writes the reply frame 42["control",{"next_x":[...],"next_y":[...]}] straight
+//   into msg (reused buffer of the planning context, cleared first) - same text as
+//   "42[\"control\","+msgJson.dump()+"]" without the json object and the copies
+// -------------------------------------------------------------------------------------
+
+inline void write_control(std::string &msg, const std::vector<double> &next_x_vals, const std::vector<double> &next_y_vals) {
+
+  msg.assign("42[\"control\",{\"next_x\":");
+  append_array(msg,next_x_vals);
+  msg.append(",\"next_y\":");
+  append_array(msg,next_y_vals);
+  msg.append("}]");
+}
+
+#endif /* CONTROL_H */
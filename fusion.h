@@ -0,0 +1,179 @@
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "planner_config.h"
+#include "prediction.h"
+#include "telemetry.h"
+
+// insertion sort budget per bucket entry before falling back to std::sort
+const int FUSION_SORT_MOVES = 4;
+
+// cars beyond this d (off the road) are in no lane bucket
+const float FUSION_MAX_D = 1024;
+
+
+// -------------------------------------------------------------------------------------
+// class FusionTable
+//
+// + one row of the PredictionTable (STEP, the end of the previous path): predicted
+//   s, d and speed of every car, bucketed by lane and sorted by predicted s within a
+//   lane
+// + lane L holds the cars with L*W < d < L*W+W, W = LANE_WIDTH (same test as the lane
+//   checks of the planner), cars on a lane marking or left of lane 0 are in no bucket
+// + id = fusion index = column of the PredictionTable
+// + CSR layout (lane_start) like the map grid, per lane suffix minimum of the speed
+//   for "slowest car ahead of s" queries
+// + queries are binary searches on s, the buffers keep their capacity between ticks
+// -------------------------------------------------------------------------------------
+
+class FusionTable {
+
+ public:
+
+  void build(const PredictionTable &prediction, int step, float lane_width = LANE_WIDTH) {
+
+    int           n      = prediction.vehicles();
+    const double *pred_s = prediction.s_at(step);
+    const double *pred_d = prediction.d_at(step);
+
+    car_s.resize(n);
+    car_speed.resize(n);
+    car_lane.resize(n);
+
+    int lanes_num = 0;
+    for (int i=0;i<n;++i) {
+
+      car_s[i]     = pred_s[i];
+      car_speed[i] = prediction.speed(i,step);
+
+      // lane of the car, -1 = none (d<=0 truncates to lane 0 and fails the test)
+      float d      = pred_d[i];
+      int   lane   = (d>0 && d<FUSION_MAX_D) ? int(d/lane_width) : -1;
+      float center = lane_width/2+lane_width*lane;
+      if (!(lane>=0 && d<(center+lane_width/2) && d>(center-lane_width/2))) lane = -1;
+      car_lane[i] = lane;
+      lanes_num   = std::max(lanes_num,lane+1);
+    }
+
+    // count, prefix sum, fill - per lane the cars stay in fusion order
+    lane_start.assign(lanes_num+1,0);
+    for (int i=0;i<n;++i) {
+      if (car_lane[i]>=0) lane_start[car_lane[i]+1]++;
+    }
+    for (int l=0;l<lanes_num;++l) lane_start[l+1] += lane_start[l];
+
+    // fill in the order of the previous tick (cars keep their fusion index between
+    // ticks and rarely overtake each other), new entries at the end
+    int m = lane_start[lanes_num];
+    order.resize(m);
+    fill.assign(lane_start.begin(),lane_start.end()-1);
+    placed.assign(n,0);
+    for (int k=0;k<(int)id.size();++k) {
+      int i = id[k];
+      if (i<n && car_lane[i]>=0 && !placed[i]) {
+        order[fill[car_lane[i]]++] = Entry { car_s[i], i };
+        placed[i] = 1;
+      }
+    }
+    for (int i=0;i<n;++i) {
+      if (car_lane[i]>=0 && !placed[i]) order[fill[car_lane[i]]++] = Entry { car_s[i], i };
+    }
+
+    // sort by predicted s, ties by fusion order - insertion sort for the almost
+    // sorted buckets, std::sort if a bucket turns out to be shuffled
+    for (int l=0;l<lanes_num;++l) {
+      std::vector<Entry>::iterator first = order.begin()+lane_start[l];
+      std::vector<Entry>::iterator last  = order.begin()+lane_start[l+1];
+      if (!insertion_sort(first,last,FUSION_SORT_MOVES*(last-first))) std::sort(first,last);
+    }
+
+    s.resize(m);
+    speed.resize(m);
+    min_speed.resize(m);
+    id.resize(m);
+    for (int k=0;k<m;++k) {
+      s[k]     = order[k].s;
+      id[k]    = order[k].id;
+      speed[k] = car_speed[id[k]];
+    }
+    for (int l=0;l<lanes_num;++l) {
+      for (int k=lane_start[l+1]-1;k>=lane_start[l];--k) {
+        min_speed[k] = (k==lane_start[l+1]-1) ? speed[k] : std::min(speed[k],min_speed[k+1]);
+      }
+    }
+  }
+
+  int lanes() const { return lane_start.empty() ? 0 : lane_start.size()-1; }
+
+  // bucket [begin(lane),end(lane)) - empty for lanes without cars
+  int begin(int lane) const { return (lane>=0 && lane<lanes()) ? lane_start[lane] : 0; }
+  int end(int lane)   const { return (lane>=0 && lane<lanes()) ? lane_start[lane+1] : 0; }
+
+  // first car of LANE with s > ref_s, end(lane) if none
+  int nearest_ahead(int lane, double ref_s) const {
+    return std::upper_bound(s.begin()+begin(lane),s.begin()+end(lane),ref_s)-s.begin();
+  }
+
+  // last car of LANE with s <= ref_s, -1 if none
+  int nearest_behind(int lane, double ref_s) const {
+    int k = nearest_ahead(lane,ref_s);
+    return (k>begin(lane)) ? k-1 : -1;
+  }
+
+  // -----------------------------------------------------------------------------------
+  // gap in LANE around ref_s: no car with ref_s-back < s and s-ref_s <= front
+  // + RETURN: first car ahead of the gap (end(lane) if none), -1 if the gap is taken
+  // -----------------------------------------------------------------------------------
+
+  int gap(int lane, double ref_s, double back, double front) const {
+    int k = nearest_ahead(lane,ref_s-back);
+    if (k<end(lane) && !((s[k]-ref_s)>front)) return -1;
+    return k;
+  }
+
+  // predicted s, speed and fusion index per bucketed car, sorted by s per lane
+  std::vector<double> s;
+  std::vector<double> speed;
+  std::vector<double> min_speed;  // min. speed from this car to the end of its lane
+  std::vector<int>    id;
+
+ private:
+
+  struct Entry {
+    double s;
+    int    id;
+    bool operator<(const Entry &e) const { return s<e.s || (s==e.s && id<e.id); }
+  };
+
+  // false (range partly sorted) once more than MOVES entries had to be shifted
+  static bool insertion_sort(std::vector<Entry>::iterator first, std::vector<Entry>::iterator last, long moves) {
+    for (std::vector<Entry>::iterator i=first+(first!=last);i<last;++i) {
+      Entry                        e = *i;
+      std::vector<Entry>::iterator j = i;
+      for (;j>first && e<*(j-1);--j) {
+        *j = *(j-1);
+        if (--moves<0) {
+          *(j-1) = e;
+          return false;
+        }
+      }
+      *j = e;
+    }
+    return true;
+  }
+
+  // per fusion entry
+  std::vector<double> car_s;
+  std::vector<double> car_speed;
+  std::vector<int>    car_lane;
+
+  std::vector<int>    lane_start;
+  std::vector<int>    fill;
+  std::vector<Entry>  order;
+  std::vector<char>   placed;
+};
+
+#endif /* FUSION_H */
@@ -0,0 +1,209 @@
+// -------------------------------------------------------------------------------------
+// highway_sim - headless closed loop simulator, drives the planner like the simulator
+//
+// + build:  g++ -O2 -std=c++11 highway_sim.cpp -luWS -lssl -lcrypto -lz -lpthread -o highway_sim
+// + run:    ./highway_sim [vehicles] [seconds] [uri] [--sessions=N] [--seed=N]
+//                         [--step=N] [--map=<file>]
+//           defaults 12 vehicles, 300 simulated s, ws://127.0.0.1:4567, 1 session,
+//           seed 1, 3 points per tick, ../data/highway_map.csv
+//
+// + every session is a simulator connection with its own world: the ego car at the
+//   start position of the simulator and VEHICLES traffic vehicles, placed and driven
+//   with the SEED (+ session index) - the same seed replays the same traffic as long
+//   as the planner drives the same way
+// + per tick the session sends a 42["telemetry",{...}] frame, waits for the control
+//   reply and advances the world by STEP points (POINTS_PER_SEC each): the ego car
+//   drives to the next points of next_x/next_y (stands if there are none left), the
+//   unused points are the previous path of the next frame - no waiting for the
+//   wall clock, the world runs as fast as the planner answers
+// + traffic: intelligent driver model behind the next vehicle in the lane (the ego
+//   car included), now and then a lane change into a free neighbouring lane
+// + checks every point like the simulator: collisions (ego and vehicle footprints
+//   overlap in s/d), acceleration and jerk over 0.2 s windows (10 m/s^2, 10 m/s^3),
+//   speed above 50 mph, ego off the road - counted as incidents (a violation lasting
+//   several points is one incident)
+// + reports per tick latency (p50, p99, max), ticks and simulated seconds per wall
+//   second, driven distance and the incidents - exit code 1 if there was one
+// -------------------------------------------------------------------------------------
+
+#include <uWS/uWS.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "control.h"
+#include "highway_sim.h"
+#include "map_file.h"
+
+using namespace std;
+
+// -------------------------------------------------------------------------------------
+// function parse_control
+//
+// + next_x/next_y of a 42["control",{...}] reply, false if it is none
+// -------------------------------------------------------------------------------------
+
+static bool parse_array(const string &msg, const char *key, vector<double> &values) {
+
+  values.clear();
+  size_t at = msg.find(key);
+  if (at==string::npos) return false;
+  at = msg.find('[',at);
+  if (at==string::npos) return false;
+
+  const char *p = msg.c_str()+at+1;
+  while (*p && *p!=']') {
+    char  *stop;
+    double value = strtod(p,&stop);
+    if (stop==p) return false;
+    values.push_back(value);
+    p = stop;
+    while (*p==',' || *p==' ') ++p;
+  }
+  return *p==']';
+}
+
+static bool parse_control(const char *data, size_t length, vector<double> &next_x, vector<double> &next_y) {
+  string msg(data,length);
+  return msg.compare(0,13,"42[\"control\",")==0 &&
+         parse_array(msg,"\"next_x\"",next_x) && parse_array(msg,"\"next_y\"",next_y) &&
+         next_x.size()==next_y.size();
+}
+
+
+// -------------------------------------------------------------------------------------
+// struct SimSession
+//
+// + one connection: its world, buffers and the send time of the frame in flight
+// -------------------------------------------------------------------------------------
+
+struct SimSession {
+
+  SimSession(const HighwayMap &map, int vehicles, unsigned seed) : sim(map,vehicles,seed), ticks(0), done(false) {}
+
+  HighwaySim                        sim;
+  string                            frame;
+  vector<double>                    next_x;
+  vector<double>                    next_y;
+  chrono::steady_clock::time_point  sent;
+  long                              ticks;
+  bool                              done;
+};
+
+int main(int argc, char **argv) {
+
+  // positional: vehicles, seconds, uri - options anywhere
+  vector<string> args;
+  int            sessions = 1;
+  unsigned       seed     = 1;
+  int            step     = 3;
+  string         map_file = "../data/highway_map.csv";
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if      (arg.compare(0,11,"--sessions=")==0) sessions = max(1,atoi(arg.c_str()+11));
+    else if (arg.compare(0,7,"--seed=")==0)      seed     = strtoul(arg.c_str()+7,nullptr,10);
+    else if (arg.compare(0,7,"--step=")==0)      step     = max(1,atoi(arg.c_str()+7));
+    else if (arg.compare(0,6,"--map=")==0)       map_file = arg.c_str()+6;
+    else                                         args.push_back(arg);
+  }
+  int    vehicles = (args.size()>0) ? atoi(args[0].c_str()) : 12;
+  double seconds  = (args.size()>1) ? atof(args[1].c_str()) : 300.0;
+  string uri      = (args.size()>2) ? args[2] : "ws://127.0.0.1:4567";
+
+  unique_ptr<HighwayMap> map = load_map(map_file);
+  if (!map) return -1;
+
+  vector<unique_ptr<SimSession>> session;
+  for (int i=0;i<sessions;++i) session.emplace_back(new SimSession(*map,vehicles,seed+i));
+
+  uWS::Hub h;
+
+  vector<double> latency;   // us per tick
+  int            open_num = 0;
+  int            errors   = 0;
+  auto           start    = chrono::steady_clock::now();
+
+  h.onConnection([&](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    SimSession *ss = session[open_num++].get();
+    ws.setUserData(ss);
+    if (open_num==sessions) start = chrono::steady_clock::now();
+    ss->sim.telemetry(ss->frame);
+    ss->sent = chrono::steady_clock::now();
+    ws.send(ss->frame.data(),ss->frame.length(),uWS::OpCode::TEXT);
+  });
+
+  h.onMessage([&](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode opCode) {
+
+    SimSession *ss = static_cast<SimSession *>(ws.getUserData());
+    if (ss->done) return;
+
+    auto now = chrono::steady_clock::now();
+    latency.push_back(chrono::duration<double,micro>(now-ss->sent).count());
+    ss->ticks++;
+
+    if (!parse_control(data,length,ss->next_x,ss->next_y)) {
+      errors++;
+      ss->done = true;
+      ws.close();
+      return;
+    }
+    ss->sim.control(ss->next_x,ss->next_y,step);
+
+    if (ss->sim.sim_time()>=seconds) {
+      ss->done = true;
+      ws.close();
+      return;
+    }
+
+    ss->sim.telemetry(ss->frame);
+    ss->sent = chrono::steady_clock::now();
+    ws.send(ss->frame.data(),ss->frame.length(),uWS::OpCode::TEXT);
+  });
+
+  h.onDisconnection([&](uWS::WebSocket<uWS::CLIENT> ws, int code, char *message, size_t length) {
+    if (--open_num==0) cout << "all sessions closed" << endl;
+  });
+
+  h.onError([&](void *user) {
+    cerr << "connection failed: " << uri << endl;
+    exit(-1);
+  });
+
+  for (int i=0;i<sessions;++i) h.connect(uri,nullptr);
+
+  h.run();
+
+  double       elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+  long         ticks   = 0;
+  double       sim_s   = 0;
+  double       driven  = 0;
+  SimIncidents incidents;
+  for (auto &ss : session) {
+    ticks  += ss->ticks;
+    sim_s  += ss->sim.sim_time();
+    driven += ss->sim.distance_driven();
+    incidents.add(ss->sim.incidents);
+  }
+
+  sort(latency.begin(),latency.end());
+  auto pct = [&](double p) { return latency.empty() ? 0.0 : latency[min(latency.size()-1,size_t(p*latency.size()))]; };
+
+  cout << "sessions:         " << sessions << " (" << vehicles << " vehicles, seed " << seed << ")" << endl;
+  cout << "ticks:            " << ticks << " in " << elapsed << " s, " << ticks/elapsed << " ticks/s" << endl;
+  cout << "simulated:        " << sim_s << " s, " << sim_s/elapsed << " x real time" << endl;
+  cout << "tick latency:     p50 " << pct(0.50) << " us, p99 " << pct(0.99) << " us, max "
+       << (latency.empty() ? 0.0 : latency.back()) << " us" << endl;
+  cout << "driven:           " << driven << " m, mean " << ((sim_s>0) ? driven/sim_s*2.23694 : 0) << " mph" << endl;
+  cout << "collisions:       " << incidents.collisions << endl;
+  cout << "acceleration:     " << incidents.acc << " (max " << incidents.acc_max << " m/s^2)" << endl;
+  cout << "jerk:             " << incidents.jerk << " (max " << incidents.jerk_max << " m/s^3)" << endl;
+  cout << "speed limit:      " << incidents.speed << " (max " << incidents.speed_max*2.23694 << " mph)" << endl;
+  cout << "off road:         " << incidents.off_road << endl;
+  if (errors>0) cout << "bad replies:      " << errors << endl;
+
+  return (incidents.total()>0 || errors>0) ? 1 : 0;
+}
@@ -0,0 +1,392 @@
+#ifndef HIGHWAY_SIM_H
+#define HIGHWAY_SIM_H
+
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+#include "collision.h"
+#include "control.h"
+#include "map.h"
+#include "planner_config.h"
+
+// start position of the simulator
+const double SIM_START_S = 124.8336;
+const double SIM_START_D = 6.164833;
+
+// road and limits checked
+const int    SIM_LANES       = 3;
+const double SIM_SPEED_LIMIT = 50.0/2.23694;   // m/s
+const double SIM_ACC_MAX     = 10.0;           // m/s^2
+const double SIM_JERK_MAX    = 10.0;           // m/s^3
+const int    SIM_WINDOW      = 10;             // points of the acc/jerk average (0.2 s)
+
+// traffic: desired speeds, intelligent driver model, lane changes
+const double SIM_SPEED_MIN        = 30.0/2.23694;
+const double SIM_SPEED_MAX        = 49.0/2.23694;
+const double IDM_ACC              = 1.5;       // m/s^2
+const double IDM_DEC              = 2.0;       // m/s^2, comfortable
+const double IDM_DEC_MAX          = 8.0;       // m/s^2
+const double IDM_HEADWAY          = 1.5;       // s
+const double IDM_GAP              = 4.0;       // m
+const double SIM_LANE_OVERLAP     = 0.75*LANE_WIDTH;
+const double SIM_LANE_CHANGE_RATE = 0.05;      // per s, while following a slower vehicle
+const double SIM_LANE_CHANGE_V    = 2.0;       // m/s lateral
+const double SIM_LANE_CHANGE_GAP  = 20.0;      // m free ahead and behind in the target lane
+const double SIM_SPAWN_CLEAR      = 60.0;      // m free behind the ego car in its lane
+const double SIM_LOOKAHEAD        = 200.0;     // m, no vehicle ahead beyond
+
+
+// -------------------------------------------------------------------------------------
+// struct SimIncidents
+//
+// + incidents of a session (events) and the extremes seen
+// -------------------------------------------------------------------------------------
+
+struct SimIncidents {
+
+  SimIncidents() : collisions(0), acc(0), jerk(0), speed(0), off_road(0), acc_max(0), jerk_max(0), speed_max(0) {}
+
+  void add(const SimIncidents &o) {
+    collisions += o.collisions;
+    acc        += o.acc;
+    jerk       += o.jerk;
+    speed      += o.speed;
+    off_road   += o.off_road;
+    acc_max     = std::max(acc_max,o.acc_max);
+    jerk_max    = std::max(jerk_max,o.jerk_max);
+    speed_max   = std::max(speed_max,o.speed_max);
+  }
+
+  long total() const { return collisions+acc+jerk+speed+off_road; }
+
+  long   collisions;
+  long   acc;
+  long   jerk;
+  long   speed;
+  long   off_road;
+  double acc_max;
+  double jerk_max;
+  double speed_max;
+};
+
+
+// -------------------------------------------------------------------------------------
+// class HighwaySim
+//
+// + world of one session: ego car and traffic on MAP, advanced point by point
+// + vehicles 0..n-1 = traffic (fusion ids), n = ego car - the ego entry takes part in
+//   the lane queries, so the traffic sees it, but is only moved along the plan
+// -------------------------------------------------------------------------------------
+
+class HighwaySim {
+
+ public:
+
+  HighwaySim(const HighwayMap &map, int vehicles, unsigned seed)
+    : map(map), n(vehicles), rng(seed), hint(-1), next(0), yaw(0), time(0), driven(0),
+      acc_on(false), jerk_on(false), speed_on(false), off_road_on(false) {
+
+    s.resize(n+1);
+    d.resize(n+1);
+    v.resize(n+1);
+    v0.resize(n+1);
+    d_target.resize(n+1);
+    x.resize(n+1);
+    y.resize(n+1);
+    vx.assign(n+1,0);
+    vy.assign(n+1,0);
+    acc_i.resize(n);
+    touching.assign(n,0);
+
+    // ego at the start of the simulator, heading along the road
+    s[n] = SIM_START_S;
+    d[n] = SIM_START_D;
+    v[n] = 0;
+    map.getXY(s[n],d[n],x[n],y[n]);
+    double hx, hy;
+    map.getXY(s[n]+1,d[n],hx,hy);
+    yaw = atan2(hy-y[n],hx-x[n]);
+
+    // traffic: random s and lane, clear of the ego car and of each other
+    std::uniform_real_distribution<double> random_s(0,map.max_s);
+    std::uniform_real_distribution<double> random_v(SIM_SPEED_MIN,SIM_SPEED_MAX);
+    std::uniform_int_distribution<int>     random_lane(0,SIM_LANES-1);
+    for (int i=0;i<n;++i) {
+      for (int attempt=0;attempt<100;++attempt) {
+        s[i] = random_s(rng);
+        d[i] = LANE_WIDTH/2+LANE_WIDTH*random_lane(rng);
+        bool free = true;
+        for (int k=0;k<i && free;++k) free = (fabs(d[k]-d[i])>SIM_LANE_OVERLAP || fabs(ds(s[i],s[k]))>2*VEHICLE_LENGTH);
+        double behind = ds(s[n],s[i]);
+        if (fabs(d[n]-d[i])<SIM_LANE_OVERLAP && behind>-2*VEHICLE_LENGTH && behind<SIM_SPAWN_CLEAR) free = false;
+        if (free) break;
+      }
+      v0[i]       = random_v(rng);
+      v[i]        = v0[i];
+      d_target[i] = d[i];
+      map.getXY(s[i],d[i],x[i],y[i]);
+    }
+    order.resize(n+1);
+    for (int i=0;i<=n;++i) order[i] = i;
+    rank.resize(n+1);
+  }
+
+  // -----------------------------------------------------------------------------------
+  // telemetry frame of the current state into FRAME
+  // -----------------------------------------------------------------------------------
+
+  void telemetry(std::string &frame) const {
+
+    double end_s = 0, end_d = 0;
+    int    left  = path_x.size()-next;
+    if (left>0) {
+      int    last    = path_x.size()-1;
+      double end_yaw = (left>1) ? atan2(path_y[last]-path_y[last-1],path_x[last]-path_x[last-1]) : yaw;
+      int    end_hint = hint;
+      map.getFrenet(path_x[last],path_y[last],end_yaw,end_s,end_d,&end_hint);
+    }
+
+    frame.assign("42[\"telemetry\",{\"x\":");
+    append_double(frame,x[n]);
+    frame.append(",\"y\":");
+    append_double(frame,y[n]);
+    frame.append(",\"yaw\":");
+    append_double(frame,rad2deg(yaw));
+    frame.append(",\"speed\":");
+    append_double(frame,v[n]*2.23694);
+    frame.append(",\"s\":");
+    append_double(frame,s[n]);
+    frame.append(",\"d\":");
+    append_double(frame,d[n]);
+    frame.append(",\"previous_path_x\":");
+    append_points(frame,path_x);
+    frame.append(",\"previous_path_y\":");
+    append_points(frame,path_y);
+    frame.append(",\"end_path_s\":");
+    append_double(frame,end_s);
+    frame.append(",\"end_path_d\":");
+    append_double(frame,end_d);
+    frame.append(",\"sensor_fusion\":[");
+    for (int i=0;i<n;++i) {
+      if (i>0) frame.push_back(',');
+      frame.push_back('[');
+      frame.append(std::to_string(i));
+      double row[] = { x[i], y[i], vx[i], vy[i], s[i], d[i] };
+      for (double value : row) {
+        frame.push_back(',');
+        append_double(frame,value);
+      }
+      frame.push_back(']');
+    }
+    frame.append("]}]");
+  }
+
+  // -----------------------------------------------------------------------------------
+  // plan NEXT_X/NEXT_Y of the control reply, then STEPS points ahead
+  // -----------------------------------------------------------------------------------
+
+  void control(const std::vector<double> &next_x, const std::vector<double> &next_y, int steps) {
+    path_x = next_x;
+    path_y = next_y;
+    next   = 0;
+    for (int k=0;k<steps;++k) advance();
+  }
+
+  double sim_time() const { return time; }
+  double distance_driven() const { return driven; }
+
+  SimIncidents incidents;
+
+ private:
+
+  // s of A relative to B, wrapped into [-max_s/2,max_s/2)
+  double ds(double a, double b) const {
+    double r = fmod(a-b,map.max_s);
+    if (r<-map.max_s/2) r += map.max_s;
+    if (r>=map.max_s/2) r -= map.max_s;
+    return r;
+  }
+
+  // samples of the previous path still to drive
+  void append_points(std::string &frame, const std::vector<double> &values) const {
+    frame.push_back('[');
+    for (int i=next;i<(int)values.size();++i) {
+      if (i>next) frame.push_back(',');
+      append_double(frame,values[i]);
+    }
+    frame.push_back(']');
+  }
+
+  // gap (bumper to bumper) to the next vehicle ahead (DIR 1) or behind (-1) of
+  // vehicle I in the lane at D_LANE, its speed in V_OTHER - SIM_LOOKAHEAD if none
+  double gap(int i, double d_lane, int dir, double &v_other) const {
+    v_other = 0;
+    for (int k=1;k<=n;++k) {
+      int    j   = order[(rank[i]+dir*k+2*(n+1))%(n+1)];
+      double off = dir*ds(s[j],s[i]);
+      if (off>SIM_LOOKAHEAD) break;
+      if (off<0) continue;
+      if (fabs(d[j]-d_lane)<SIM_LANE_OVERLAP || fabs(d_target[j]-d_lane)<SIM_LANE_OVERLAP) {
+        v_other = v[j];
+        return off-VEHICLE_LENGTH;
+      }
+    }
+    return SIM_LOOKAHEAD;
+  }
+
+  // one point: traffic, ego, checks
+  void advance() {
+
+    const double dt = POINTS_PER_SEC;
+
+    // lane queries on the vehicles sorted by s
+    std::sort(order.begin(),order.end(),[this](int a, int b) { return s[a]<s[b]; });
+    for (int k=0;k<=n;++k) rank[order[k]] = k;
+
+    std::uniform_real_distribution<double> uniform(0,1);
+    for (int i=0;i<n;++i) {
+
+      // intelligent driver model
+      double v_lead;
+      double lead = std::max(gap(i,d[i],1,v_lead),0.1);
+      double want = IDM_GAP+std::max(0.0,v[i]*IDM_HEADWAY+v[i]*(v[i]-v_lead)/(2*sqrt(IDM_ACC*IDM_DEC)));
+      double acc  = IDM_ACC*(1-pow(v[i]/v0[i],4)-(want/lead)*(want/lead));
+      acc_i[i] = std::max(-IDM_DEC_MAX,acc);
+
+      // lane change while stuck behind a slower vehicle
+      if (d_target[i]==d[i] && lead<SIM_LOOKAHEAD && v_lead<v0[i] && uniform(rng)<SIM_LANE_CHANGE_RATE*dt) {
+        int lane   = int(d[i]/LANE_WIDTH);
+        int target = lane+((uniform(rng)<0.5) ? -1 : 1);
+        if (target<0 || target>=SIM_LANES) target = 2*lane-target;
+        double center = LANE_WIDTH/2+LANE_WIDTH*target;
+        double v_front, v_back;
+        if (gap(i,center,1,v_front)>SIM_LANE_CHANGE_GAP && gap(i,center,-1,v_back)>SIM_LANE_CHANGE_GAP) {
+          d_target[i] = center;
+        }
+      }
+    }
+
+    for (int i=0;i<n;++i) {
+      double px = x[i], py = y[i];
+      v[i]  = std::max(0.0,v[i]+acc_i[i]*dt);
+      s[i]  = fmod(s[i]+v[i]*dt,map.max_s);
+      d[i] += std::max(-SIM_LANE_CHANGE_V*dt,std::min(d_target[i]-d[i],SIM_LANE_CHANGE_V*dt));
+      map.getXY(s[i],d[i],x[i],y[i]);
+      vx[i] = (x[i]-px)/dt;
+      vy[i] = (y[i]-py)/dt;
+    }
+
+    // ego: next point of the plan, stands without one
+    double px = x[n], py = y[n];
+    if (next<(int)path_x.size()) {
+      x[n] = path_x[next];
+      y[n] = path_y[next];
+      ++next;
+    }
+    double step = distance(px,py,x[n],y[n]);
+    if (step>1e-3) yaw = atan2(y[n]-py,x[n]-px);
+    v[n]     = step/dt;
+    driven  += step;
+    time    += dt;
+    map.getFrenet(x[n],y[n],yaw,s[n],d[n],&hint);
+    d_target[n] = d[n];
+
+    check(px,py);
+  }
+
+  // incidents of the point just driven from PX/PY
+  void check(double px, double py) {
+
+    const double dt = POINTS_PER_SEC;
+
+    // collisions: footprint boxes overlap, one incident per contact
+    for (int i=0;i<n;++i) {
+      bool hit = fabs(ds(s[i],s[n]))<VEHICLE_LENGTH && fabs(d[i]-d[n])<VEHICLE_WIDTH;
+      if (hit && !touching[i]) incidents.collisions++;
+      touching[i] = hit;
+    }
+
+    // velocity per point, acceleration and jerk averaged over the window
+    hist_vx.push_back((x[n]-px)/dt);
+    hist_vy.push_back((y[n]-py)/dt);
+    if (hist_vx.size()>SIM_WINDOW) {
+      int    k  = hist_vx.size()-1;
+      double ax = (hist_vx[k]-hist_vx[k-SIM_WINDOW])/(SIM_WINDOW*dt);
+      double ay = (hist_vy[k]-hist_vy[k-SIM_WINDOW])/(SIM_WINDOW*dt);
+      hist_ax.push_back(ax);
+      hist_ay.push_back(ay);
+      double acc = sqrt(ax*ax+ay*ay);
+      incidents.acc_max = std::max(incidents.acc_max,acc);
+      raise(acc>SIM_ACC_MAX,acc_on,incidents.acc);
+    }
+    if (hist_ax.size()>SIM_WINDOW) {
+      int    k    = hist_ax.size()-1;
+      double jx   = (hist_ax[k]-hist_ax[k-SIM_WINDOW])/(SIM_WINDOW*dt);
+      double jy   = (hist_ay[k]-hist_ay[k-SIM_WINDOW])/(SIM_WINDOW*dt);
+      double jerk = sqrt(jx*jx+jy*jy);
+      incidents.jerk_max = std::max(incidents.jerk_max,jerk);
+      raise(jerk>SIM_JERK_MAX,jerk_on,incidents.jerk);
+    }
+    trim(hist_vx);
+    trim(hist_vy);
+    trim(hist_ax);
+    trim(hist_ay);
+
+    incidents.speed_max = std::max(incidents.speed_max,v[n]);
+    raise(v[n]>SIM_SPEED_LIMIT,speed_on,incidents.speed);
+    raise(d[n]<0 || d[n]>SIM_LANES*LANE_WIDTH,off_road_on,incidents.off_road);
+  }
+
+  // one incident when CONDITION starts
+  static void raise(bool condition, bool &on, long &count) {
+    if (condition && !on) count++;
+    on = condition;
+  }
+
+  // keep the last window + 1 values
+  static void trim(std::vector<double> &h) {
+    if (h.size()>4*SIM_WINDOW) h.erase(h.begin(),h.end()-SIM_WINDOW-1);
+  }
+
+  const HighwayMap &map;
+  int                    n;
+  std::mt19937           rng;
+
+  // vehicles 0..n-1 traffic, n ego
+  std::vector<double> s;
+  std::vector<double> d;
+  std::vector<double> v;
+  std::vector<double> v0;
+  std::vector<double> d_target;
+  std::vector<double> x;
+  std::vector<double> y;
+  std::vector<double> vx;
+  std::vector<double> vy;
+  std::vector<double> acc_i;
+  std::vector<int>    order;
+  std::vector<int>    rank;
+  std::vector<char>   touching;
+
+  // ego: plan of the last reply, next point to drive
+  std::vector<double> path_x;
+  std::vector<double> path_y;
+  int                 hint;
+  int                 next;
+  double              yaw;
+  double              time;
+  double              driven;
+
+  // window history and open incidents
+  std::vector<double> hist_vx;
+  std::vector<double> hist_vy;
+  std::vector<double> hist_ax;
+  std::vector<double> hist_ay;
+  bool                acc_on;
+  bool                jerk_on;
+  bool                speed_on;
+  bool                off_road_on;
+};
+
+#endif /* HIGHWAY_SIM_H */
@@ -0,0 +1,153 @@
+#ifndef JMT_H
+#define JMT_H
+
+#include <math.h>
+#include "map.h"
+#include "spline_fixed.h"
+
+// waypoints of the local reference line: behind / ahead of the start segment
+const int JMT_REF_BACK  = 3;
+const int JMT_REF_AHEAD = 5;
+const int JMT_REF_NUM   = JMT_REF_BACK+JMT_REF_AHEAD+1;
+
+
+// -------------------------------------------------------------------------------------
+// struct FrenetState
+//
+// + position, velocity and acceleration in s and d (m, m/s, m/s^2)
+// -------------------------------------------------------------------------------------
+
+struct FrenetState {
+  double s;
+  double s_dot;
+  double s_ddot;
+  double d;
+  double d_dot;
+  double d_ddot;
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct Jmt
+//
+// + jerk minimizing trajectory: quintic x(t) from (x0,v0,a0) to (x1,v1,a1) in T
+// + a0..a2 follow from the start state, a3..a5 from the inverse of the 3x3 end
+//   condition matrix in closed form (no solver, no heap - built per candidate)
+// + after T the end state continues with constant velocity
+// -------------------------------------------------------------------------------------
+
+struct Jmt {
+
+  void solve(double x0, double v0, double a0, double x1, double v1, double a1, double T) {
+
+    double T2 = T*T;
+    double T3 = T2*T;
+
+    // end conditions: [T^3 T^4 T^5; 3T^2 4T^3 5T^4; 6T 12T^2 20T^3] a3..a5 = b
+    double b0 = x1-(x0+v0*T+0.5*a0*T2);
+    double b1 = (v1-(v0+a0*T))*T;
+    double b2 = (a1-a0)*T2;
+
+    c[0] = x0;
+    c[1] = v0;
+    c[2] = 0.5*a0;
+    c[3] = (10*b0-4*b1+0.5*b2)/T3;
+    c[4] = (-15*b0+7*b1-b2)/(T3*T);
+    c[5] = (6*b0-3*b1+0.5*b2)/(T3*T2);
+
+    this->T  = T;
+    this->x1 = x1;
+    this->v1 = v1;
+  }
+
+  double pos(double t) const {
+    if (t>T) return x1+v1*(t-T);
+    return ((((c[5]*t+c[4])*t+c[3])*t+c[2])*t+c[1])*t+c[0];
+  }
+  double vel(double t) const {
+    if (t>T) return v1;
+    return (((5*c[5]*t+4*c[4])*t+3*c[3])*t+2*c[2])*t+c[1];
+  }
+  double acc(double t) const {
+    if (t>T) return 0;
+    return ((20*c[5]*t+12*c[4])*t+6*c[3])*t+2*c[2];
+  }
+  double jerk(double t) const {
+    if (t>T) return 0;
+    return (60*c[5]*t+24*c[4])*t+6*c[3];
+  }
+
+  double c[6];
+  double T;
+  double x1;
+  double v1;
+};
+
+
+// -------------------------------------------------------------------------------------
+// class LocalReference
+//
+// + smooth reference line around s0: natural splines x(s), y(s) through the map
+//   waypoints JMT_REF_BACK behind to JMT_REF_AHEAD ahead of the segment of s0 -
+//   the piecewise linear map has kinks at the waypoints, the splines don't
+// + s is unwrapped inside the window, so queries may run past max_s - on a section
+//   (window of a tiled route) the window stays within its waypoints, the splines
+//   extrapolate past its ends
+// + d along the right hand normal of the spline tangent (same side as the map's
+//   dx,dy)
+// -------------------------------------------------------------------------------------
+
+class LocalReference {
+
+ public:
+
+  void build(const HighwayMap &map, double s0) {
+
+    int    n     = map.size();
+    double sw    = map.wrap_s(s0);
+    int    wp    = map.segment(sw);
+    int    first = wp-JMT_REF_BACK;
+    int    num   = JMT_REF_NUM;
+
+    // section: no closing segment to wrap across, the window slides to stay on the
+    // waypoints (s unwrapped already)
+    if (map.section) {
+      num   = std::min(num,n);
+      first = std::min(std::max(first,0),n-num);
+    }
+
+    double rs[JMT_REF_NUM], rx[JMT_REF_NUM], ry[JMT_REF_NUM];
+    for (int k=0;k<num;++k) {
+      int i     = first+k;
+      int wraps = (i<0) ? -1 : i/n;
+      int idx   = i-wraps*n;
+      rs[k] = map.s[idx]+wraps*map.max_s;
+      rx[k] = map.x[idx];
+      ry[k] = map.y[idx];
+    }
+    sx.set_points(rs,rx,num);
+    sy.set_points(rs,ry,num);
+
+    // query s -> window s
+    offset = sw-s0;
+  }
+
+  void xy(double s, double d, double &x, double &y) const {
+
+    double u  = s+offset;
+    double tx = sx.deriv(u);
+    double ty = sy.deriv(u);
+    double tn = sqrt(tx*tx+ty*ty);
+
+    x = sx(u)+d*ty/tn;
+    y = sy(u)-d*tx/tn;
+  }
+
+ private:
+
+  FixedSpline<JMT_REF_NUM> sx;
+  FixedSpline<JMT_REF_NUM> sy;
+  double                   offset;
+};
+
+#endif /* JMT_H */
@@ -1,322 +1,357 @@
 #include <fstream>
 #include <math.h>
 #include <uWS/uWS.h>
+#include <atomic>
 #include <chrono>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 #include "Eigen-3.3/Eigen/Core"
 #include "Eigen-3.3/Eigen/QR"
-#include "json.hpp"
-// added spline CAM
-#include "spline.h"
+#include "map.h"
+#include "map_file.h"
+#include "tiled_map.h"
+#include "telemetry.h"
+#include "planner.h"
+#include "control.h"
+#include "tick_stats.h"
+#include "transport.h"
 
 using namespace std;
 
-// for convenience
-using json = nlohmann::json;
-
-// For converting back and forth between radians and degrees.
-constexpr double pi() { return M_PI; }
-double deg2rad(double x) { return x * pi() / 180; }
-double rad2deg(double x) { return x * 180 / pi(); }
-
-// Checks if the SocketIO event has JSON data.
-// If there is data the JSON object in string format will be returned,
-// else the empty string "" will be returned.
-string hasData(string s) {
-  auto found_null = s.find("null");
-  auto b1 = s.find_first_of("[");
-  auto b2 = s.find_first_of("}");
-  if (found_null != string::npos) {
-    return "";
-  } else if (b1 != string::npos && b2 != string::npos) {
-    return s.substr(b1, b2 - b1 + 2);
-  }
-  return "";
-}
-
-double distance(double x1, double y1, double x2, double y2)
-{
-	return sqrt((x2-x1)*(x2-x1)+(y2-y1)*(y2-y1));
-}
-int ClosestWaypoint(double x, double y, const vector<double> &maps_x, const vector<double> &maps_y)
-{
-
-	double closestLen = 100000; //large number
-	int closestWaypoint = 0;
-
-	for(int i = 0; i < maps_x.size(); i++)
-	{
-		double map_x = maps_x[i];
-		double map_y = maps_y[i];
-		double dist = distance(x,y,map_x,map_y);
-		if(dist < closestLen)
-		{
-			closestLen = dist;
-			closestWaypoint = i;
-		}
-
-	}
-
-	return closestWaypoint;
+// -------------------------------------------------------------------------------------
+// struct EventLoop
+//
+// + worker thread with its own uWS::Hub (--threads=N). The main hub accepts the
+//   connections and transfers each one to the least loaded loop, the planning of a
+//   connection then runs on that thread only.
+// -------------------------------------------------------------------------------------
 
-}
+struct EventLoop {
 
-int NextWaypoint(double x, double y, double theta, const vector<double> &maps_x, const vector<double> &maps_y)
-{
+  EventLoop() : group(nullptr), connections(0) {}
 
-	int closestWaypoint = ClosestWaypoint(x,y,maps_x,maps_y);
+  uWS::Group<uWS::SERVER> *group;        // default group of the loop's hub
+  atomic<int>              connections;  // open connections on this loop
+  thread                   worker;
+};
 
-	double map_x = maps_x[closestWaypoint];
-	double map_y = maps_y[closestWaypoint];
 
-	double heading = atan2((map_y-y),(map_x-x));
+// -------------------------------------------------------------------------------------
+// struct PlanContext
+//
+// + per connection Planner and buffers of the telemetry handler, attached to the
+//   websocket user data - every simulator connection drives its own vehicle, only
+//   the map is shared (read-only)
+// + buffers are cleared, not freed, every message, so after the first ticks the
+//   handler runs without heap allocation
+// + with --config=<file> the tick runs on a RuntimePlanner with the parameters of the
+//   file instead of the constexpr tuned Planner
+// + on a tiled route (--tiles=N) every tick plans on the MapWindow of the vehicle,
+//   otherwise on the shared map and its reference LINE (if any) - so does a route
+//   that is its own window
+// + frames are decoded into INCOMING and swapped into TELEMETRY when valid, so a
+//   frame coalesced behind a newer one (TickQueue) is simply overwritten
+// -------------------------------------------------------------------------------------
 
-	double angle = fabs(theta-heading);
-  angle = min(2*pi() - angle, angle);
+struct PlanContext {
+
+  PlanContext(const HighwayMap &map, const CostBehavior *cost, TrajectoryBackend backend,
+              const PlannerParams *params, TiledMap *tiles, const ReferenceLine *line, double deadline_share)
+    : planner(map,cost,backend), line(line), id(0), loop(nullptr), queued(false) {
+    if (params) tuned.reset(new RuntimePlanner(map,cost,backend,RuntimePlannerConfig(*params)));
+    if (tiles)  window.reset(new MapWindow(*tiles));
+    planner.set_map(map,line);
+    if (tuned) tuned->set_map(map,line);
+    planner.deadline_share = deadline_share;
+    if (tuned) tuned->deadline_share = deadline_share;
+    reserve(telemetry);
+    reserve(incoming);
+    msg.reserve(4096);
+  }
 
-  if(angle > pi()/4)
-  {
-    closestWaypoint++;
-  if (closestWaypoint == maps_x.size())
-  {
-    closestWaypoint = 0;
+  // decode buffers at their steady state size
+  static void reserve(Telemetry &t) {
+    t.previous_path_x.reserve(DISTANCE_NUM);
+    t.previous_path_y.reserve(DISTANCE_NUM);
+    t.sensor_fusion.reserve(64*SF_FIELDS);
   }
+
+  // one planning tick on the decoded telemetry
+  const Trajectory &step() {
+    if (window) {
+      const HighwayMap    &tick_map  = window->at(telemetry.car_s);
+      const ReferenceLine *tick_line = window->whole_route() ? line : nullptr;
+      planner.set_map(tick_map,tick_line);
+      if (tuned) tuned->set_map(tick_map,tick_line);
+    }
+    return tuned ? tuned->step(telemetry) : planner.step(telemetry);
   }
 
-  return closestWaypoint;
-}
+  // planner state + scratch buffers of this vehicle
+  Planner                    planner;
+  unique_ptr<RuntimePlanner> tuned;
 
-// Transform from Cartesian x,y coordinates to Frenet s,d coordinates
-vector<double> getFrenet(double x, double y, double theta, const vector<double> &maps_x, const vector<double> &maps_y)
-{
-	int next_wp = NextWaypoint(x,y, theta, maps_x,maps_y);
+  // road around the vehicle on a tiled route, reference line of the whole route
+  unique_ptr<MapWindow> window;
+  const ReferenceLine  *line;
 
-	int prev_wp;
-	prev_wp = next_wp-1;
-	if(next_wp == 0)
-	{
-		prev_wp  = maps_x.size()-1;
-	}
+  // decoded telemetry event: the one planned next, the one being decoded
+  Telemetry telemetry;
+  Telemetry incoming;
 
-	double n_x = maps_x[next_wp]-maps_x[prev_wp];
-	double n_y = maps_y[next_wp]-maps_y[prev_wp];
-	double x_x = x - maps_x[prev_wp];
-	double x_y = y - maps_y[prev_wp];
+  // reply frame
+  string msg;
 
-	// find the projection of x onto n
-	double proj_norm = (x_x*n_x+x_y*n_y)/(n_x*n_x+n_y*n_y);
-	double proj_x = proj_norm*n_x;
-	double proj_y = proj_norm*n_y;
+  // connection number of the recording (Recorder)
+  int id;
 
-	double frenet_d = distance(x_x,x_y,proj_x,proj_y);
+  // event loop serving the connection (nullptr = main hub)
+  EventLoop *loop;
 
-	//see if d value is positive or negative by comparing it to a center point
+  // waiting in the TickQueue of its loop
+  bool queued;
+};
 
-	double center_x = 1000-maps_x[prev_wp];
-	double center_y = 2000-maps_y[prev_wp];
-	double centerToPos = distance(center_x,center_y,x_x,x_y);
-	double centerToRef = distance(center_x,center_y,proj_x,proj_y);
 
-	if(centerToPos <= centerToRef)
-	{
-		frenet_d *= -1;
-	}
+// -------------------------------------------------------------------------------------
+// function plan_tick
+//
+// + planning tick of a connection on its latest telemetry: step, control message,
+//   send (stage timers tick, serialize, send)
+// -------------------------------------------------------------------------------------
+
+void plan_tick(PlanContext &ctx, uWS::WebSocket<uWS::SERVER> ws) {
 
-	// calculate s value
-	double frenet_s = 0;
-	for(int i = 0; i < prev_wp; i++)
-	{
-		frenet_s += distance(maps_x[i],maps_y[i],maps_x[i+1],maps_y[i+1]);
-	}
+  STAGE_BEGIN(tick_start);
 
-	frenet_s += distance(0,0,proj_x,proj_y);
+  // one planning tick
+  const Trajectory &trajectory = ctx.step();
 
-	return {frenet_s,frenet_d};
+  // these variables has to be set for the simulator
+  STAGE_BEGIN(serialize_start);
+  write_control(ctx.msg,trajectory.next_x_vals,trajectory.next_y_vals);
+  STAGE_END(serialize_start,STAGE_SERIALIZE);
 
+  //this_thread::sleep_for(chrono::milliseconds(1000));
+  STAGE_BEGIN(send_start);
+  ws.send(ctx.msg.data(), ctx.msg.length(), uWS::OpCode::TEXT);
+  STAGE_END(send_start,STAGE_SEND);
+  STAGE_END(tick_start,STAGE_TICK);
 }
 
-// Transform from Frenet s,d coordinates to Cartesian x,y
-vector<double> getXY(double s, double d, const vector<double> &maps_s, const vector<double> &maps_x, const vector<double> &maps_y)
-{
-	int prev_wp = -1;
 
-	while(s > maps_s[prev_wp+1] && (prev_wp < (int)(maps_s.size()-1) ))
-	{
-		prev_wp++;
-	}
+// -------------------------------------------------------------------------------------
+// struct TickQueue
+//
+// + coalescing of telemetry frames, one queue per event loop: a valid frame only
+//   queues its connection and wakes the loop (uS::Async), the ticks run after the
+//   frames already read - several frames of one socket in the same read replace
+//   each other and only the newest is planned for (counter coalesced)
+// + connections are queued at most once; a disconnect clears its entries
+// + --coalesce=0 plans every frame inline
+// -------------------------------------------------------------------------------------
 
-	int wp2 = (prev_wp+1)%maps_x.size();
+struct TickQueue {
 
-	double heading = atan2((maps_y[wp2]-maps_y[prev_wp]),(maps_x[wp2]-maps_x[prev_wp]));
-	// the x,y,s along the segment
-	double seg_s = (s-maps_s[prev_wp]);
+  struct Entry {
+    PlanContext                 *ctx;
+    uWS::WebSocket<uWS::SERVER>  ws;
+  };
 
-	double seg_x = maps_x[prev_wp]+seg_s*cos(heading);
-	double seg_y = maps_y[prev_wp]+seg_s*sin(heading);
+  TickQueue(uWS::Hub &hub) : async(new uS::Async(hub.getLoop())) {
+    pending.reserve(64);
+    ticking.reserve(64);
+    async->setData(this);
+    async->start(flush);
+  }
 
-	double perp_heading = heading-pi()/2;
+  void push(PlanContext &ctx, uWS::WebSocket<uWS::SERVER> ws) {
+    if (ctx.queued) {
+      STATS_COUNT(COUNTER_COALESCED);
+      return;
+    }
+    ctx.queued = true;
+    pending.push_back({ &ctx, ws });
+    if (pending.size()==1) async->send();
+  }
 
-	double x = seg_x + d*cos(perp_heading);
-	double y = seg_y + d*sin(perp_heading);
+  void remove(PlanContext &ctx) {
+    for (vector<Entry> *q : { &pending, &ticking }) {
+      for (Entry &e : *q) if (e.ctx==&ctx) e.ctx = nullptr;
+    }
+  }
 
-	return {x,y};
+  // plans the queued connections, a send may disconnect one of them (remove)
+  static void flush(uS::Async *a) {
+    TickQueue &q = *static_cast<TickQueue *>(a->getData());
+    q.ticking.swap(q.pending);
+    for (int i=0;i<(int)q.ticking.size();++i) {
+      Entry &e = q.ticking[i];
+      if (!e.ctx) continue;
+      e.ctx->queued = false;
+      plan_tick(*e.ctx,e.ws);
+    }
+    q.ticking.clear();
+  }
 
-}
+  uS::Async     *async;    // lives as long as the loop
+  vector<Entry>  pending;  // queued since the last flush
+  vector<Entry>  ticking;  // of the running flush
+};
+
+// queue of the event loop of the calling thread, nullptr = no coalescing
+thread_local TickQueue *tick_queue = nullptr;
 
 
+// -------------------------------------------------------------------------------------
+// struct Recorder
+//
+// + --record=<file> appends every incoming socket.io event frame as one line, tagged
+//   with the connection it came in on (recording.h), the format read by
+//   planner_replay (shared by all event loops, so locked)
+// + connections are numbered in the order they connect
+// -------------------------------------------------------------------------------------
 
+struct Recorder {
 
+  Recorder() : connections(0) {}
 
-// ------------------------------------------------------------------------
-// New variables & constants
-// + lane
-// + velocity
-// ------------------------------------------------------------------------
+  int connect() { return connections++; }
 
-int     lane     = 1;    // start lane 
-double  velocity = 0;    // start velocity 
+  void frame(int connection, const char *data, size_t length) {
+    lock_guard<mutex> guard(lock);
+    out << connection << ' ';
+    out.write(data,length);
+    out.put('\n');
+  }
 
-// constants
-const double VELOCITY_EMERGENCY  = 0.33; // speed of front car in terms percentance of ego velocity 
-const double VELOCITY_MAX        = 49.5;
-const double VELOCITY_STEP       = 0.336;
-const double VELOCITY_DEC        = 0.85;
-const int    DISTANCE_NUM        = 50;
-const double POINTS_PER_SEC      = 0.02;
-const double REF_DISTANCE        = 30.0;
-const double BACK_DISTANCE       = 0.33;
-const int PREVIOUS_SIZE_LIMIT    = 2;
+  atomic<int> connections;
+  mutex       lock;
+  ofstream    out;
+};
 
 
 // -------------------------------------------------------------------------------------
-// function check_lane
-// 
-// + check if a lane change can be preformed based on lane gap and velocity
-// + of the cars in the new lane. 
-// 
-// + RETURN: min. velocity of "front" cars n new lane if possible, else
-//           negative, if new has no "front" cars then max. velocity 
-// 
-// + CONSTANTS:  
-//    VELOCITY_MAX    = speed limit 
-//    VELOCITY_DEC    = velocity tolerance of lane change 
-//    POINTS_PER_SEC  = steps for velocity 
-//    REF_DISTANCE    = reference distance from ego car to next car  
-//    BACK_DISTANCE   = factor of reference distance of backwards cars   
-//  
-// + GAP definition 
-//                            B                 F
-//  Lane current 	  <--------> ego car <--------->  
-//  Lane to change     car (backward)                  car (front)
-//  
-//  B = REF_DISTANCE * BACK_DISTANCE
-//  F = REF_DISTANCE 
-//  
-// + LANE speed definition:  speed of new lane > speed of current lane * VELOCITY_DEC  
-//  
+// struct ShmSession
+//
+// + --shm=<name> serves one simulator session over the shared memory channel NAME
+//   (transport.h) next to the websocket server: binary telemetry / trajectory
+//   records, no framing and no json - for a simulator or hardware in the loop rig on
+//   the same host
+// + own planning context and thread, polling the channel (serve_channel)
 // -------------------------------------------------------------------------------------
 
-double check_lane (const vector<vector<double>> &fusion, double ref_s, int lane_ref, double speed_ref, int lane_off_set,int prev_size) { 
-  
-  // analyze cars on to switch lane
-  bool    lane_ok    = true;
-  double  lane_speed = VELOCITY_MAX;
-  int     lane       = lane_ref+lane_off_set;
-
-  // analyze 
-  for (int a=0;a<fusion.size();++a) {
-
-     // get line info
-     float d = fusion[a][6];
-
-     // check if inside lane
-     if (d<(2+4*lane+2) && (d>2+4*lane-2)) {
-      
-       lane_ok = false;
-
-       // get data 
-       double vx           = fusion[a][3];                    
-       double vy           = fusion[a][4];                    
-       double check_speed  = sqrt(vx*vx+vy*vy);
-       double check_car_s  = fusion[a][5];                    
-              check_car_s += ((double)prev_size*POINTS_PER_SEC*check_speed);
-       
-       // position check for lane change
-               
-       // cars in front of vehicle
-       if (check_car_s>ref_s) { 
-        
-         // no collision + speed is higher of speed of car infront current lane 
-         if ( ((check_car_s-ref_s)>REF_DISTANCE) && (check_speed>(VELOCITY_DEC*speed_ref)) ) {
-        
-           lane_ok = true;
-           // set smallest velocity of lane
-           if (check_speed<lane_speed) lane_speed = check_speed;
-         }
-      } 
-      // backwards check
-      else if (check_car_s<=(ref_s-REF_DISTANCE*BACK_DISTANCE)) {
-        
-             lane_ok = true;
-           }
-    } // end inside lane
-
-
-    // final check not ok => lane not ok  
-    if (lane_ok == false) break;                           
-
-  } // end list fusion 
-
-
-  // return status
-  if (lane_ok) return lane_speed;
-  else         return -1.0; 
+struct ShmSession {
 
-}
+  unique_ptr<ShmChannel>  channel;
+  unique_ptr<PlanContext> ctx;
+  thread                  worker;
+};
 
 
-
-int main() {
+int main(int argc, char **argv) {
   uWS::Hub h;
 
-  // Load up map values for waypoint's x,y,s and d normalized normal vectors
-  vector<double> map_waypoints_x;
-  vector<double> map_waypoints_y;
-  vector<double> map_waypoints_s;
-  vector<double> map_waypoints_dx;
-  vector<double> map_waypoints_dy;
-
-  // Waypoint map to read from
-  string map_file_ = "../data/highway_map.csv";
-  // The max s value before wrapping around the track back to 0
-  double max_s = 6945.554;
-
-  ifstream in_map_(map_file_.c_str(), ifstream::in);
-
-  string line;
-  while (getline(in_map_, line)) {
-  	istringstream iss(line);
-  	double x;
-  	double y;
-  	float s;
-  	float d_x;
-  	float d_y;
-  	iss >> x;
-  	iss >> y;
-  	iss >> s;
-  	iss >> d_x;
-  	iss >> d_y;
-  	map_waypoints_x.push_back(x);
-  	map_waypoints_y.push_back(y);
-  	map_waypoints_s.push_back(s);
-  	map_waypoints_dx.push_back(d_x);
-  	map_waypoints_dy.push_back(d_y);
+  // event loops: --threads=N, 0 = one per hardware thread, default = main hub only
+  // recording:   --record=<file> frames of all connections, tagged by connection
+  // behavior:    --behavior=rules|cost, cost planner: --lanes=N (3), --workers=N
+  //              (candidate evaluation threads, default one per hardware thread),
+  //              --budget=<ms> per tick (5)
+  // trajectory:  --trajectory=spline|jmt
+  // tuning:      --config=<file> planner parameters (see read_planner_params)
+  // map:         --map=<file> binary map file or waypoint CSV (../data/highway_map.csv)
+  //              --tiles=N tiled route, N waypoints per tile, --tile-cap=<MB> resident
+  //              tiles (256), --reference=waypoints plans on the piecewise linear
+  //              waypoints instead of the spline reference line of the map
+  // deadline:    --deadline-share=<f> share of the tick budget before the planner
+  //              degrades (0.5), --coalesce=0 plans every telemetry frame
+  // transport:   --shm=<name> additional session over a shared memory channel
+  //              (repeatable), the websocket server on port 4567 runs anyway
+  int      threads  = 1;
+  bool     use_cost = false;
+  int      lanes    = 3;
+  int      workers  = -1;
+  double   budget   = 5.0;
+  Recorder recorder;
+  TrajectoryBackend backend = TRAJECTORY_SPLINE;
+  PlannerParams     params;
+  bool              tuned    = false;
+  string            map_file_ = "../data/highway_map.csv";
+  int               tile_waypoints = 0;
+  double            tile_cap       = 256;
+  double            deadline_share = DEADLINE_SHARE;
+  bool              coalesce       = true;
+  bool              use_line       = true;
+  vector<string>    shm_names;
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if (arg.compare(0,10,"--threads=")==0) threads  = atoi(arg.c_str()+10);
+    if (arg.compare(0,9,"--record=")==0)   recorder.out.open(arg.c_str()+9,ofstream::out|ofstream::app);
+    if (arg=="--behavior=cost")            use_cost = true;
+    if (arg.compare(0,8,"--lanes=")==0)    lanes    = max(1,atoi(arg.c_str()+8));
+    if (arg.compare(0,10,"--workers=")==0) workers  = atoi(arg.c_str()+10);
+    if (arg.compare(0,9,"--budget=")==0)   budget   = atof(arg.c_str()+9);
+    if (arg=="--trajectory=jmt")           backend  = TRAJECTORY_JMT;
+    if (arg.compare(0,6,"--map=")==0)      map_file_ = arg.c_str()+6;
+    if (arg.compare(0,8,"--tiles=")==0)    tile_waypoints = atoi(arg.c_str()+8);
+    if (arg.compare(0,11,"--tile-cap=")==0) tile_cap      = atof(arg.c_str()+11);
+    if (arg.compare(0,17,"--deadline-share=")==0) deadline_share = atof(arg.c_str()+17);
+    if (arg=="--coalesce=0")               coalesce = false;
+    if (arg=="--reference=waypoints")      use_line = false;
+    if (arg.compare(0,6,"--shm=")==0)      shm_names.push_back(arg.c_str()+6);
+    if (arg.compare(0,9,"--config=")==0) {
+      if (!read_planner_params(arg.c_str()+9,params)) return -1;
+      tuned = true;
+    }
+  }
+  if (threads<=0) threads = max(1u,thread::hardware_concurrency());
+  if (workers<0)  workers = thread::hardware_concurrency();
+
+  // cost planner, candidate pool shared by all event loops (the calling loop takes
+  // part in the evaluation, so workers-1 extra threads)
+  unique_ptr<TaskPool>     pool;
+  unique_ptr<CostBehavior> cost;
+  if (use_cost) {
+    pool.reset(new TaskPool(max(workers-1,0)));
+    cost.reset(new CostBehavior(lanes,pool.get(),budget));
+    std::cout << "Cost planner: " << lanes << " lanes, " << workers << " workers, "
+              << budget << " ms budget" << std::endl;
   }
 
-  h.onMessage([&map_waypoints_x,&map_waypoints_y,&map_waypoints_s,&map_waypoints_dx,&map_waypoints_dy](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
+  // Waypoint map to read from: binary map file (./map_compiler) or waypoint CSV,
+  // max s before wrapping around the track back to 0 derived from the waypoints
+  // tiled: tiles around each vehicle resident, loaded ahead on a background thread
+  unique_ptr<HighwayMap> map_ptr;
+  unique_ptr<TiledMap>   tiles;
+  if (tile_waypoints>0) {
+    tiles = load_tiled_map(map_file_,tile_waypoints,size_t(tile_cap*(1<<20)));
+    if (!tiles) return -1;
+    std::cout << "Tiled map: " << tiles->tiles() << " tiles of " << tile_waypoints << " waypoints, "
+              << tile_cap << " MB resident" << std::endl;
+  }
+  else {
+    map_ptr = load_map(map_file_);
+    if (!map_ptr) return -1;
+  }
+
+  // segment tables built once (or mapped), shared read-only by the message handler
+  const HighwayMap &map = tiles ? tiles->route() : *map_ptr;
+
+  // smooth reference line of the whole loop, built once - the windows of a tiled
+  // route plan without, a tiled route shorter than a window is its own window and
+  // keeps it
+  unique_ptr<ReferenceLine> line;
+  bool                      own_window = map.max_s<=MAP_TILE_BEHIND+MAP_TILE_AHEAD;
+  if (use_line && (!tiles || own_window)) line.reset(new ReferenceLine(map));
+
+  auto on_message = [&recorder](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length,
                      uWS::OpCode opCode) {
+    PlanContext &ctx = *static_cast<PlanContext *>(ws.getUserData());
+
     // "42" at the start of the message means there's a websocket message event.
     // The 4 signifies a websocket message
     // The 2 signifies a websocket event
@@ -324,296 +359,21 @@ int main() {
     //cout << sdata << endl;
     if (length && length > 2 && data[0] == '4' && data[1] == '2') {
 
-      auto s = hasData(data);
-
-      if (s != "") {
-        auto j = json::parse(s);
-        
-        string event = j[0].get<string>();
-       
-        if (event == "telemetry") {
-          // j[1] is the data JSON object
-          
-        	// Main car's localization Data
-          	double car_x = j[1]["x"];
-          	double car_y = j[1]["y"];
-          	double car_s = j[1]["s"];
-          	double car_d = j[1]["d"];
-          	double car_yaw = j[1]["yaw"];
-          	double car_speed = j[1]["speed"];
-
-          	// Previous path data given to the Planner
-          	auto previous_path_x = j[1]["previous_path_x"];
-          	auto previous_path_y = j[1]["previous_path_y"];
-          	// Previous path's end s and d values 
-          	double end_path_s = j[1]["end_path_s"];
-          	double end_path_d = j[1]["end_path_d"];
-
-          	// Sensor Fusion Data, a list of all other cars on the same side of the road.
-          	auto sensor_fusion = j[1]["sensor_fusion"];
-
-          	json msgJson;
-
-                // vehicle data to simulator
-          	vector<double> next_x_vals;
-          	vector<double> next_y_vals;
-
-          	// TODO: define a path made up of (x,y) points that the car will visit sequentially every .02 seconds
-		
-		/* ************************************************************************************
- 		 * Adedd code Dec-03-2017 
- 		 * +  
- 		 * + 
-		 * ************************************************************************************ */	
-
-             	 // get from simulator
-                 int prev_size = previous_path_x.size(); 
-
-                 // -------------------------------------------------------------------------------------
-                 // sensor fusion analysis
-                 // -------------------------------------------------------------------------------------
-                 
-                 // check previous trajectory
-                 if (prev_size>0) car_s = end_path_s;
-
-                 // trigger for reducing 
-		 bool too_close       = false;
-		 bool emergency_break = false;
-
-                 // analyze sensor data for each lane
-                 for (int i=0;i<sensor_fusion.size();++i) {
-                   
-                   // check if other vehicles on my lane 
-                   float d = sensor_fusion[i][6];
-
-                   // check for vehicles inside my lane 
-                   if (d<(2+4*lane+2) && (d>2+4*lane-2)) {
-                    
-		     double vx          = sensor_fusion[i][3];                    
-		     double vy          = sensor_fusion[i][4];                    
-		     double check_speed = sqrt(vx*vx+vy*vy);                    
-		     double check_car_s = sensor_fusion[i][5];                    
-
-		     // calculate position
-     		     check_car_s += ((double)prev_size*POINTS_PER_SEC*check_speed);
-
-                     // too close ?
-		     if ((check_car_s>car_s) && ((check_car_s-car_s)<REF_DISTANCE)) {
-
-                       // reduce velocity 
-                       too_close = true;
-
-                       // ------------------------------------------------------------------------------- 
-                       // check for lane change or emergency break 
-                       // ------------------------------------------------------------------------------- 
-
-                       if (car_speed*VELOCITY_EMERGENCY > check_speed) emergency_break = true; // emergency break
-                       else {
-
-                       // lane change analysis
-                       
-                       double speed_lane   = -1.0;
-                       double speed_lane_l = -1.0;
-                                            
-                       // ------------------------------------------------------------------------------- 
-                       // lane analysis by checking gap for lane change & speed at new lane
-                       // ------------------------------------------------------------------------------- 
-
-                       //  change from left to middle lane
-
-                       if (lane == 0) {
-                         speed_lane = check_lane(sensor_fusion, car_s, lane, check_speed, 1,prev_size); 
-                         if (speed_lane > 0) {
-                           lane = 1;  
-                         } 
-
-                         // change from right to middle lane       
-                       } 
-                       else if (lane == 2) {
-                              speed_lane = check_lane(sensor_fusion, car_s, lane, check_speed, -1,prev_size); 
-                              if (speed_lane > 0) {
-                                lane = 1;  
-                              } 
-                            } 
-
-                            // change from middle to left or right lane       
-                                     
-                            else {
-                                   speed_lane_l = check_lane(sensor_fusion, car_s, lane, check_speed, -1,prev_size);
-                                   speed_lane   = check_lane(sensor_fusion, car_s, lane, check_speed,  1,prev_size);
-                                   if (speed_lane_l > speed_lane) {     
-                                     lane = 0;
-                                   }
-                                   else if (speed_lane_l < speed_lane) {
-                                          lane = 2;
-                                        }
-                                        else if (speed_lane > 0) {
-                                               lane = 0;
-                                             }  
-                                 } 
- 
-                       } // end change lane or emergency break 
- 
-                     } // end too close
-
-                   } // end in lane 
-
-                 } // end fusion analysis
-
-
-                 // -------------------------------------------------------------------------------------
-                 //  velocity adaption 
-                 // -------------------------------------------------------------------------------------
-                
-                 // reduce velocity 
-       		 if (too_close) { 
-                 
-                   velocity -= VELOCITY_STEP;
-                
-                   // emergncy break 
-                   if (emergency_break) { 
-                     velocity -= 2*VELOCITY_STEP;
-                   }
-                 }
-                 // increase velocity
- 		 else if (velocity < VELOCITY_MAX) velocity += VELOCITY_STEP;                                
-               
-
-                 // -------------------------------------------------------------------------------------
-                 // Trajectory 
-                 // -------------------------------------------------------------------------------------
- 
-                 // wavepoint list (x,y) 
-          	 vector<double> ptsx;
-          	 vector<double> ptsy;
-
-                 // start reference of vehicle               
-                 double ref_x    = car_x;
-                 double ref_y    = car_y;
-                 double ref_yaw  = deg2rad(car_yaw);
- 
-                 //  check if list size 
-                 if (prev_size < PREVIOUS_SIZE_LIMIT) {
-                  
-                   // take 2 points for path - kind of linarization (car_x + previous_x calculated from past linear)
-                   double prev_car_x = car_x-cos(ref_yaw);
-                   double prev_car_y = car_y-sin(ref_yaw);
-                   
-                   // build list
-                   ptsx.push_back(prev_car_x);
-                   ptsx.push_back(car_x);
-                   ptsy.push_back(prev_car_y);
-                   ptsy.push_back(car_y);
-                 }
-                 else {
-     
-                   // take reference from last entry of list
-                   ref_x = previous_path_x[prev_size-1];
-                   ref_y = previous_path_y[prev_size-1];
-                   // one more from past
-                   double ref_x_prev = previous_path_x[prev_size-2];
-                   double ref_y_prev = previous_path_y[prev_size-2];
-
-                   // calculate yaw
-                   ref_yaw = atan2(ref_y-ref_y_prev,ref_x-ref_x_prev);
-                  
-                   // build list
-                   ptsx.push_back(ref_x_prev);
-                   ptsx.push_back(ref_x);
-                   ptsy.push_back(ref_y_prev);
-                   ptsy.push_back(ref_y);
-                }
-
-                //
-		// Add Fenet line of 3 x REF_DISTANCE - lane selects middle of lane
-                //
-                vector<double> next_wp0 = getXY(car_s+REF_DISTANCE  ,(2+4*lane),map_waypoints_s,map_waypoints_x,map_waypoints_y);
-                vector<double> next_wp1 = getXY(car_s+REF_DISTANCE*2,(2+4*lane),map_waypoints_s,map_waypoints_x,map_waypoints_y);
-                vector<double> next_wp2 = getXY(car_s+REF_DISTANCE*3,(2+4*lane),map_waypoints_s,map_waypoints_x,map_waypoints_y);
-		
-                // add to vector (after this vector size is 5 = 2 + 3 
-          	ptsx.push_back(next_wp0[0]);
-          	ptsx.push_back(next_wp1[0]);
-          	ptsx.push_back(next_wp2[0]);
-          	ptsy.push_back(next_wp0[1]);
-          	ptsy.push_back(next_wp1[1]);
-          	ptsy.push_back(next_wp2[1]);
-
-                //
-                // Transform to vehicles coordinate system - see MPC 
-                //
-                for (int i=0;i<ptsx.size();++i) {
-                   
-                   // shift by 0 degrees
-                   double shift_x = ptsx[i]-ref_x;
-                   double shift_y = ptsy[i]-ref_y;
-                  
-                   ptsx[i] =(shift_x*cos(0-ref_yaw)-shift_y*sin(0-ref_yaw));
-                   ptsy[i] =(shift_x*sin(0-ref_yaw)+shift_y*cos(0-ref_yaw));
-                }
-
-                //
-                // Create a spline wavepoints ptsx/y
-                //
-                tk::spline s;
-                // set points
-                s.set_points(ptsx,ptsy);
-                
-                //
-                // Create/reuse path based on previous - it only unses points which have not used in simulator
-                // org. list size = 50, simulator used (simulated) 5 points => previous list size = 45
-                //
-                for (int i=0;i<previous_path_x.size(); ++i) {
-                
-          	   next_x_vals.push_back(previous_path_x[i]);
-          	   next_y_vals.push_back(previous_path_y[i]);
-                }
-
-                //
-                // Calculate how to breakup spline for trajectory - triangle linearization
-                //
-                double target_x    = REF_DISTANCE; // x horizon
-                double target_y    = s(target_x);  
-                double target_dist = sqrt((target_x*target_x)+(target_y*target_y));   
-                double x_add_on    = 0;
-                // calc. of the following loop moved for perf.
-                double N           = (target_dist/(POINTS_PER_SEC*velocity/2.24)); // note 2.24 factor for m/s vs. mph - may put out of loop
-                double target_step = (target_x)/N;                         
-
-                // 
-                // Create Trajectory 
-                // 
-                for (int i=0;i<DISTANCE_NUM-previous_path_x.size();++i) {
-                  
-                   double x_point = x_add_on+target_step;
-                   double y_point = s(x_point);  
-                   // new start      
-                   x_add_on = x_point;
-
-                   // Transfrom from vehicle coord. to simulator coord.
-                   double x_ref = x_point;                   
-                   double y_ref = y_point;                   
-                    
-                   x_point  = (x_ref*cos(ref_yaw)-y_ref*sin(ref_yaw)); 
-                   y_point  = (x_ref*sin(ref_yaw)+y_ref*cos(ref_yaw)); 
-                   
-                   x_point += ref_x; 
-                   y_point += ref_y;
-
-                   // add to vector 
-          	   next_x_vals.push_back(x_point);
-          	   next_y_vals.push_back(y_point);
-                }
-     
-                // these variables has to be set for the simulator
-          	msgJson["next_x"] = next_x_vals;
-          	msgJson["next_y"] = next_y_vals;
-
-          	auto msg = "42[\"control\","+ msgJson.dump()+"]";
-
-          	//this_thread::sleep_for(chrono::milliseconds(1000));
-          	ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
-          
+      if (recorder.out.is_open()) recorder.frame(ctx.id,data,length);
+
+      // decode straight from the websocket buffer
+      STAGE_BEGIN(parse_start);
+      TelemetryStatus status = TelemetryParser::parse(data,length,ctx.incoming);
+      STAGE_END(parse_start,STAGE_PARSE);
+
+      if (status != TELEMETRY_MANUAL) {
+
+        if (status == TELEMETRY_OK) {
+
+          // newest telemetry of the connection, planned now or when the loop flushes
+          swap(ctx.telemetry,ctx.incoming);
+          if (tick_queue) tick_queue->push(ctx,ws);
+          else            plan_tick(ctx,ws);
         }
       } else {
         // Manual driving
@@ -621,15 +381,36 @@ int main() {
         ws.send(msg.data(), msg.length(), uWS::OpCode::TEXT);
       }
     }
-  });
+  };
+
+  auto on_disconnection = [](uWS::WebSocket<uWS::SERVER> ws, int code,
+                             char *message, size_t length) {
+    PlanContext *ctx = static_cast<PlanContext *>(ws.getUserData());
+    if (ctx && ctx->loop) ctx->loop->connections--;
+    if (ctx && tick_queue) tick_queue->remove(*ctx);
+    delete ctx;
+    ws.setUserData(nullptr);
+    ws.close();
+    std::cout << "Disconnected" << std::endl;
+  };
+
+  h.onMessage(on_message);
 
-  // We don't need this since we're not using HTTP but if it's removed the
-  // program
-  // doesn't compile :-(
+  // HTTP: GET /stats = stage latencies of all planning threads as JSON, GET /metrics
+  // the same in Prometheus text format (tick_stats.h)
   h.onHttpRequest([](uWS::HttpResponse *res, uWS::HttpRequest req, char *data,
                      size_t, size_t) {
     const std::string s = "<h1>Hello world!</h1>";
-    if (req.getUrl().valueLength == 1) {
+    uWS::Header url = req.getUrl();
+    std::string path(url.value, url.valueLength);
+    std::string report;
+    if (path == "/stats") {
+      stats_json(report);
+      res->end(report.data(), report.length());
+    } else if (path == "/metrics") {
+      stats_prometheus(report);
+      res->end(report.data(), report.length());
+    } else if (req.getUrl().valueLength == 1) {
       res->end(s.data(), s.length());
     } else {
       // i guess this should be done more gracefully?
@@ -637,16 +418,50 @@ int main() {
     }
   });
 
-  h.onConnection([&h](uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+  // worker loops, connections move there right after the handshake
+  vector<unique_ptr<EventLoop>> loops;
+  int                           next_loop = 0;
+
+  const CostBehavior  *behavior = cost.get();
+  const PlannerParams *tuning   = tuned ? &params : nullptr;
+  TiledMap            *tiled    = tiles.get();
+  const ReferenceLine *ref_line = line.get();
+
+  h.onConnection([&h,&map,behavior,backend,tuning,tiled,ref_line,deadline_share,&loops,&next_loop,&recorder](
+                     uWS::WebSocket<uWS::SERVER> ws, uWS::HttpRequest req) {
+    PlanContext *ctx = new PlanContext(map,behavior,backend,tuning,tiled,ref_line,deadline_share);
+    ctx->id = recorder.connect();
+    ws.setUserData(ctx);
     std::cout << "Connected!!!" << std::endl;
-  });
 
-  h.onDisconnection([&h](uWS::WebSocket<uWS::SERVER> ws, int code,
-                         char *message, size_t length) {
-    ws.close();
-    std::cout << "Disconnected" << std::endl;
+    if (!loops.empty()) {
+      // least loaded loop, round robin between equally loaded ones
+      EventLoop *loop = nullptr;
+      for (int i=0;i<(int)loops.size();++i) {
+        EventLoop *l = loops[(next_loop+i)%loops.size()].get();
+        if (!loop || l->connections<loop->connections) loop = l;
+      }
+      next_loop = (next_loop+1)%loops.size();
+
+      loop->connections++;
+      ctx->loop = loop;
+      ws.transfer(loop->group);
+    }
   });
 
+  h.onDisconnection(on_disconnection);
+
+  // shared memory channels (--shm), one session each
+  vector<unique_ptr<ShmSession>> sessions;
+  for (const string &name : shm_names) {
+    unique_ptr<ShmSession> session(new ShmSession);
+    session->channel = ShmChannel::create(name);
+    if (!session->channel) return -1;
+    session->ctx.reset(new PlanContext(map,behavior,backend,tuning,tiled,ref_line,deadline_share));
+    sessions.push_back(move(session));
+    std::cout << "Shared memory channel " << name << std::endl;
+  }
+
   int port = 4567;
   if (h.listen(port)) {
     std::cout << "Listening to port " << port << std::endl;
@@ -654,5 +469,46 @@ int main() {
     std::cerr << "Failed to listen to port" << std::endl;
     return -1;
   }
+
+  if (threads>1) {
+    for (int i=0;i<threads;++i) {
+
+      loops.emplace_back(new EventLoop);
+      EventLoop                *loop  = loops.back().get();
+      shared_ptr<promise<void>> ready = make_shared<promise<void>>();
+      future<void>              started = ready->get_future();
+
+      loop->worker = thread([loop,ready,coalesce,&on_message,&on_disconnection]() {
+        uWS::Hub lh;
+        if (coalesce) tick_queue = new TickQueue(lh);
+        lh.onMessage(on_message);
+        lh.onDisconnection(on_disconnection);
+        // keeps the loop running while it has no sockets
+        lh.getDefaultGroup<uWS::SERVER>().addAsync();
+        loop->group = &lh.getDefaultGroup<uWS::SERVER>();
+        ready->set_value();
+        lh.run();
+      });
+      // loops run until the process exits
+      loop->worker.detach();
+      started.wait();
+    }
+    std::cout << "Planning on " << threads << " event loops" << std::endl;
+  }
+
+  // shared memory sessions, planning once the channels are all there
+  atomic<bool> shm_stop(false);
+  for (unique_ptr<ShmSession> &session : sessions) {
+    ShmSession *sp = session.get();
+    session->worker = thread([sp,&shm_stop]() {
+      PlanContext &ctx = *sp->ctx;
+      serve_channel(*sp->channel,ctx.telemetry,[&ctx]() -> const Trajectory & { return ctx.step(); },&shm_stop);
+    });
+  }
+
+  if (coalesce) tick_queue = new TickQueue(h);
   h.run();
+
+  shm_stop = true;
+  for (unique_ptr<ShmSession> &session : sessions) session->worker.join();
 }
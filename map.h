@@ -0,0 +1,652 @@
+#ifndef HIGHWAY_MAP_H
+#define HIGHWAY_MAP_H
+
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// For converting back and forth between radians and degrees.
+constexpr double pi() { return M_PI; }
+inline double deg2rad(double x) { return x * pi() / 180; }
+inline double rad2deg(double x) { return x * 180 / pi(); }
+
+// lateral range around the waypoints covered by the road (lanes + margin), used to
+// size the grid cells and to validate hinted lookups
+const double MAP_ROAD_WIDTH = 16.0;
+
+// chunk size of the batch conversions (stack buffers of gathered segment terms)
+const int MAP_BATCH = 64;
+
+// max. grid cells per waypoint of the spatial index
+const int MAP_GRID_CELLS = 4;
+
+inline double distance(double x1, double y1, double x2, double y2)
+{
+	return sqrt((x2-x1)*(x2-x1)+(y2-y1)*(y2-y1));
+}
+
+
+// -------------------------------------------------------------------------------------
+// struct MapArray
+//
+// + read-only view of N values, owned by the map (built from waypoints) or by a
+//   memory mapped map file - indexing, size() and iterators like a const vector
+// -------------------------------------------------------------------------------------
+
+template <class T>
+struct MapArray {
+
+  MapArray() : p(nullptr), n(0) {}
+  MapArray(const T *p, int n) : p(p), n(n) {}
+
+  int      size() const              { return n; }
+  bool     empty() const             { return n==0; }
+  const T *data() const              { return p; }
+  const T *begin() const             { return p; }
+  const T *end() const               { return p+n; }
+  const T &operator[](int i) const   { return p[i]; }
+  const T &back() const              { return p[n-1]; }
+
+  const T *p;
+  int      n;
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct MapTables
+//
+// + everything a HighwayMap consists of: waypoints, per segment tables, spatial
+//   index - the content of a binary map file (see map_file.h)
+// -------------------------------------------------------------------------------------
+
+struct MapTables {
+
+  // waypoints
+  MapArray<double> x;
+  MapArray<double> y;
+  MapArray<double> s;
+  MapArray<double> dx;
+  MapArray<double> dy;
+
+  // per segment tables
+  MapArray<double> seg_acc;
+  MapArray<double> seg_cos;
+  MapArray<double> seg_sin;
+  MapArray<double> seg_nx;
+  MapArray<double> seg_ny;
+  double           seg_len;           // median segment length
+
+  // spatial index
+  MapArray<int>    grid_start;
+  MapArray<int>    grid_wp;
+  double           grid_x0;
+  double           grid_y0;
+  double           grid_cell;
+  int              grid_nx;
+  int              grid_ny;
+
+  double           max_s;
+};
+
+
+// -------------------------------------------------------------------------------------
+// class HighwayMap
+//
+// + waypoint map, built once at startup and shared read-only by the planner
+//
+// + SEGMENT i runs from waypoint i to waypoint i+1, the last segment closes the
+//   loop back to waypoint 0. Per segment the map holds
+//     seg_acc    = prefix sum of the euclidian segment lengths (s used by getFrenet)
+//     cos/sin    = heading of the segment (getXY)
+//     nx/ny      = unit normal, heading-pi/2 (getXY)
+//
+// + getXY     : O(log n) binary search on waypoint s, s wraps around at max_s
+// + getFrenet : O(1) s from prefix sum table (no re-summing from waypoint 0)
+//
+// + ClosestWaypoint : uniform grid over the waypoints, cell size = max(median segment
+//   length, road width), searched ring by ring around the query cell => cost
+//   independent of map size. With a HINT (closest waypoint of the previous frame)
+//   the search walks along the waypoint list from the hint instead and only falls
+//   back to the grid unless the query is on the road next to the waypoint reached
+//   (local_bound).
+//
+// + batch getXY/getFrenet convert SoA spans into caller provided buffers, the
+//   arithmetic runs over chunks of MAP_BATCH points and vectorizes. Define
+//   HIGHWAY_MAP_SCALAR to fall back to the point by point conversion.
+//
+// + results are the same as the original per call getXY/getFrenet, only the
+//   per segment terms are computed once
+//
+// + all tables are MapArray views: built from waypoints the map owns them, loaded
+//   from a binary map file they point into the mapping (OWNER keeps it alive) -
+//   nothing is computed or copied at load time
+//
+// + a SECTION map covers a window of a longer route (tiled_map.h): s between its
+//   first and last waypoint, the loop is not closed
+// -------------------------------------------------------------------------------------
+
+class HighwayMap {
+
+ public:
+
+  HighwayMap(const std::vector<double> &maps_x, const std::vector<double> &maps_y, const std::vector<double> &maps_s,
+             const std::vector<double> &maps_dx, const std::vector<double> &maps_dy, double max_s)
+    : max_s(max_s), section(false) {
+
+    x  = keep(maps_x);
+    y  = keep(maps_y);
+    s  = keep(maps_s);
+    dx = keep(maps_dx);
+    dy = keep(maps_dy);
+
+    int n = x.size();
+
+    std::vector<double> acc_tab(n), cos_tab(n), sin_tab(n), nx_tab(n), ny_tab(n);
+
+    // prefix sum in the same order as the original loop => identical s
+    double acc = 0;
+    for (int i=0;i<n;++i) {
+      acc_tab[i] = acc;
+      if (i+1<n) acc += distance(x[i],y[i],x[i+1],y[i+1]);
+    }
+
+    std::vector<double> len_tab;
+    len_tab.reserve(n);
+    for (int i=0;i<n;++i) {
+      int    wp2     = (i+1)%n;
+      if (i+1<n) len_tab.push_back(distance(x[i],y[i],x[wp2],y[wp2]));
+      double heading = atan2((y[wp2]-y[i]),(x[wp2]-x[i]));
+      cos_tab[i] = cos(heading);
+      sin_tab[i] = sin(heading);
+      nx_tab[i]  = cos(heading-pi()/2);
+      ny_tab[i]  = sin(heading-pi()/2);
+    }
+
+    seg_acc = keep(acc_tab);
+    seg_cos = keep(cos_tab);
+    seg_sin = keep(sin_tab);
+    seg_nx  = keep(nx_tab);
+    seg_ny  = keep(ny_tab);
+
+    // typical segment length: median, the closing segment left out - the ends of a
+    // route that is not a loop are far apart
+    seg_len = 0;
+    if (!len_tab.empty()) {
+      std::nth_element(len_tab.begin(),len_tab.begin()+len_tab.size()/2,len_tab.end());
+      seg_len = len_tab[len_tab.size()/2];
+    }
+
+    build_grid();
+  }
+
+  // tables of a binary map file, OWNER = the mapping
+  // SECTION: consecutive waypoints of a longer route (see tiled_map.h) with the route's
+  // segment tables and max_s, s unwrapped past the route's wrap point - the spatial
+  // index is built over the section
+  HighwayMap(const MapTables &tables, std::shared_ptr<const void> owner, bool section = false)
+    : x(tables.x), y(tables.y), s(tables.s), dx(tables.dx), dy(tables.dy), max_s(tables.max_s),
+      section(section), seg_acc(tables.seg_acc), seg_cos(tables.seg_cos), seg_sin(tables.seg_sin),
+      seg_nx(tables.seg_nx), seg_ny(tables.seg_ny), seg_len(tables.seg_len), grid_x0(tables.grid_x0),
+      grid_y0(tables.grid_y0), grid_cell(tables.grid_cell), grid_nx(tables.grid_nx),
+      grid_ny(tables.grid_ny), grid_start(tables.grid_start), grid_wp(tables.grid_wp), owner(owner) {
+    if (section) build_grid();
+  }
+
+  // the views point into this map's storage
+  HighwayMap(const HighwayMap &) = delete;
+  HighwayMap &operator=(const HighwayMap &) = delete;
+
+  MapTables tables() const {
+    MapTables t;
+    t.x           = x;
+    t.y           = y;
+    t.s           = s;
+    t.dx          = dx;
+    t.dy          = dy;
+    t.seg_acc     = seg_acc;
+    t.seg_cos     = seg_cos;
+    t.seg_sin     = seg_sin;
+    t.seg_nx      = seg_nx;
+    t.seg_ny      = seg_ny;
+    t.seg_len     = seg_len;
+    t.grid_start  = grid_start;
+    t.grid_wp     = grid_wp;
+    t.grid_x0     = grid_x0;
+    t.grid_y0     = grid_y0;
+    t.grid_cell   = grid_cell;
+    t.grid_nx     = grid_nx;
+    t.grid_ny     = grid_ny;
+    t.max_s       = max_s;
+    return t;
+  }
+
+  int size() const { return x.size(); }
+
+  // wrap s into [0,max_s)
+  double wrap_s(double s_in) const {
+    double s_wrap = fmod(s_in,max_s);
+    if (s_wrap<0) s_wrap += max_s;
+    return s_wrap;
+  }
+
+  // segment containing s (last waypoint with s value below s_in), s_in already wrapped
+  int segment(double &s_in) const {
+    // section: below the first waypoint = past the route's wrap point, s beyond the
+    // section runs along its first / last segment
+    if (section && s_in<s[0] && s_in+max_s-s.back()<s[0]-s_in) s_in += max_s;
+    int prev_wp = int(std::lower_bound(s.begin(),s.end(),s_in)-s.begin())-1;
+    if (section) return std::max(prev_wp,0);
+    // before first waypoint => tail of the closing segment
+    if (prev_wp<0) {
+      prev_wp = s.size()-1;
+      s_in   += max_s;
+    }
+    return prev_wp;
+  }
+
+  // Transform from Frenet s,d coordinates to Cartesian x,y
+  void getXY(double s_in, double d, double &x_out, double &y_out) const {
+
+    double s_wrap  = wrap_s(s_in);
+    int    prev_wp = segment(s_wrap);
+
+    xy_kernel(x[prev_wp],y[prev_wp],seg_cos[prev_wp],seg_sin[prev_wp],seg_nx[prev_wp],seg_ny[prev_wp],
+              s_wrap-s[prev_wp],d,x_out,y_out);
+  }
+
+  std::vector<double> getXY(double s_in, double d) const {
+    double x_out, y_out;
+    getXY(s_in,d,x_out,y_out);
+    return {x_out,y_out};
+  }
+
+  // batch version over SoA spans: s[],d[] -> x[],y[] (caller provided, n entries)
+  void getXY(const double *s_in, const double *d, double *x_out, double *y_out, int n) const {
+
+#ifdef HIGHWAY_MAP_SCALAR
+    for (int i=0;i<n;++i) getXY(s_in[i],d[i],x_out[i],y_out[i]);
+#else
+    // segment lookup per point, then the pure arithmetic over a chunk of gathered
+    // segment terms - the second loop is branch free and auto-vectorizes
+    double x0[MAP_BATCH], y0[MAP_BATCH], c[MAP_BATCH], sn[MAP_BATCH], nx[MAP_BATCH], ny[MAP_BATCH], seg_s[MAP_BATCH];
+
+    for (int b=0;b<n;b+=MAP_BATCH) {
+
+      int m = std::min(n-b,MAP_BATCH);
+
+      for (int i=0;i<m;++i) {
+        double s_wrap  = wrap_s(s_in[b+i]);
+        int    prev_wp = segment(s_wrap);
+        x0[i]    = x[prev_wp];
+        y0[i]    = y[prev_wp];
+        c[i]     = seg_cos[prev_wp];
+        sn[i]    = seg_sin[prev_wp];
+        nx[i]    = seg_nx[prev_wp];
+        ny[i]    = seg_ny[prev_wp];
+        seg_s[i] = s_wrap-s[prev_wp];
+      }
+
+      const double *d_b = d+b;
+      double       *x_b = x_out+b;
+      double       *y_b = y_out+b;
+      for (int i=0;i<m;++i) xy_kernel(x0[i],y0[i],c[i],sn[i],nx[i],ny[i],seg_s[i],d_b[i],x_b[i],y_b[i]);
+    }
+#endif
+  }
+
+  // closest waypoint to x,y - HINT (in/out) is the closest waypoint of the previous query
+  int ClosestWaypoint(double x_in, double y_in, int *hint = nullptr) const {
+
+    int closest = -1;
+
+    if (hint && *hint>=0 && *hint<size()) {
+      closest = walk_closest(x_in,y_in,*hint);
+      // walk got stuck in a local minimum or the hint was stale
+      double r = local_bound(closest);
+      if (dist2(x_in,y_in,closest)>r*r) closest = -1;
+    }
+    if (closest<0) closest = grid_closest(x_in,y_in);
+
+    if (hint) *hint = closest;
+    return closest;
+  }
+
+  int NextWaypoint(double x_in, double y_in, double theta, int *hint = nullptr) const {
+
+    int closestWaypoint = ClosestWaypoint(x_in,y_in,hint);
+
+    double heading = atan2((y[closestWaypoint]-y_in),(x[closestWaypoint]-x_in));
+
+    double angle = fabs(theta-heading);
+    angle = std::min(2*pi() - angle, angle);
+
+    if (angle>pi()/4) {
+      closestWaypoint++;
+      if (closestWaypoint==size()) closestWaypoint = section ? size()-1 : 0;
+    }
+
+    // section: no closing segment, the first / last segment extends past the ends
+    if (section) closestWaypoint = std::max(closestWaypoint,1);
+
+    return closestWaypoint;
+  }
+
+  // Transform from Cartesian x,y coordinates to Frenet s,d coordinates
+  void getFrenet(double x_in, double y_in, double theta, double &s_out, double &d_out, int *hint = nullptr) const {
+
+    int next_wp = NextWaypoint(x_in,y_in,theta,hint);
+    int prev_wp = (next_wp==0) ? x.size()-1 : next_wp-1;
+
+    frenet_kernel(x[prev_wp],y[prev_wp],x[next_wp]-x[prev_wp],y[next_wp]-y[prev_wp],seg_acc[prev_wp],
+                  x_in,y_in,s_out,d_out);
+  }
+
+  std::vector<double> getFrenet(double x_in, double y_in, double theta, int *hint = nullptr) const {
+    double s_out, d_out;
+    getFrenet(x_in,y_in,theta,s_out,d_out,hint);
+    return {s_out,d_out};
+  }
+
+  // batch version over SoA spans: x[],y[],theta[] -> s[],d[] (caller provided, n entries)
+  // consecutive points share the hint, so trajectories walk only a few waypoints each
+  void getFrenet(const double *x_in, const double *y_in, const double *theta, double *s_out, double *d_out, int n,
+                 int *hint = nullptr) const {
+
+    int local_hint = hint ? *hint : -1;
+
+#ifdef HIGHWAY_MAP_SCALAR
+    for (int i=0;i<n;++i) getFrenet(x_in[i],y_in[i],theta[i],s_out[i],d_out[i],&local_hint);
+#else
+    double x0[MAP_BATCH], y0[MAP_BATCH], n_x[MAP_BATCH], n_y[MAP_BATCH], acc[MAP_BATCH];
+
+    for (int b=0;b<n;b+=MAP_BATCH) {
+
+      int m = std::min(n-b,MAP_BATCH);
+
+      for (int i=0;i<m;++i) {
+        int next_wp = NextWaypoint(x_in[b+i],y_in[b+i],theta[b+i],&local_hint);
+        int prev_wp = (next_wp==0) ? x.size()-1 : next_wp-1;
+        x0[i]  = x[prev_wp];
+        y0[i]  = y[prev_wp];
+        n_x[i] = x[next_wp]-x[prev_wp];
+        n_y[i] = y[next_wp]-y[prev_wp];
+        acc[i] = seg_acc[prev_wp];
+      }
+
+      const double *x_b = x_in+b;
+      const double *y_b = y_in+b;
+      double       *s_b = s_out+b;
+      double       *d_b = d_out+b;
+      for (int i=0;i<m;++i) frenet_kernel(x0[i],y0[i],n_x[i],n_y[i],acc[i],x_b[i],y_b[i],s_b[i],d_b[i]);
+    }
+#endif
+
+    if (hint) *hint = local_hint;
+  }
+
+  // waypoints
+  MapArray<double> x;
+  MapArray<double> y;
+  MapArray<double> s;
+  MapArray<double> dx;
+  MapArray<double> dy;
+
+  // The max s value before wrapping around the track back to 0
+  const double max_s;
+
+  // section of a route (no closing segment), see tiled_map.h
+  const bool section;
+
+ private:
+
+  // -----------------------------------------------------------------------------------
+  // conversion kernels shared by the single point and batch versions => the batch
+  // results are bit-identical to the single point ones (same operations in the same
+  // order, no transcendental calls)
+  // -----------------------------------------------------------------------------------
+
+  static void xy_kernel(double x0, double y0, double c, double sn, double nx, double ny, double seg_s, double d,
+                        double &x_out, double &y_out) {
+
+    // the x,y along the segment
+    double seg_x = x0+seg_s*c;
+    double seg_y = y0+seg_s*sn;
+
+    x_out = seg_x+d*nx;
+    y_out = seg_y+d*ny;
+  }
+
+  static void frenet_kernel(double x0, double y0, double n_x, double n_y, double acc, double x_in, double y_in,
+                            double &s_out, double &d_out) {
+
+    double x_x = x_in-x0;
+    double x_y = y_in-y0;
+
+    // find the projection of x onto n
+    double proj_norm = (x_x*n_x+x_y*n_y)/(n_x*n_x+n_y*n_y);
+    double proj_x    = proj_norm*n_x;
+    double proj_y    = proj_norm*n_y;
+
+    double frenet_d  = distance(x_x,x_y,proj_x,proj_y);
+
+    //see if d value is positive or negative by comparing it to a center point
+    double center_x    = 1000-x0;
+    double center_y    = 2000-y0;
+    double centerToPos = distance(center_x,center_y,x_x,x_y);
+    double centerToRef = distance(center_x,center_y,proj_x,proj_y);
+
+    d_out = (centerToPos<=centerToRef) ? -frenet_d : frenet_d;
+
+    // calculate s value
+    s_out = acc+distance(0,0,proj_x,proj_y);
+  }
+
+  double dist2(double x_in, double y_in, int wp) const {
+    return (x[wp]-x_in)*(x[wp]-x_in)+(y[wp]-y_in)*(y[wp]-y_in);
+  }
+
+  // -----------------------------------------------------------------------------------
+  // uniform grid, waypoint indices bucketed per cell (CSR layout)
+  // -----------------------------------------------------------------------------------
+
+  void build_grid() {
+
+    int n = size();
+
+    double x_max = *std::max_element(x.begin(),x.end());
+    double y_max = *std::max_element(y.begin(),y.end());
+    grid_x0   = *std::min_element(x.begin(),x.end());
+    grid_y0   = *std::min_element(y.begin(),y.end());
+    grid_cell = std::max(seg_len,MAP_ROAD_WIDTH);
+
+    // sparse maps (long loops around empty land) get coarser cells
+    double area  = ((x_max-grid_x0)/grid_cell+1)*((y_max-grid_y0)/grid_cell+1);
+    double limit = double(MAP_GRID_CELLS)*n;
+    if (area>limit) grid_cell *= sqrt(area/limit);
+
+    grid_nx   = int((x_max-grid_x0)/grid_cell)+1;
+    grid_ny   = int((y_max-grid_y0)/grid_cell)+1;
+
+    // count, prefix sum, fill - waypoint indices stay ascending per cell
+    std::vector<int> start(grid_nx*grid_ny+1,0);
+    for (int i=0;i<n;++i) start[cell_of(i)+1]++;
+    for (int c=0;c<grid_nx*grid_ny;++c) start[c+1] += start[c];
+
+    std::vector<int> wp(n);
+    std::vector<int> fill(start.begin(),start.end()-1);
+    for (int i=0;i<n;++i) wp[fill[cell_of(i)]++] = i;
+
+    grid_start = keep(start);
+    grid_wp    = keep(wp);
+  }
+
+  int cell_of(int wp) const {
+    return int((y[wp]-grid_y0)/grid_cell)*grid_nx+int((x[wp]-grid_x0)/grid_cell);
+  }
+
+  int grid_closest(double x_in, double y_in) const {
+
+    // query cell, clamped to the grid
+    int cx = std::min(std::max(int(floor((x_in-grid_x0)/grid_cell)),0),grid_nx-1);
+    int cy = std::min(std::max(int(floor((y_in-grid_y0)/grid_cell)),0),grid_ny-1);
+
+    double best_d2 = -1;
+    int    best    = 0;
+
+    for (int r=0;;++r) {
+
+      int x_lo = cx-r, x_hi = cx+r;
+      int y_lo = cy-r, y_hi = cy+r;
+
+      // ring r = border cells of the (2r+1)x(2r+1) block
+      for (int gy=std::max(y_lo,0);gy<=std::min(y_hi,grid_ny-1);++gy) {
+        int step = (gy==y_lo || gy==y_hi) ? 1 : x_hi-x_lo;
+        for (int gx=x_lo;gx<=x_hi;gx+=std::max(step,1)) {
+          if (gx<0 || gx>=grid_nx) continue;
+          int c = gy*grid_nx+gx;
+          for (int k=grid_start[c];k<grid_start[c+1];++k) {
+            int    wp = grid_wp[k];
+            double d2 = dist2(x_in,y_in,wp);
+            // ties resolved to the lowest index like the linear scan
+            if (best_d2<0 || d2<best_d2 || (d2==best_d2 && wp<best)) {
+              best_d2 = d2;
+              best    = wp;
+            }
+          }
+        }
+      }
+
+      // distance from the query to the nearest unsearched cell
+      double bound   = -1;
+      bool   covered = true;
+      if (x_lo>0)         { covered = false; bound = min_bound(bound,x_in-(grid_x0+x_lo*grid_cell)); }
+      if (x_hi<grid_nx-1) { covered = false; bound = min_bound(bound,(grid_x0+(x_hi+1)*grid_cell)-x_in); }
+      if (y_lo>0)         { covered = false; bound = min_bound(bound,y_in-(grid_y0+y_lo*grid_cell)); }
+      if (y_hi<grid_ny-1) { covered = false; bound = min_bound(bound,(grid_y0+(y_hi+1)*grid_cell)-y_in); }
+
+      if (covered) break;
+      if (best_d2>=0 && bound>0 && best_d2<bound*bound) break;
+    }
+
+    return best;
+  }
+
+  static double min_bound(double bound, double side) {
+    return (bound<0) ? side : std::min(bound,side);
+  }
+
+  // max. distance of a hinted result from the query: on the road next to WP, half the
+  // longer segment at WP (closing segment left out) along, the road width across -
+  // a walk stuck on another part of the route is farther
+  double local_bound(int wp) const {
+    int    n   = size();
+    double len = 0;
+    if (wp>0)   len = std::max(len,distance(x[wp-1],y[wp-1],x[wp],y[wp]));
+    if (wp+1<n) len = std::max(len,distance(x[wp],y[wp],x[wp+1],y[wp+1]));
+    return sqrt(len*len/4+MAP_ROAD_WIDTH*MAP_ROAD_WIDTH);
+  }
+
+  // local descent along the waypoint list starting at the hint - across the closing
+  // segment of a loop, a section stops at its first / last waypoint
+  int walk_closest(double x_in, double y_in, int wp) const {
+
+    int    n  = size();
+    double d2 = dist2(x_in,y_in,wp);
+
+    for (int dir=1;dir>=-1;dir-=2) {
+      for (;;) {
+        if (section && (wp+dir<0 || wp+dir>=n)) break;
+        int    next    = (wp+dir+n)%n;
+        double next_d2 = dist2(x_in,y_in,next);
+        if (next_d2>=d2) break;
+        wp = next;
+        d2 = next_d2;
+      }
+    }
+    return wp;
+  }
+
+  // storage of a map built from waypoints - the views stay valid when the outer
+  // vector grows, moving the inner vectors keeps their buffers
+  template <class T>
+  MapArray<T> keep(const std::vector<T> &values) {
+    std::vector<std::vector<T> > &store = storage((T *)nullptr);
+    store.push_back(values);
+    return MapArray<T>(store.back().data(),store.back().size());
+  }
+  std::vector<std::vector<double> > &storage(double *) { return owned_double; }
+  std::vector<std::vector<int> >    &storage(int *)    { return owned_int; }
+
+  // per segment tables
+  MapArray<double> seg_acc;
+  MapArray<double> seg_cos;
+  MapArray<double> seg_sin;
+  MapArray<double> seg_nx;
+  MapArray<double> seg_ny;
+  double           seg_len;
+
+  // spatial index
+  double        grid_x0;
+  double        grid_y0;
+  double        grid_cell;
+  int           grid_nx;
+  int           grid_ny;
+  MapArray<int> grid_start;
+  MapArray<int> grid_wp;
+
+  // owned tables (built from waypoints) or the mapping they live in (map file)
+  std::vector<std::vector<double> > owned_double;
+  std::vector<std::vector<int> >    owned_int;
+  std::shared_ptr<const void>       owner;
+};
+
+
+// -------------------------------------------------------------------------------------
+// function read_map_csv
+//
+// + waypoint file, one "x y s d_x d_y" line per waypoint, all parsed as double
+// -------------------------------------------------------------------------------------
+
+inline void read_map_csv(const std::string &map_file, std::vector<double> &maps_x, std::vector<double> &maps_y,
+                         std::vector<double> &maps_s, std::vector<double> &maps_dx, std::vector<double> &maps_dy) {
+
+  std::ifstream in_map_(map_file.c_str(), std::ifstream::in);
+
+  std::string line;
+  while (std::getline(in_map_, line)) {
+  	std::istringstream iss(line);
+  	double x;
+  	double y;
+  	double s;
+  	double d_x;
+  	double d_y;
+  	iss >> x;
+  	iss >> y;
+  	iss >> s;
+  	iss >> d_x;
+  	iss >> d_y;
+  	maps_x.push_back(x);
+  	maps_y.push_back(y);
+  	maps_s.push_back(s);
+  	maps_dx.push_back(d_x);
+  	maps_dy.push_back(d_y);
+  }
+}
+
+
+// -------------------------------------------------------------------------------------
+// function map_max_s
+//
+// + track length: s of the last waypoint + the closing segment back to waypoint 0
+// -------------------------------------------------------------------------------------
+
+inline double map_max_s(const std::vector<double> &maps_x, const std::vector<double> &maps_y, const std::vector<double> &maps_s) {
+  int n = maps_x.size();
+  return maps_s[n-1]+distance(maps_x[n-1],maps_y[n-1],maps_x[0],maps_y[0]);
+}
+
+#endif /* HIGHWAY_MAP_H */
@@ -0,0 +1,98 @@
+// -------------------------------------------------------------------------------------
+// map_compiler - waypoint CSV to binary map file
+//
+// + build:  g++ -O2 -std=c++11 map_compiler.cpp -o map_compiler
+// + run:    ./map_compiler <map csv> <map file> [--max-s=<s>]
+//           ./path_planning --map=<map file>
+//
+// + builds the HighwayMap once (segment tables, spatial index) and writes all of it
+//   as a binary map file (map_file.h) that the planner mmaps at startup without
+//   parsing or computing anything
+// + max_s = s of the last waypoint + closing segment unless given with --max-s
+// + the file is loaded back and compared against the CSV map before reporting
+//   success
+// -------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "map.h"
+#include "map_file.h"
+
+using namespace std;
+
+int main(int argc, char **argv) {
+
+  string csv_file;
+  string map_file;
+  double max_s = -1;
+
+  int positional = 0;
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if      (arg.compare(0,8,"--max-s=")==0) max_s    = atof(arg.c_str()+8);
+    else if (positional==0)                  csv_file = arg, ++positional;
+    else if (positional==1)                  map_file = arg, ++positional;
+  }
+  if (map_file.empty()) {
+    cerr << "usage: " << argv[0] << " <map csv> <map file> [--max-s=<s>]" << endl;
+    return -1;
+  }
+
+  auto t0 = chrono::steady_clock::now();
+
+  vector<double> map_waypoints_x;
+  vector<double> map_waypoints_y;
+  vector<double> map_waypoints_s;
+  vector<double> map_waypoints_dx;
+  vector<double> map_waypoints_dy;
+
+  read_map_csv(csv_file,map_waypoints_x,map_waypoints_y,map_waypoints_s,map_waypoints_dx,map_waypoints_dy);
+  if (map_waypoints_x.size()<2) {
+    cerr << csv_file << ": no waypoints" << endl;
+    return -1;
+  }
+  if (max_s<=0) max_s = map_max_s(map_waypoints_x,map_waypoints_y,map_waypoints_s);
+
+  const HighwayMap map(map_waypoints_x,map_waypoints_y,map_waypoints_s,map_waypoints_dx,map_waypoints_dy,max_s);
+
+  auto t1 = chrono::steady_clock::now();
+
+  if (!write_map_file(map,map_file)) return -1;
+
+  auto t2 = chrono::steady_clock::now();
+
+  // load back: same tables bit for bit
+  unique_ptr<HighwayMap> loaded = load_map_file(map_file);
+  if (!loaded) return -1;
+
+  auto t3 = chrono::steady_clock::now();
+
+  MapTables a = map.tables();
+  MapTables b = loaded->tables();
+  bool same = a.max_s==b.max_s && a.seg_len==b.seg_len && a.grid_x0==b.grid_x0 &&
+              a.grid_y0==b.grid_y0 && a.grid_cell==b.grid_cell && a.grid_nx==b.grid_nx &&
+              a.grid_ny==b.grid_ny && a.grid_start.size()==b.grid_start.size();
+  const MapArray<double> *da[] = { &a.x, &a.y, &a.s, &a.dx, &a.dy, &a.seg_acc, &a.seg_cos, &a.seg_sin, &a.seg_nx, &a.seg_ny };
+  const MapArray<double> *db[] = { &b.x, &b.y, &b.s, &b.dx, &b.dy, &b.seg_acc, &b.seg_cos, &b.seg_sin, &b.seg_nx, &b.seg_ny };
+  for (int k=0;k<10 && same;++k) {
+    same = equal(da[k]->begin(),da[k]->end(),db[k]->begin());
+  }
+  same = same && equal(a.grid_start.begin(),a.grid_start.end(),b.grid_start.begin()) &&
+                 equal(a.grid_wp.begin(),a.grid_wp.end(),b.grid_wp.begin());
+  if (!same) {
+    cerr << map_file << ": map file differs from " << csv_file << endl;
+    return -1;
+  }
+
+  cout << "waypoints:  " << map.size() << endl;
+  cout << "max_s:      " << max_s << endl;
+  cout << "grid:       " << a.grid_nx << " x " << a.grid_ny << " cells" << endl;
+  cout << "csv parse:  " << chrono::duration<double,milli>(t1-t0).count() << " ms (incl. tables)" << endl;
+  cout << "write:      " << chrono::duration<double,milli>(t2-t1).count() << " ms" << endl;
+  cout << "map load:   " << chrono::duration<double,milli>(t3-t2).count() << " ms (mmap + checksum)" << endl;
+}
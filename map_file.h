@@ -0,0 +1,293 @@
+#ifndef MAP_FILE_H
+#define MAP_FILE_H
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "map.h"
+
+// binary map file: magic, format version, byte order mark
+const char     MAP_FILE_MAGIC[8]   = { 'H','W','Y','M','A','P','\0','\0' };
+const uint32_t MAP_FILE_VERSION    = 2;
+const uint32_t MAP_FILE_BYTE_ORDER = 0x01020304;
+
+// alignment of every array in the file (cache line)
+const uint64_t MAP_FILE_ALIGN = 64;
+
+// arrays of the file, in file order
+enum MapFileArray {
+  MAP_X, MAP_Y, MAP_S, MAP_DX, MAP_DY,
+  MAP_SEG_ACC, MAP_SEG_COS, MAP_SEG_SIN, MAP_SEG_NX, MAP_SEG_NY,
+  MAP_GRID_START, MAP_GRID_WP,
+  MAP_FILE_ARRAYS
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct MapFileHeader
+//
+// + start of a binary map file (map_compiler), followed by the arrays of MapTables
+//   as SoA: MAP_X..MAP_SEG_NY = double x waypoints, MAP_GRID_START = int x
+//   (grid_cells+1), MAP_GRID_WP = int x waypoints, each at a MAP_FILE_ALIGN aligned
+//   OFFSET from the start of the file, zero padded
+// + CHECKSUM = map_file_checksum of everything after the header
+// + native byte order and IEEE doubles, a file of another byte order is rejected
+// -------------------------------------------------------------------------------------
+
+struct MapFileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  uint64_t file_size;
+  uint64_t checksum;
+  uint64_t waypoints;
+  uint64_t grid_cells;
+  double   max_s;
+  double   seg_len;
+  double   grid_x0;
+  double   grid_y0;
+  double   grid_cell;
+  int32_t  grid_nx;
+  int32_t  grid_ny;
+  uint64_t offset[MAP_FILE_ARRAYS];
+};
+
+static_assert(sizeof(MapFileHeader)%MAP_FILE_ALIGN==0, "map file arrays start aligned after the header");
+
+
+// -------------------------------------------------------------------------------------
+// function map_file_checksum
+//
+// + FNV-1a over 64 bit words (the payload is a multiple of 8 bytes), runs at memory
+//   speed - the check of a country-scale map costs a fraction of a CSV parse
+// -------------------------------------------------------------------------------------
+
+inline uint64_t map_file_checksum(const char *data, uint64_t size) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (uint64_t i=0;i+8<=size;i+=8) {
+    uint64_t word;
+    memcpy(&word,data+i,8);
+    hash = (hash^word)*1099511628211ULL;
+  }
+  return hash;
+}
+
+// bytes of array A for N waypoints / C grid cells
+inline uint64_t map_file_array_size(int a, uint64_t n, uint64_t c) {
+  if (a==MAP_GRID_START) return (c+1)*sizeof(int32_t);
+  if (a==MAP_GRID_WP)    return n*sizeof(int32_t);
+  return n*sizeof(double);
+}
+
+inline uint64_t map_file_align(uint64_t offset) {
+  return (offset+MAP_FILE_ALIGN-1)/MAP_FILE_ALIGN*MAP_FILE_ALIGN;
+}
+
+
+// -------------------------------------------------------------------------------------
+// function write_map_file
+//
+// + all tables of MAP (waypoints, segment tables, spatial index) as a binary map file
+// + RETURN: false (with a message on cerr) if the file can't be written
+// -------------------------------------------------------------------------------------
+
+inline bool write_map_file(const HighwayMap &map, const std::string &map_file) {
+
+  MapTables t = map.tables();
+
+  const void *arrays[MAP_FILE_ARRAYS] = {
+    t.x.data(), t.y.data(), t.s.data(), t.dx.data(), t.dy.data(),
+    t.seg_acc.data(), t.seg_cos.data(), t.seg_sin.data(), t.seg_nx.data(), t.seg_ny.data(),
+    t.grid_start.data(), t.grid_wp.data()
+  };
+
+  MapFileHeader header;
+  memset(&header,0,sizeof(header));
+  memcpy(header.magic,MAP_FILE_MAGIC,sizeof(header.magic));
+  header.version     = MAP_FILE_VERSION;
+  header.byte_order  = MAP_FILE_BYTE_ORDER;
+  header.waypoints   = t.x.size();
+  header.grid_cells  = uint64_t(t.grid_nx)*t.grid_ny;
+  header.max_s       = t.max_s;
+  header.seg_len     = t.seg_len;
+  header.grid_x0     = t.grid_x0;
+  header.grid_y0     = t.grid_y0;
+  header.grid_cell   = t.grid_cell;
+  header.grid_nx     = t.grid_nx;
+  header.grid_ny     = t.grid_ny;
+
+  // layout, then the payload in one buffer (checksum before writing)
+  uint64_t offset = sizeof(MapFileHeader);
+  for (int a=0;a<MAP_FILE_ARRAYS;++a) {
+    header.offset[a] = offset;
+    offset = map_file_align(offset+map_file_array_size(a,header.waypoints,header.grid_cells));
+  }
+  header.file_size = offset;
+
+  std::vector<char> payload(header.file_size-sizeof(MapFileHeader),0);
+  for (int a=0;a<MAP_FILE_ARRAYS;++a) {
+    memcpy(&payload[header.offset[a]-sizeof(MapFileHeader)],arrays[a],
+           map_file_array_size(a,header.waypoints,header.grid_cells));
+  }
+  header.checksum = map_file_checksum(payload.data(),payload.size());
+
+  std::ofstream out(map_file.c_str(),std::ofstream::out|std::ofstream::binary|std::ofstream::trunc);
+  out.write((const char *)&header,sizeof(header));
+  out.write(payload.data(),payload.size());
+  out.close();
+  if (!out) {
+    std::cerr << map_file << ": can't write map file" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+
+// -------------------------------------------------------------------------------------
+// function is_map_file
+//
+// + true if MAP_FILE starts with the binary map magic (else: CSV)
+// -------------------------------------------------------------------------------------
+
+inline bool is_map_file(const std::string &map_file) {
+  char          magic[sizeof(MAP_FILE_MAGIC)];
+  std::ifstream in(map_file.c_str(),std::ifstream::in|std::ifstream::binary);
+  return in.read(magic,sizeof(magic)) && memcmp(magic,MAP_FILE_MAGIC,sizeof(magic))==0;
+}
+
+
+// -------------------------------------------------------------------------------------
+// function load_map_file
+//
+// + mmaps a binary map file read-only, the HighwayMap views point straight into the
+//   mapping (pages are loaded on first access, shared between processes)
+// + VERIFY = check the checksum (reads the whole file once)
+// + RETURN: the map, nullptr (with a message on cerr) if the file can't be mapped or
+//   fails a check: magic, version, byte order, sizes, offsets, checksum
+// -------------------------------------------------------------------------------------
+
+inline std::unique_ptr<HighwayMap> load_map_file(const std::string &map_file, bool verify = true) {
+
+  int fd = open(map_file.c_str(),O_RDONLY);
+  if (fd<0) {
+    std::cerr << map_file << ": can't open map file" << std::endl;
+    return nullptr;
+  }
+
+  struct stat st;
+  if (fstat(fd,&st)!=0 || uint64_t(st.st_size)<sizeof(MapFileHeader)) {
+    std::cerr << map_file << ": not a map file (too short)" << std::endl;
+    close(fd);
+    return nullptr;
+  }
+
+  uint64_t size = st.st_size;
+  void    *base = mmap(nullptr,size,PROT_READ,MAP_SHARED,fd,0);
+  close(fd);
+  if (base==MAP_FAILED) {
+    std::cerr << map_file << ": can't map map file" << std::endl;
+    return nullptr;
+  }
+  std::shared_ptr<const void> mapping(base,[size](const void *p) { munmap(const_cast<void *>(p),size); });
+
+  const char          *data   = static_cast<const char *>(base);
+  const MapFileHeader &header = *reinterpret_cast<const MapFileHeader *>(data);
+
+  const char *error = nullptr;
+  if      (memcmp(header.magic,MAP_FILE_MAGIC,sizeof(header.magic))!=0) error = "not a map file (magic)";
+  else if (header.version!=MAP_FILE_VERSION)                             error = "unsupported map file version";
+  else if (header.byte_order!=MAP_FILE_BYTE_ORDER)                       error = "map file of another byte order";
+  else if (header.file_size!=size)                                       error = "map file truncated";
+  else if (header.waypoints<2 || header.waypoints>0x7fffffff ||
+           header.grid_nx<=0 || header.grid_ny<=0 ||
+           header.grid_cells!=uint64_t(header.grid_nx)*header.grid_ny ||
+           header.grid_cells>=0x7fffffff)                               error = "map file sizes out of range";
+  else {
+    for (int a=0;a<MAP_FILE_ARRAYS && !error;++a) {
+      uint64_t end = header.offset[a]+map_file_array_size(a,header.waypoints,header.grid_cells);
+      if (header.offset[a]%MAP_FILE_ALIGN!=0 || header.offset[a]<sizeof(MapFileHeader) || end>size) {
+        error = "map file array out of bounds";
+      }
+    }
+  }
+  if (!error && reinterpret_cast<const int32_t *>(data+header.offset[MAP_GRID_START])[header.grid_cells]!=
+                int64_t(header.waypoints)) {
+    error = "map file spatial index inconsistent";
+  }
+  if (!error && verify &&
+      map_file_checksum(data+sizeof(MapFileHeader),size-sizeof(MapFileHeader))!=header.checksum) {
+    error = "map file checksum mismatch";
+  }
+  if (error) {
+    std::cerr << map_file << ": " << error << std::endl;
+    return nullptr;
+  }
+
+  int n = header.waypoints;
+  int c = header.grid_cells;
+  const double *d[MAP_SEG_NY+1];
+  for (int a=0;a<=MAP_SEG_NY;++a) d[a] = reinterpret_cast<const double *>(data+header.offset[a]);
+
+  MapTables t;
+  t.x           = MapArray<double>(d[MAP_X],n);
+  t.y           = MapArray<double>(d[MAP_Y],n);
+  t.s           = MapArray<double>(d[MAP_S],n);
+  t.dx          = MapArray<double>(d[MAP_DX],n);
+  t.dy          = MapArray<double>(d[MAP_DY],n);
+  t.seg_acc     = MapArray<double>(d[MAP_SEG_ACC],n);
+  t.seg_cos     = MapArray<double>(d[MAP_SEG_COS],n);
+  t.seg_sin     = MapArray<double>(d[MAP_SEG_SIN],n);
+  t.seg_nx      = MapArray<double>(d[MAP_SEG_NX],n);
+  t.seg_ny      = MapArray<double>(d[MAP_SEG_NY],n);
+  t.seg_len     = header.seg_len;
+  t.grid_start  = MapArray<int>(reinterpret_cast<const int *>(data+header.offset[MAP_GRID_START]),c+1);
+  t.grid_wp     = MapArray<int>(reinterpret_cast<const int *>(data+header.offset[MAP_GRID_WP]),n);
+  t.grid_x0     = header.grid_x0;
+  t.grid_y0     = header.grid_y0;
+  t.grid_cell   = header.grid_cell;
+  t.grid_nx     = header.grid_nx;
+  t.grid_ny     = header.grid_ny;
+  t.max_s       = header.max_s;
+
+  return std::unique_ptr<HighwayMap>(new HighwayMap(t,mapping));
+}
+
+
+// -------------------------------------------------------------------------------------
+// function load_map
+//
+// + binary map file (see load_map_file) or, as fallback, the waypoint CSV - max_s
+//   of a CSV is derived from the waypoints (map_max_s)
+// + RETURN: the map, nullptr (with a message on cerr) if there is none
+// -------------------------------------------------------------------------------------
+
+inline std::unique_ptr<HighwayMap> load_map(const std::string &map_file) {
+
+  if (is_map_file(map_file)) return load_map_file(map_file);
+
+  std::vector<double> map_waypoints_x;
+  std::vector<double> map_waypoints_y;
+  std::vector<double> map_waypoints_s;
+  std::vector<double> map_waypoints_dx;
+  std::vector<double> map_waypoints_dy;
+
+  read_map_csv(map_file,map_waypoints_x,map_waypoints_y,map_waypoints_s,map_waypoints_dx,map_waypoints_dy);
+  if (map_waypoints_x.size()<2) {
+    std::cerr << map_file << ": no waypoints" << std::endl;
+    return nullptr;
+  }
+
+  double max_s = map_max_s(map_waypoints_x,map_waypoints_y,map_waypoints_s);
+  return std::unique_ptr<HighwayMap>(new HighwayMap(map_waypoints_x,map_waypoints_y,map_waypoints_s,
+                                                    map_waypoints_dx,map_waypoints_dy,max_s));
+}
+
+#endif /* MAP_FILE_H */
@@ -0,0 +1,385 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <chrono>
+#include <math.h>
+#include <vector>
+#include "behavior.h"
+#include "fusion.h"
+#include "map.h"
+#include "planner_config.h"
+#include "prediction.h"
+#include "telemetry.h"
+#include "tick_stats.h"
+#include "trajectory.h"
+
+// -------------------------------------------------------------------------------------
+// function check_lane
+// 
+// + check if a lane change can be preformed based on lane gap and velocity
+// + of the cars in the new lane. 
+// 
+// + RETURN: min. velocity of "front" cars n new lane if possible, else
+//           negative, if new has no "front" cars then max. velocity 
+// 
+// + CONSTANTS:  
+//    VELOCITY_MAX    = speed limit 
+//    VELOCITY_DEC    = velocity tolerance of lane change 
+//    POINTS_PER_SEC  = steps for velocity 
+//    REF_DISTANCE    = reference distance from ego car to next car  
+//    BACK_DISTANCE   = factor of reference distance of backwards cars   
+//  
+// + GAP definition 
+//                            B                 F
+//  Lane current 	  <--------> ego car <--------->  
+//  Lane to change     car (backward)                  car (front)
+//  
+//  B = REF_DISTANCE * BACK_DISTANCE
+//  F = REF_DISTANCE 
+//  
+// + LANE speed definition:  speed of new lane > speed of current lane * VELOCITY_DEC  
+//  
+// + FUSION: lane bucketed table of the tick (predicted s, speed), the gap is one
+//   binary search, the lane speed the suffix minimum at the first car ahead of it
+//  
+// + CONFIG: tuning policy, the constants above by default (planner_config.h)
+//  
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+double check_lane (const Config &config, const FusionTable &fusion, double ref_s, int lane_ref, double speed_ref, int lane_off_set) { 
+  
+  STAGE_SCOPE(STAGE_CHECK_LANE);
+
+  int lane = lane_ref+lane_off_set;
+
+  // gap: no car in [ref_s-B, ref_s+F], first car ahead of it
+  int front = fusion.gap(lane,ref_s,config.ref_distance()*config.back_distance(),config.ref_distance());
+  if (front<0) return -1.0;
+
+  // no "front" cars => max. velocity
+  if (front==fusion.end(lane)) return config.velocity_max();
+
+  // all cars in front must be faster than the current lane, slowest one is the lane speed
+  double lane_speed = fusion.min_speed[front];
+  if (!(lane_speed>(config.velocity_dec()*speed_ref))) return -1.0;
+
+  return std::min(lane_speed,config.velocity_max());
+}
+
+inline double check_lane (const FusionTable &fusion, double ref_s, int lane_ref, double speed_ref, int lane_off_set) { 
+  return check_lane(DefaultPlannerConfig(),fusion,ref_s,lane_ref,speed_ref,lane_off_set);
+}
+
+
+// -------------------------------------------------------------------------------------
+// class BasicPlanner / Planner
+//
+// + planner of one vehicle (session): lane/velocity state and scratch buffers,
+//   the map is shared read-only between all planners (or, on a tiled route, the
+//   window of the session set before every tick)
+// + step: one tick, telemetry in, trajectory out
+//     0. prediction - every tracked vehicle over the horizon (PredictionTable), the
+//                     lane buckets at the end of the previous path (FusionTable)
+//     1. behavior   - sensor fusion analysis (FusionTable), lane change, velocity
+//                     adaption
+//     2. trajectory - spline through the previous path end and 3 points ahead in
+//                     the target lane, sampled for the target velocity (on the
+//                     reference line: its offset curve into the target lane)
+// + with a CostBehavior 1+2 are replaced by the candidate search (any number of
+//   lanes): every candidate gets its trajectory, the cheapest one is driven
+// + trajectories from the spline or the JMT backend, the JMT continues from the
+//   Frenet state at the end of the last trajectory sent - on the spline reference
+//   line of the map when set_map got one (ReferenceLine), else on the waypoints
+// + while the maneuver stays the same the last trajectory is extended by the
+//   consumed points only (see extend_trajectory), a new one is built on a change
+// + no heap allocation after the first ticks, the returned trajectory is valid
+//   until the next step
+// + CONFIG = tuning policy (planner_config.h): Planner = DefaultPlannerConfig, all
+//   parameters constexpr - RuntimePlanner reads them from PlannerParams
+// + stage timers (tick_stats.h): predict, fusion, behavior, check_lane, fit, sample
+// + deadline: the simulator drove (DISTANCE_NUM - previous path) points since the
+//   last trajectory, POINTS_PER_SEC each - that time is the budget of the tick. When
+//   the running estimate of a full tick exceeds DEADLINE_SHARE of it the tick is
+//   degraded: no candidate search or lane change analysis, the lane is kept, the
+//   velocity only reduced and the last trajectory extended if it still fits
+//   (counters degraded / deadline_misses)
+// -------------------------------------------------------------------------------------
+
+const double DEADLINE_SHARE = 0.5;   // share of the budget a full tick may take
+const double DEADLINE_EWMA  = 0.2;   // weight of the last full tick in the estimate
+const double DEADLINE_DECAY = 0.9;   // estimate decay per degraded tick (retry full ticks)
+
+template <class Config>
+class BasicPlanner {
+
+ public:
+
+  BasicPlanner(const HighwayMap &map, const CostBehavior *cost = nullptr,
+               TrajectoryBackend backend = TRAJECTORY_SPLINE, const Config &config = Config())
+    : lane(1), velocity(0), reuse(true), degraded(false), deadline_misses(0), deadline_share(DEADLINE_SHARE),
+      config(config), map(&map), line(nullptr), cost(cost), backend(backend), sent_num(0), estimate(0) {}
+
+  // map of the following ticks - a tiled route gives each tick the window around the
+  // vehicle (see MapWindow), the map must stay valid until the next set_map
+  // + TICK_LINE = global reference line of the map (ReferenceLine), trajectories are
+  //   built on it - none on a window, the JMT backend fits a local one then
+  void set_map(const HighwayMap &tick_map, const ReferenceLine *tick_line = nullptr) {
+    map  = &tick_map;
+    line = tick_line;
+  }
+
+  const Trajectory &step(const Telemetry &t) {
+
+    std::chrono::steady_clock::time_point tick_start = std::chrono::steady_clock::now();
+
+    // get from simulator
+    int prev_size = t.previous_path_x.size();
+
+    // time budget of the tick: points consumed since the last trajectory
+    double budget = std::max(config.distance_num()-prev_size,1)*config.points_per_sec();
+    degraded = estimate>deadline_share*budget;
+
+    // check previous trajectory
+    double car_s = (prev_size>0) ? t.end_path_s : t.car_s;
+
+    // prediction over the horizon, rates over the points driven since the last tick
+    STAGE_BEGIN(predict_start);
+    prediction.update(t,std::max(sent_num-prev_size,0)*config.points_per_sec());
+    prediction.predict(prev_size,config.distance_num(),config.points_per_sec(),config.lane_width());
+    STAGE_END(predict_start,STAGE_PREDICT);
+
+    // sensor fusion at the end of the previous path
+    STAGE_BEGIN(fusion_start);
+    fusion.build(prediction,prev_size,config.lane_width());
+    STAGE_END(fusion_start,STAGE_FUSION);
+
+    FrenetState start = start_state(t,car_s);
+
+    // cost behavior: best of the candidates, its trajectory is the result
+    if (cost && !degraded) {
+      STAGE_BEGIN(behavior_start);
+      prediction.predict_xy(*map);
+      collisions.prepare(prediction,*map);
+      cost->generate(config,lane,velocity,candidates);
+      const Candidate &best = candidates[cost->evaluate(config,*map,line,t,collisions,fusion,start,backend,
+                                                        reuse ? &plan : nullptr,lane,velocity,candidates)];
+      STAGE_END(behavior_start,STAGE_BEHAVIOR);
+      lane     = best.lane;
+      velocity = best.velocity;
+      return finished(sent(best.trajectory),tick_start,budget);
+    }
+
+    STAGE_BEGIN(behavior_start);
+    behavior(t,car_s,!degraded);
+    STAGE_END(behavior_start,STAGE_BEHAVIOR);
+
+    if ((reuse || degraded) && can_extend(config,plan,t,backend,lane,velocity,config.ref_distance())) {
+      extend_trajectory(config,*map,plan,t,out);
+    }
+    else build_trajectory(config,backend,*map,t,start,lane,velocity,config.ref_distance(),out,line);
+
+    return finished(sent(out),tick_start,budget);
+  }
+
+  // planner state
+  int     lane;        // start lane 
+  double  velocity;    // start velocity 
+  bool    reuse;       // extend the last trajectory while the maneuver is unchanged
+
+  // deadline
+  bool    degraded;         // last tick was degraded
+  long    deadline_misses;  // ticks longer than their budget
+  double  deadline_share;   // share of the budget a full tick may take (DEADLINE_SHARE)
+
+ private:
+
+  // -------------------------------------------------------------------------------------
+  // state at the end of the previous path - for the JMT backend the end state of the
+  // last trajectory if the simulator still drives it, else estimated from telemetry
+  // (s, d and the d rates on the reference line if the map has one)
+  // -------------------------------------------------------------------------------------
+
+  FrenetState start_state(const Telemetry &t, double car_s) const {
+
+    const std::vector<double> &px = t.previous_path_x;
+    const std::vector<double> &py = t.previous_path_y;
+    int                        n  = px.size();
+
+    if (backend==TRAJECTORY_JMT && continues_plan(plan,t)) return end;
+
+    FrenetState st = { car_s, t.car_speed/MPH_TO_MS, 0, t.car_d, 0, 0 };
+    if (n>=2) {
+      st.s_dot = distance(px[n-2],py[n-2],px[n-1],py[n-1])/config.points_per_sec();
+      st.d     = t.end_path_d;
+    }
+    if (line) line_start_state(*line,t,config.points_per_sec(),st);
+    return st;
+  }
+
+  const Trajectory &sent(const Trajectory &trajectory) {
+    plan     = trajectory.plan;
+    end      = trajectory.end;
+    sent_num = trajectory.next_x_vals.size();
+    return trajectory;
+  }
+
+  // -------------------------------------------------------------------------------------
+  // deadline bookkeeping: full ticks update the estimate, degraded ones let it decay
+  // so that a full tick is tried again once the budget allows it
+  // -------------------------------------------------------------------------------------
+
+  const Trajectory &finished(const Trajectory &trajectory, std::chrono::steady_clock::time_point tick_start,
+                             double budget) {
+
+    double took = std::chrono::duration<double>(std::chrono::steady_clock::now()-tick_start).count();
+
+    if (degraded) estimate *= DEADLINE_DECAY;
+    else          estimate  = (estimate>0) ? (1-DEADLINE_EWMA)*estimate+DEADLINE_EWMA*took : took;
+
+    STATS_COUNT(COUNTER_TICKS);
+    if (degraded) STATS_COUNT(COUNTER_DEGRADED);
+    if (took>budget) {
+      STATS_COUNT(COUNTER_DEADLINE_MISS);
+      ++deadline_misses;
+    }
+    return trajectory;
+  }
+
+  // -------------------------------------------------------------------------------------
+  // sensor fusion analysis + velocity adaption - not FULL (degraded tick): no lane
+  // change analysis, the velocity is held unless a car is too close
+  // -------------------------------------------------------------------------------------
+
+  void behavior(const Telemetry &t, double car_s, bool full) {
+
+    double car_speed = t.car_speed;
+
+    // trigger for reducing 
+    bool too_close       = false;
+    bool emergency_break = false;
+
+    // cars in my lane in front within REF_DISTANCE, in fusion order - a lane change
+    // switches to the cars of the new lane from the next fusion entry on
+    int last = -1;
+    for (;;) {
+
+      int car = -1;
+      for (int k=fusion.nearest_ahead(lane,car_s);k<fusion.end(lane) && (fusion.s[k]-car_s)<config.ref_distance();++k) {
+        if (fusion.id[k]>last && (car<0 || fusion.id[k]<fusion.id[car])) car = k;
+      }
+      if (car<0) break;
+      last = fusion.id[car];
+
+      double check_speed = fusion.speed[car];
+
+      // reduce velocity 
+      too_close = true;
+
+      // ------------------------------------------------------------------------------- 
+      // check for lane change or emergency break 
+      // ------------------------------------------------------------------------------- 
+
+      if (car_speed*config.velocity_emergency() > check_speed) emergency_break = true; // emergency break
+      else if (full) {
+
+        // lane change analysis
+
+        double speed_lane   = -1.0;
+        double speed_lane_l = -1.0;
+
+        // ------------------------------------------------------------------------------- 
+        // lane analysis by checking gap for lane change & speed at new lane
+        // ------------------------------------------------------------------------------- 
+
+        //  change from left to middle lane
+        if (lane == 0) {
+          speed_lane = check_lane(config, fusion, car_s, lane, check_speed, 1); 
+          if (speed_lane > 0) {
+            lane = 1;  
+          } 
+        } 
+        // change from right to middle lane       
+        else if (lane == 2) {
+          speed_lane = check_lane(config, fusion, car_s, lane, check_speed, -1); 
+          if (speed_lane > 0) {
+            lane = 1;  
+          } 
+        } 
+        // change from middle to left or right lane       
+        else {
+          speed_lane_l = check_lane(config, fusion, car_s, lane, check_speed, -1);
+          speed_lane   = check_lane(config, fusion, car_s, lane, check_speed,  1);
+          if (speed_lane_l > speed_lane) {     
+            lane = 0;
+          }
+          else if (speed_lane_l < speed_lane) {
+            lane = 2;
+          }
+          else if (speed_lane > 0) {
+            lane = 0;
+          }  
+        } 
+
+      } // end change lane or emergency break 
+
+    } // end fusion analysis
+
+
+    // -------------------------------------------------------------------------------------
+    //  velocity adaption 
+    // -------------------------------------------------------------------------------------
+
+    // reduce velocity 
+    if (too_close) { 
+
+      velocity -= config.velocity_step();
+
+      // emergncy break 
+      if (emergency_break) { 
+        velocity -= 2*config.velocity_step();
+      }
+    }
+    // increase velocity
+    else if (full && velocity < config.velocity_max()) velocity += config.velocity_step();                                
+  }
+
+
+  // tuning
+  Config config;
+
+  const HighwayMap    *map;
+  const ReferenceLine *line;
+
+  // cost behavior (shared), nullptr = rule based behavior
+  const CostBehavior *cost;
+
+  // trajectory generation, plan + end state of the last trajectory sent (extension,
+  // JMT start) - copied, the candidates are overwritten by the next tick
+  TrajectoryBackend backend;
+  TrajectoryPlan    plan;
+  FrenetState       end;
+
+  // prediction of the tick (time x vehicle), sensor fusion at the end of the
+  // previous path by lane, collision check of the candidates against the prediction
+  PredictionTable  prediction;
+  FusionTable      fusion;
+  CollisionChecker collisions;
+
+  // points of the last trajectory sent - minus the previous path = points driven
+  int sent_num;
+
+  // candidates of the cost behavior, trajectories reused between ticks
+  std::vector<Candidate> candidates;
+
+  // vehicle data to simulator
+  Trajectory out;
+
+  // running estimate of a full tick (s)
+  double estimate;
+};
+
+typedef BasicPlanner<DefaultPlannerConfig> Planner;
+typedef BasicPlanner<RuntimePlannerConfig> RuntimePlanner;
+
+#endif /* PLANNER_H */
@@ -0,0 +1,137 @@
+// -------------------------------------------------------------------------------------
+// planner_alloc_test - the steady state planning tick performs no heap allocation
+//
+// + build:  g++ -O2 -std=c++11 planner_alloc_test.cpp alloc_count.cpp -lpthread -o planner_alloc_test
+// + run:    ./planner_alloc_test [map] [--recording=<file>] [--ticks=N]
+//           map = binary map file or waypoint CSV, defaults to ../data/highway_map.csv,
+//           2000 ticks
+//
+// + a tick is the way of a telemetry frame through the server - TelemetryParser,
+//   Planner::step, write_control on the buffers of one planning context - counted
+//   with the allocation hook of alloc_count.cpp
+// + frames: closed loop with HighwaySim (ALLOC_VEHICLES vehicles, ALLOC_STEP points
+//   per tick), or the frames of a RECORDING replayed in order (the first connection
+//   of a ./path_planning --record=<file> recording)
+// + every combination of behavior (rules, cost on a TaskPool without workers, cost
+//   on ALLOC_WORKERS workers as the server runs it) and trajectory backend (spline,
+//   jmt) runs on a fresh planner; after ALLOC_WARMUP ticks no tick may allocate on
+//   the planning thread
+// + prints the first allocating ticks, exit code 1 if there was one
+// -------------------------------------------------------------------------------------
+
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "map.h"
+#include "map_file.h"
+#include "reference_line.h"
+#include "telemetry.h"
+#include "planner.h"
+#include "control.h"
+#include "highway_sim.h"
+#include "alloc_count.h"
+#include "recording.h"
+
+using namespace std;
+
+// ticks before the count starts (buffers growing to their steady state size)
+const int ALLOC_WARMUP   = 200;
+
+// closed loop world
+const int ALLOC_VEHICLES = 12;
+const int ALLOC_STEP     = 3;
+
+// worker threads of the pooled cost planner
+const int ALLOC_WORKERS  = 2;
+
+// allocating ticks printed per run
+const int ALLOC_REPORT   = 10;
+
+
+// TICKS ticks of one planner, FRAMES replayed or a closed loop if there are none -
+// number of allocating ticks after the warm-up
+static int run_ticks(const char *name, const HighwayMap &map, const ReferenceLine &line, const CostBehavior *cost,
+                     TrajectoryBackend backend, const vector<string> &frames, int ticks) {
+
+  // planning context as in the server
+  Planner planner(map,cost,backend);
+  planner.set_map(map,&line);
+  Telemetry telemetry;
+  telemetry.previous_path_x.reserve(DISTANCE_NUM);
+  telemetry.previous_path_y.reserve(DISTANCE_NUM);
+  telemetry.sensor_fusion.reserve(64*SF_FIELDS);
+  string msg;
+  msg.reserve(4096);
+
+  HighwaySim sim(map,ALLOC_VEHICLES,1);
+  string     frame;
+  int        allocating = 0;
+  long       total      = 0;
+
+  for (int k=0;k<ticks;++k) {
+
+    if (frames.empty()) sim.telemetry(frame);
+    const string &in = frames.empty() ? frame : frames[k%frames.size()];
+
+    long              before     = alloc_count();
+    const Trajectory *trajectory = nullptr;
+    if (TelemetryParser::parse(in.data(),in.size(),telemetry)==TELEMETRY_OK) {
+      trajectory = &planner.step(telemetry);
+      write_control(msg,trajectory->next_x_vals,trajectory->next_y_vals);
+    }
+    long allocs = alloc_count()-before;
+
+    if (frames.empty() && trajectory) sim.control(trajectory->next_x_vals,trajectory->next_y_vals,ALLOC_STEP);
+
+    if (k>=ALLOC_WARMUP && allocs) {
+      if (allocating<ALLOC_REPORT) printf("  %s tick %d: %ld allocations\n",name,k,allocs);
+      allocating++;
+      total += allocs;
+    }
+  }
+
+  printf("%-14s %6d ticks, %d allocating after the warm-up (%ld allocations)\n",name,ticks,allocating,total);
+  return allocating;
+}
+
+int main(int argc, char **argv) {
+
+  string map_file_ = "../data/highway_map.csv";
+  string recording;
+  int    ticks     = 2000;
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if (arg.compare(0,12,"--recording=")==0)  recording = arg.c_str()+12;
+    else if (arg.compare(0,8,"--ticks=")==0)  ticks     = atoi(arg.c_str()+8);
+    else                                      map_file_ = arg;
+  }
+
+  vector<string> frames;
+  if (!recording.empty() && !read_recording(recording,frames)) {
+    cerr << "no frames in " << recording << endl;
+    return 1;
+  }
+
+  unique_ptr<HighwayMap> map = load_map(map_file_);
+  if (!map) return 1;
+  ReferenceLine line(*map);
+
+  TaskPool     pool(0);
+  CostBehavior cost(3,&pool);
+  TaskPool     workers(ALLOC_WORKERS);
+  CostBehavior pooled(3,&workers);
+
+  int allocating = 0;
+  allocating += run_ticks("rules/spline",*map,line,nullptr,TRAJECTORY_SPLINE,frames,ticks);
+  allocating += run_ticks("rules/jmt",*map,line,nullptr,TRAJECTORY_JMT,frames,ticks);
+  allocating += run_ticks("cost/spline",*map,line,&cost,TRAJECTORY_SPLINE,frames,ticks);
+  allocating += run_ticks("cost/jmt",*map,line,&cost,TRAJECTORY_JMT,frames,ticks);
+  allocating += run_ticks("pooled/spline",*map,line,&pooled,TRAJECTORY_SPLINE,frames,ticks);
+  allocating += run_ticks("pooled/jmt",*map,line,&pooled,TRAJECTORY_JMT,frames,ticks);
+
+  cout << (allocating ? "FAILED" : "passed") << endl;
+  return allocating ? 1 : 0;
+}
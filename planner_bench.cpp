@@ -0,0 +1,841 @@
+// -------------------------------------------------------------------------------------
+// planner_bench - microbenchmarks of the planner hot path (Google Benchmark)
+//
+// + build:  g++ -O2 -std=c++11 planner_bench.cpp alloc_count.cpp -lbenchmark -lpthread -o planner_bench
+// + run:    ./planner_bench [--recording=<file>] [benchmark flags]
+//           ./planner_bench --benchmark_format=json --benchmark_out=bench.json
+//
+// + RECORDING = telemetry frames as written by ./path_planning --record=<file>, the
+//   frames of its first connection (recording.h). Without a recording a synthetic
+//   frame (47 previous path points, 12 cars) is used.
+// + geometry benchmarks run on synthetic circular tracks of 181 (simulator track) up
+//   to 100k waypoints, 30 m apart
+// + every benchmark reports ns/op (real/cpu time) and allocs/op - the latter counts
+//   only with alloc_count.cpp linked, without it the column stays 0
+// -------------------------------------------------------------------------------------
+
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "spline.h"
+#include "map.h"
+#include "map_file.h"
+#include "telemetry.h"
+#include "planner.h"
+#include "control.h"
+#include "alloc_count.h"
+#include "recording.h"
+
+using namespace std;
+
+// for convenience
+using json = nlohmann::json;
+
+static vector<string> frames;
+
+// allocations of the timed loop per iteration, taken before/after the loop
+static void report_allocs(benchmark::State &state, long allocs) {
+  state.counters["allocs/op"] = benchmark::Counter(allocs,benchmark::Counter::kAvgIterations);
+}
+
+
+// -------------------------------------------------------------------------------------
+// test data
+// -------------------------------------------------------------------------------------
+
+static string synthetic_frame(int path_num, int cars_num, unsigned seed) {
+
+  mt19937                          gen(seed);
+  uniform_real_distribution<double> pos(0,3000);
+  uniform_real_distribution<double> vel(0,25);
+
+  json d;
+  d["x"]     = pos(gen);
+  d["y"]     = pos(gen);
+  d["s"]     = pos(gen);
+  d["d"]     = 6.0;
+  d["yaw"]   = 0.5;
+  d["speed"] = 49.1;
+
+  vector<double> path_x, path_y;
+  for (int i=0;i<path_num;++i) {
+    path_x.push_back(pos(gen));
+    path_y.push_back(pos(gen));
+  }
+  d["previous_path_x"] = path_x;
+  d["previous_path_y"] = path_y;
+  d["end_path_s"]      = pos(gen);
+  d["end_path_d"]      = 6.0;
+
+  json fusion = json::array();
+  for (int i=0;i<cars_num;++i) {
+    fusion.push_back({i,pos(gen),pos(gen),vel(gen),vel(gen),pos(gen),(i%12)+0.5});
+  }
+  d["sensor_fusion"] = fusion;
+
+  return "42[\"telemetry\","+d.dump()+"]";
+}
+
+// -------------------------------------------------------------------------------------
+// telemetry decoding: hasData + json::parse (original handler) vs TelemetryParser
+// -------------------------------------------------------------------------------------
+
+// original handler: copy the payload, cut the json part, parse into a DOM
+static string hasData(string s) {
+  auto found_null = s.find("null");
+  auto b1 = s.find_first_of("[");
+  auto b2 = s.find_first_of("}");
+  if (found_null != string::npos) {
+    return "";
+  } else if (b1 != string::npos && b2 != string::npos) {
+    return s.substr(b1, b2 - b1 + 2);
+  }
+  return "";
+}
+
+static void BM_ParseJson(benchmark::State &state) {
+
+  size_t k = 0;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+
+    const string &frame = frames[k++%frames.size()];
+
+    auto j = json::parse(hasData(frame));
+    double car_x = j[1]["x"];
+    auto previous_path_x = j[1]["previous_path_x"];
+    auto sensor_fusion   = j[1]["sensor_fusion"];
+
+    // per car field access as done by the fusion loop
+    double sum = car_x+previous_path_x.size();
+    for (int i=0;i<(int)sensor_fusion.size();++i) {
+      double d = sensor_fusion[i][6];
+      double s = sensor_fusion[i][5];
+      sum += d+s;
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseJson);
+
+static void BM_ParseTelemetry(benchmark::State &state) {
+
+  Telemetry t;
+  size_t    k = 0;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+
+    const string &frame = frames[k++%frames.size()];
+
+    TelemetryParser::parse(frame.data(),frame.size(),t);
+
+    double sum = t.car_x+t.previous_path_x.size();
+    for (int i=0;i<t.fusion_size();++i) sum += t.fusion(i)[SF_D]+t.fusion(i)[SF_S];
+    benchmark::DoNotOptimize(sum);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ParseTelemetry);
+
+
+
+// -------------------------------------------------------------------------------------
+// control reply: json object + dump + concatenation (original handler) vs write_control
+// -------------------------------------------------------------------------------------
+
+static void trajectory(vector<double> &next_x, vector<double> &next_y, int num) {
+  mt19937                          gen(2);
+  uniform_real_distribution<double> pos(0,3000);
+  for (int i=0;i<num;++i) {
+    next_x.push_back(pos(gen));
+    next_y.push_back(pos(gen));
+  }
+}
+
+static void BM_ControlJson(benchmark::State &state) {
+
+  vector<double> next_x_vals, next_y_vals;
+  trajectory(next_x_vals,next_y_vals,state.range(0));
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    json msgJson;
+    msgJson["next_x"] = next_x_vals;
+    msgJson["next_y"] = next_y_vals;
+    auto msg = "42[\"control\","+ msgJson.dump()+"]";
+    benchmark::DoNotOptimize(msg.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ControlJson)->Arg(50);
+
+static void BM_ControlWriter(benchmark::State &state) {
+
+  vector<double> next_x_vals, next_y_vals;
+  trajectory(next_x_vals,next_y_vals,state.range(0));
+
+  string msg;
+  msg.reserve(4096);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    write_control(msg,next_x_vals,next_y_vals);
+    benchmark::DoNotOptimize(msg.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ControlWriter)->Arg(50);
+
+
+
+// -------------------------------------------------------------------------------------
+// test tracks: circle of `num` waypoints, 30 m apart, driving counter clockwise -
+// d points outwards (right of the driving direction) as on the simulator track
+// -------------------------------------------------------------------------------------
+
+const double TRACK_SPACING = 30.0;
+const int    QUERY_NUM     = 1024;
+
+struct Track {
+
+  Track(int num) : max_s(num*TRACK_SPACING) {
+
+    double radius = max_s/(2*pi());
+    vector<double> x, y, s, dx, dy;
+    for (int i=0;i<num;++i) {
+      double a = 2*pi()*i/num;
+      x.push_back(radius*cos(a));
+      y.push_back(radius*sin(a));
+      s.push_back(i*TRACK_SPACING);
+      dx.push_back(cos(a));
+      dy.push_back(sin(a));
+    }
+    map.reset(new HighwayMap(x,y,s,dx,dy,max_s));
+    line.reset(new ReferenceLine(*map));
+
+    // random queries on the road, heading along the track
+    mt19937                          gen(num);
+    uniform_real_distribution<double> pos_s(0,max_s);
+    uniform_real_distribution<double> pos_d(0,12);
+    for (int i=0;i<QUERY_NUM;++i) {
+      query_s.push_back(pos_s(gen));
+      query_d.push_back(pos_d(gen));
+    }
+    sequence(query_s,query_d,query_x,query_y,query_theta);
+
+    // vehicle driving in lane 1, 0.4 m per query (~45 mph at 50 Hz)
+    for (int i=0;i<QUERY_NUM;++i) {
+      drive_s.push_back(fmod(i*0.4,max_s));
+      drive_d.push_back(6.0);
+    }
+    sequence(drive_s,drive_d,drive_x,drive_y,drive_theta);
+  }
+
+  void sequence(const vector<double> &s, const vector<double> &d, vector<double> &x,
+                vector<double> &y, vector<double> &theta) {
+    x.resize(s.size());
+    y.resize(s.size());
+    map->getXY(s.data(),d.data(),x.data(),y.data(),s.size());
+    for (int i=0;i<(int)s.size();++i) theta.push_back(atan2(y[i],x[i])+pi()/2);
+  }
+
+  double                    max_s;
+  unique_ptr<HighwayMap>    map;
+  unique_ptr<ReferenceLine> line;
+
+  vector<double> query_s, query_d, query_x, query_y, query_theta;
+  vector<double> drive_s, drive_d, drive_x, drive_y, drive_theta;
+};
+
+static const Track &track(int num) {
+  static std::map<int,unique_ptr<Track> > tracks;
+  unique_ptr<Track> &t = tracks[num];
+  if (!t) t.reset(new Track(num));
+  return *t;
+}
+
+// map sizes: simulator track up to 100k waypoints
+static void MapSizes(benchmark::internal::Benchmark *b) {
+  b->Arg(181)->Arg(1000)->Arg(10000)->Arg(100000);
+}
+
+
+// -------------------------------------------------------------------------------------
+// map geometry: random queries (grid lookup) and a driving vehicle (hinted walk)
+// -------------------------------------------------------------------------------------
+
+static void BM_ClosestWaypoint(benchmark::State &state) {
+
+  const Track &t = track(state.range(0));
+  size_t       k = 0;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    benchmark::DoNotOptimize(t.map->ClosestWaypoint(t.query_x[i],t.query_y[i]));
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClosestWaypoint)->Apply(MapSizes);
+
+static void BM_ClosestWaypointHint(benchmark::State &state) {
+
+  const Track &t    = track(state.range(0));
+  size_t       k    = 0;
+  int          hint = -1;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    benchmark::DoNotOptimize(t.map->ClosestWaypoint(t.drive_x[i],t.drive_y[i],&hint));
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ClosestWaypointHint)->Apply(MapSizes);
+
+static void BM_NextWaypoint(benchmark::State &state) {
+
+  const Track &t = track(state.range(0));
+  size_t       k = 0;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    benchmark::DoNotOptimize(t.map->NextWaypoint(t.query_x[i],t.query_y[i],t.query_theta[i]));
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NextWaypoint)->Apply(MapSizes);
+
+static void BM_GetFrenet(benchmark::State &state) {
+
+  const Track &t = track(state.range(0));
+  size_t       k = 0;
+  double       s, d;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    t.map->getFrenet(t.query_x[i],t.query_y[i],t.query_theta[i],s,d);
+    benchmark::DoNotOptimize(s+d);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetFrenet)->Apply(MapSizes);
+
+static void BM_GetFrenetHint(benchmark::State &state) {
+
+  const Track &t    = track(state.range(0));
+  size_t       k    = 0;
+  int          hint = -1;
+  double       s, d;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    t.map->getFrenet(t.drive_x[i],t.drive_y[i],t.drive_theta[i],s,d,&hint);
+    benchmark::DoNotOptimize(s+d);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetFrenetHint)->Apply(MapSizes);
+
+static void BM_GetXY(benchmark::State &state) {
+
+  const Track &t = track(state.range(0));
+  size_t       k = 0;
+  double       x, y;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    t.map->getXY(t.query_s[i],t.query_d[i],x,y);
+    benchmark::DoNotOptimize(x+y);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GetXY)->Apply(MapSizes);
+
+// batch conversion, items = points
+static void BM_GetXYBatch(benchmark::State &state) {
+
+  const Track   &t = track(state.range(0));
+  vector<double> x(QUERY_NUM), y(QUERY_NUM);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    t.map->getXY(t.query_s.data(),t.query_d.data(),x.data(),y.data(),QUERY_NUM);
+    benchmark::DoNotOptimize(x.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations()*QUERY_NUM);
+}
+BENCHMARK(BM_GetXYBatch)->Apply(MapSizes);
+
+// spline reference line: Frenet -> XY (single, batch), XY -> Frenet (driving, hinted)
+static void BM_ReferenceLineXY(benchmark::State &state) {
+
+  const Track &t = track(state.range(0));
+  size_t       k = 0;
+  double       x, y;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    t.line->xy(t.query_s[i],t.query_d[i],x,y);
+    benchmark::DoNotOptimize(x+y);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReferenceLineXY)->Apply(MapSizes);
+
+static void BM_ReferenceLineXYBatch(benchmark::State &state) {
+
+  const Track   &t = track(state.range(0));
+  vector<double> x(QUERY_NUM), y(QUERY_NUM);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    t.line->xy(t.query_s.data(),t.query_d.data(),x.data(),y.data(),QUERY_NUM);
+    benchmark::DoNotOptimize(x.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations()*QUERY_NUM);
+}
+BENCHMARK(BM_ReferenceLineXYBatch)->Apply(MapSizes);
+
+static void BM_ReferenceLineFrenet(benchmark::State &state) {
+
+  const Track &t    = track(state.range(0));
+  size_t       k    = 0;
+  int          hint = -1;
+  double       s, d;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    int i = k++%QUERY_NUM;
+    t.line->frenet(t.drive_x[i],t.drive_y[i],s,d,&hint);
+    benchmark::DoNotOptimize(s+d);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ReferenceLineFrenet)->Apply(MapSizes);
+
+
+// -------------------------------------------------------------------------------------
+// startup: map from the waypoint CSV (parse + tables) vs binary map file (mmap +
+// checksum), track files written once to /tmp
+// -------------------------------------------------------------------------------------
+
+static string track_file(int num, bool binary) {
+  const Track &t    = track(num);
+  string       file = "/tmp/planner_bench_"+to_string(num)+(binary ? ".map" : ".csv");
+  static std::map<string,bool> written;
+  if (!written[file]) {
+    if (binary) write_map_file(*t.map,file);
+    else {
+      ofstream out(file.c_str());
+      out.precision(17);
+      for (int i=0;i<t.map->size();++i) {
+        out << t.map->x[i] << " " << t.map->y[i] << " " << t.map->s[i] << " "
+            << t.map->dx[i] << " " << t.map->dy[i] << "\n";
+      }
+    }
+    written[file] = true;
+  }
+  return file;
+}
+
+static void BM_LoadMapCsv(benchmark::State &state) {
+
+  string file = track_file(state.range(0),false);
+  for (auto _ : state) {
+    unique_ptr<HighwayMap> map = load_map(file);
+    benchmark::DoNotOptimize(map.get());
+  }
+}
+BENCHMARK(BM_LoadMapCsv)->Apply(MapSizes)->Unit(benchmark::kMicrosecond);
+
+static void BM_LoadMapFile(benchmark::State &state) {
+
+  string file = track_file(state.range(0),true);
+  for (auto _ : state) {
+    unique_ptr<HighwayMap> map = load_map(file);
+    benchmark::DoNotOptimize(map.get());
+  }
+}
+BENCHMARK(BM_LoadMapFile)->Apply(MapSizes)->Unit(benchmark::kMicrosecond);
+
+
+// -------------------------------------------------------------------------------------
+// prediction: prediction table, fusion table, check_lane and the planner tick over the
+// number of vehicles
+// -------------------------------------------------------------------------------------
+
+// ego car at s=100 in lane 1, `cars_num` cars spread over 3 lanes around it - at
+// least 24 m of lane per car, dense traffic stretches over more of the track
+static void traffic(Telemetry &t, int cars_num, int path_num, const Track &track) {
+
+  mt19937                          gen(cars_num);
+  uniform_real_distribution<double> pos(0,max(300.0,cars_num*8.0));
+  uniform_real_distribution<double> vel(10,22);
+  uniform_int_distribution<int>     lane(0,2);
+
+  const HighwayMap &map = *track.map;
+
+  t.car_s     = 100.0;
+  t.car_d     = 6.0;
+  t.car_speed = 45.0;
+  map.getXY(t.car_s,t.car_d,t.car_x,t.car_y);
+  t.car_yaw   = rad2deg(atan2(t.car_y,t.car_x)+pi()/2);
+
+  // previous path ahead of the car, 0.4 m per point
+  t.previous_path_x.clear();
+  t.previous_path_y.clear();
+  for (int i=1;i<=path_num;++i) {
+    double x, y;
+    map.getXY(t.car_s+0.4*i,t.car_d,x,y);
+    t.previous_path_x.push_back(x);
+    t.previous_path_y.push_back(y);
+  }
+  t.end_path_s = t.car_s+0.4*path_num;
+  t.end_path_d = t.car_d;
+
+  t.sensor_fusion.clear();
+  for (int i=0;i<cars_num;++i) {
+    double s = pos(gen);
+    double d = 2+4*lane(gen);
+    double x, y;
+    map.getXY(s,d,x,y);
+    double v = vel(gen);
+    double a = atan2(y,x)+pi()/2;
+    double car[SF_FIELDS] = { double(i), x, y, v*cos(a), v*sin(a), s, d };
+    t.sensor_fusion.insert(t.sensor_fusion.end(),car,car+SF_FIELDS);
+  }
+}
+
+// every vehicle over the horizon, rates from the history of the previous tick
+static void BM_PredictionTable(benchmark::State &state) {
+
+  Telemetry       t;
+  PredictionTable prediction;
+  traffic(t,state.range(0),47,track(181));
+  prediction.update(t,0);
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    prediction.update(t,3*POINTS_PER_SEC);
+    prediction.predict(0,DISTANCE_NUM,POINTS_PER_SEC);
+    benchmark::DoNotOptimize(prediction.s_at(DISTANCE_NUM));
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations()*state.range(0));
+}
+BENCHMARK(BM_PredictionTable)->Arg(0)->Arg(12)->Arg(100)->Arg(1000);
+
+// lane bucketed table, built once per tick
+static void BM_FusionTable(benchmark::State &state) {
+
+  Telemetry       t;
+  PredictionTable prediction;
+  FusionTable     fusion;
+  traffic(t,state.range(0),47,track(181));
+  prediction.update(t,0);
+  prediction.predict(47,DISTANCE_NUM,POINTS_PER_SEC);
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    fusion.build(prediction,47);
+    benchmark::DoNotOptimize(fusion.s.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FusionTable)->Arg(0)->Arg(12)->Arg(100)->Arg(1000);
+
+static void BM_CheckLane(benchmark::State &state) {
+
+  Telemetry       t;
+  PredictionTable prediction;
+  FusionTable     fusion;
+  traffic(t,state.range(0),47,track(181));
+  prediction.update(t,0);
+  prediction.predict(47,DISTANCE_NUM,POINTS_PER_SEC);
+  fusion.build(prediction,47);
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(check_lane(fusion,t.end_path_s,1,20.0,1));
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CheckLane)->Arg(0)->Arg(12)->Arg(100)->Arg(1000);
+
+// one candidate (lane change) against the prediction: cars x previous path length,
+// the checker prepared once per tick outside the loop
+static void BM_CollisionCheck(benchmark::State &state) {
+
+  const Track &tr = track(181);
+  Telemetry    t;
+  traffic(t,state.range(0),state.range(1),tr);
+
+  int              prev_size = state.range(1);
+  PredictionTable  prediction;
+  CollisionChecker collisions;
+  prediction.update(t,0);
+  prediction.predict(prev_size,DISTANCE_NUM,POINTS_PER_SEC);
+  prediction.predict_xy(*tr.map);
+  collisions.prepare(prediction,*tr.map);
+
+  double      start_s = prev_size ? t.end_path_s : t.car_s;
+  FrenetState start   = { start_s, 40.0/MPH_TO_MS, 0, 6, 0, 0 };
+  Trajectory  out;
+  build_trajectory(DefaultPlannerConfig(),TRAJECTORY_SPLINE,*tr.map,t,start,0,40.0,REF_DISTANCE,out);
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(collisions.check(t,start_s,out.next_x_vals,out.next_y_vals));
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CollisionCheck)->ArgsProduct({{12,100,1000},{0,47}});
+
+// full tick (fusion loop, lane change, spline, sampling) over cars x previous path
+// length, the planner state is reset every iteration so every tick does the same work
+static void BM_PlannerStep(benchmark::State &state) {
+
+  const Track &tr = track(181);
+  Telemetry    t;
+  traffic(t,state.range(0),state.range(1),tr);
+
+  Planner planner(*tr.map);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    planner.lane     = 1;
+    planner.velocity = 40.0;
+    const Trajectory &out = planner.step(t);
+    benchmark::DoNotOptimize(out.next_x_vals.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PlannerStep)->ArgsProduct({{0,12,100,1000},{0,10,47}});
+
+// cruising on an empty road, 3 points consumed per tick: the previous path is the
+// last trajectory minus its first points, the maneuver never changes - backend x
+// extension of the last trajectory off / on
+static void BM_PlannerStepCruise(benchmark::State &state) {
+
+  const Track &tr = track(181);
+  Telemetry    t;
+  traffic(t,0,47,tr);
+
+  Planner planner(*tr.map,nullptr,TrajectoryBackend(state.range(0)));
+  planner.reuse    = state.range(1);
+  planner.velocity = VELOCITY_MAX;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    const Trajectory &out = planner.step(t);
+    t.previous_path_x.assign(out.next_x_vals.begin()+3,out.next_x_vals.end());
+    t.previous_path_y.assign(out.next_y_vals.begin()+3,out.next_y_vals.end());
+    int    n     = t.previous_path_x.size();
+    double theta = atan2(t.previous_path_y[n-1]-t.previous_path_y[n-2],t.previous_path_x[n-1]-t.previous_path_x[n-2]);
+    tr.map->getFrenet(t.previous_path_x[n-1],t.previous_path_y[n-1],theta,t.end_path_s,t.end_path_d);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PlannerStepCruise)->ArgsProduct({{TRAJECTORY_SPLINE,TRAJECTORY_JMT},{0,1}});
+
+// same tick with the constexpr tuned Planner and the RuntimePlanner (default
+// parameters, read from memory), cars x previous path length
+template <class P>
+static void BM_PlannerStepConfig(benchmark::State &state) {
+
+  const Track &tr = track(181);
+  Telemetry    t;
+  traffic(t,state.range(0),state.range(1),tr);
+
+  P planner(*tr.map);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    planner.lane     = 1;
+    planner.velocity = 40.0;
+    const Trajectory &out = planner.step(t);
+    benchmark::DoNotOptimize(out.next_x_vals.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_PlannerStepConfig,Planner)->ArgsProduct({{0,12},{0,47}});
+BENCHMARK_TEMPLATE(BM_PlannerStepConfig,RuntimePlanner)->ArgsProduct({{0,12},{0,47}});
+
+// cost planner tick: lanes x evaluation threads (caller + pool), 12 cars per 3 lanes
+static void BM_PlannerStepCost(benchmark::State &state) {
+
+  int lanes   = state.range(0);
+  int workers = state.range(1);
+
+  const Track &tr = track(181);
+  Telemetry    t;
+  traffic(t,4*lanes,47,tr);
+
+  TaskPool     pool(workers-1);
+  CostBehavior cost(lanes,&pool,1e3);
+  Planner      planner(*tr.map,&cost);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    planner.lane     = 1;
+    planner.velocity = 40.0;
+    const Trajectory &out = planner.step(t);
+    benchmark::DoNotOptimize(out.next_x_vals.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_PlannerStepCost)->ArgsProduct({{3,5},{1,2,4}})->UseRealTime();
+
+// one trajectory of a lane change: backend (0 spline, 1 JMT) x previous path length
+// x reference (0 waypoints / local JMT reference line, 1 spline reference line)
+static void BM_BuildTrajectory(benchmark::State &state) {
+
+  TrajectoryBackend backend = TrajectoryBackend(state.range(0));
+
+  const Track &tr = track(181);
+  Telemetry    t;
+  traffic(t,0,state.range(1),tr);
+
+  FrenetState          start = { t.previous_path_x.empty() ? t.car_s : t.end_path_s, 40.0/MPH_TO_MS, 0, 6, 0, 0 };
+  const ReferenceLine *line  = state.range(2) ? tr.line.get() : nullptr;
+  Trajectory           out;
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    build_trajectory(DefaultPlannerConfig(),backend,*tr.map,t,start,2,40.0,REF_DISTANCE,out,line);
+    benchmark::DoNotOptimize(out.next_x_vals.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BuildTrajectory)->ArgsProduct({{TRAJECTORY_SPLINE,TRAJECTORY_JMT},{0,47},{0,1}});
+
+
+// -------------------------------------------------------------------------------------
+// trajectory kernels: spline fit + sampling and the vehicle frame rotation
+// -------------------------------------------------------------------------------------
+
+// spline points of a lane change in the vehicle frame, as built by the planner
+static const double SPLINE_X[PTS_NUM] = { -1.0, 0.0, 30.0, 60.0, 90.0 };
+static const double SPLINE_Y[PTS_NUM] = {  0.0, 0.0,  1.5,  4.0,  4.0 };
+
+// tk::spline (original planner), fit + `range` samples
+static void BM_SplineTk(benchmark::State &state) {
+
+  vector<double> x(SPLINE_X,SPLINE_X+PTS_NUM), y(SPLINE_Y,SPLINE_Y+PTS_NUM);
+  int            num = state.range(0);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    tk::spline s;
+    s.set_points(x,y);
+    double sum = 0;
+    for (int i=0;i<num;++i) sum += s(i*0.6);
+    benchmark::DoNotOptimize(sum);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SplineTk)->Arg(10)->Arg(50)->Arg(200);
+
+// FixedSpline (Planner), fit + `range` samples
+static void BM_SplineFixed(benchmark::State &state) {
+
+  FixedSpline<PTS_NUM> s;
+  int                  num = state.range(0);
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    s.set_points(SPLINE_X,SPLINE_Y,PTS_NUM);
+    double sum = 0;
+    for (int i=0;i<num;++i) sum += s(i*0.6);
+    benchmark::DoNotOptimize(sum);
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SplineFixed)->Arg(10)->Arg(50)->Arg(200);
+
+// map -> vehicle frame, same loop as in Planner::trajectory, `range` points
+static void BM_VehicleFrame(benchmark::State &state) {
+
+  int            num = state.range(0);
+  vector<double> ptsx, ptsy;
+  trajectory(ptsx,ptsy,num);
+  vector<double> x(num), y(num);
+
+  double ref_x   = 1500.0;
+  double ref_y   = 1500.0;
+  double ref_yaw = 0.3;
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ref_yaw);   // no constant folded cos/sin
+    for (int i=0;i<num;++i) {
+
+      // shift by 0 degrees
+      double shift_x = ptsx[i]-ref_x;
+      double shift_y = ptsy[i]-ref_y;
+
+      x[i] =(shift_x*cos(0-ref_yaw)-shift_y*sin(0-ref_yaw));
+      y[i] =(shift_x*sin(0-ref_yaw)+shift_y*cos(0-ref_yaw));
+    }
+    benchmark::DoNotOptimize(x.data());
+    benchmark::DoNotOptimize(y.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations()*num);
+}
+BENCHMARK(BM_VehicleFrame)->Arg(PTS_NUM)->Arg(50)->Arg(1000);
+
+// same with a RigidTransform: cos/sin once per transform, batch over the points
+static void BM_VehicleFrameRigid(benchmark::State &state) {
+
+  int            num = state.range(0);
+  vector<double> ptsx, ptsy;
+  trajectory(ptsx,ptsy,num);
+  vector<double> x(num), y(num);
+
+  double ref_yaw = 0.3;
+
+  long allocs = alloc_count();
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(ref_yaw);
+    RigidTransform frame(1500.0,1500.0,ref_yaw);
+    frame.inverse(ptsx.data(),ptsy.data(),x.data(),y.data(),num);
+    benchmark::DoNotOptimize(x.data());
+    benchmark::DoNotOptimize(y.data());
+  }
+  report_allocs(state,alloc_count()-allocs);
+  state.SetItemsProcessed(state.iterations()*num);
+}
+BENCHMARK(BM_VehicleFrameRigid)->Arg(PTS_NUM)->Arg(50)->Arg(1000);
+
+
+int main(int argc, char **argv) {
+
+  benchmark::Initialize(&argc,argv);
+
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if (arg.compare(0,12,"--recording=")==0) read_recording(arg.substr(12),frames);
+  }
+  if (frames.empty()) frames.push_back(synthetic_frame(47,12,1));
+
+  benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,150 @@
+#ifndef PLANNER_CONFIG_H
+#define PLANNER_CONFIG_H
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// ------------------------------------------------------------------------
+// Planner tuning, defaults of every planner configuration
+// ------------------------------------------------------------------------
+
+// constants (constexpr: DefaultPlannerConfig returns them as constant expressions)
+constexpr double VELOCITY_EMERGENCY  = 0.33; // speed of front car in terms percentance of ego velocity
+constexpr double VELOCITY_MAX        = 49.5;
+constexpr double VELOCITY_STEP       = 0.336;
+constexpr double VELOCITY_DEC        = 0.85;
+constexpr int    DISTANCE_NUM        = 50;
+constexpr double POINTS_PER_SEC      = 0.02;
+constexpr double REF_DISTANCE        = 30.0;
+constexpr double BACK_DISTANCE       = 0.33;
+constexpr double LANE_WIDTH          = 4.0;  // lane L = d in [L*LANE_WIDTH,(L+1)*LANE_WIDTH]
+
+
+// -------------------------------------------------------------------------------------
+// planner configuration policies
+//
+// + the planner templates (BasicPlanner, check_lane, build_trajectory, ...) read
+//   their tuning through a CONFIG object: config.velocity_max(), ...
+// + DefaultPlannerConfig: static constexpr functions of the constants above - every
+//   parameter is an immediate, a fixed deployment derives from it and hides the
+//   functions it changes:
+//
+//     struct TruckConfig : DefaultPlannerConfig {
+//       static constexpr double velocity_max() { return 40.0; }
+//     };
+//
+// + RuntimePlannerConfig: the same functions reading PlannerParams, loaded from a
+//   file for tuning runs (--config=<file>)
+// -------------------------------------------------------------------------------------
+
+struct DefaultPlannerConfig {
+  static constexpr double velocity_emergency()    { return VELOCITY_EMERGENCY; }
+  static constexpr double velocity_max()          { return VELOCITY_MAX; }
+  static constexpr double velocity_step()         { return VELOCITY_STEP; }
+  static constexpr double velocity_dec()          { return VELOCITY_DEC; }
+  static constexpr int    distance_num()          { return DISTANCE_NUM; }
+  static constexpr double points_per_sec()        { return POINTS_PER_SEC; }
+  static constexpr double ref_distance()          { return REF_DISTANCE; }
+  static constexpr double back_distance()         { return BACK_DISTANCE; }
+  static constexpr double lane_width()            { return LANE_WIDTH; }
+  static constexpr double lane_center(int lane)   { return LANE_WIDTH/2+LANE_WIDTH*lane; }
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct PlannerParams
+//
+// + values of a runtime configuration, defaults = DefaultPlannerConfig
+// -------------------------------------------------------------------------------------
+
+struct PlannerParams {
+  double velocity_emergency = VELOCITY_EMERGENCY;
+  double velocity_max       = VELOCITY_MAX;
+  double velocity_step      = VELOCITY_STEP;
+  double velocity_dec       = VELOCITY_DEC;
+  int    distance_num       = DISTANCE_NUM;
+  double points_per_sec     = POINTS_PER_SEC;
+  double ref_distance       = REF_DISTANCE;
+  double back_distance      = BACK_DISTANCE;
+  double lane_width         = LANE_WIDTH;
+};
+
+struct RuntimePlannerConfig {
+
+  RuntimePlannerConfig() {}
+  RuntimePlannerConfig(const PlannerParams &params) : params(params) {}
+
+  double velocity_emergency()  const { return params.velocity_emergency; }
+  double velocity_max()        const { return params.velocity_max; }
+  double velocity_step()       const { return params.velocity_step; }
+  double velocity_dec()        const { return params.velocity_dec; }
+  int    distance_num()        const { return params.distance_num; }
+  double points_per_sec()      const { return params.points_per_sec; }
+  double ref_distance()        const { return params.ref_distance; }
+  double back_distance()       const { return params.back_distance; }
+  double lane_width()          const { return params.lane_width; }
+  double lane_center(int lane) const { return params.lane_width/2+params.lane_width*lane; }
+
+  PlannerParams params;
+};
+
+
+// -------------------------------------------------------------------------------------
+// function read_planner_params
+//
+// + one "name value" pair per line, names as in PlannerParams, '#' starts a comment,
+//   parameters not in the file keep their value
+// + RETURN: false (with a message on cerr) if the file can't be read, a name is
+//   unknown or a value is not a number / out of range
+// -------------------------------------------------------------------------------------
+
+inline bool read_planner_params(const std::string &config_file, PlannerParams &params) {
+
+  std::ifstream in_config(config_file.c_str(), std::ifstream::in);
+  if (!in_config) {
+    std::cerr << config_file << ": can't read planner config" << std::endl;
+    return false;
+  }
+
+  std::string line;
+  int         line_num = 0;
+  while (std::getline(in_config, line)) {
+    ++line_num;
+    line = line.substr(0,line.find('#'));
+
+    std::istringstream iss(line);
+    std::string name;
+    double      value;
+    if (!(iss >> name)) continue;
+    if (!(iss >> value)) {
+      std::cerr << config_file << ":" << line_num << ": missing value of " << name << std::endl;
+      return false;
+    }
+
+    if      (name=="velocity_emergency") params.velocity_emergency = value;
+    else if (name=="velocity_max")       params.velocity_max       = value;
+    else if (name=="velocity_step")      params.velocity_step      = value;
+    else if (name=="velocity_dec")       params.velocity_dec       = value;
+    else if (name=="distance_num")       params.distance_num       = int(value);
+    else if (name=="points_per_sec")     params.points_per_sec     = value;
+    else if (name=="ref_distance")       params.ref_distance       = value;
+    else if (name=="back_distance")      params.back_distance      = value;
+    else if (name=="lane_width")         params.lane_width         = value;
+    else {
+      std::cerr << config_file << ":" << line_num << ": unknown parameter " << name << std::endl;
+      return false;
+    }
+  }
+
+  if (params.velocity_max<=0 || params.velocity_step<=0 || params.distance_num<=0 ||
+      params.points_per_sec<=0 || params.ref_distance<=0 || params.lane_width<=0) {
+    std::cerr << config_file << ": velocity_max, velocity_step, distance_num, points_per_sec, "
+         << "ref_distance and lane_width must be > 0" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+#endif /* PLANNER_CONFIG_H */
@@ -0,0 +1,155 @@
+// -------------------------------------------------------------------------------------
+// planner_load - load test, N concurrent simulator connections against one planner
+//
+// + build:  g++ -O2 -std=c++11 planner_load.cpp -luWS -lssl -lcrypto -lz -lpthread -o planner_load
+// + run:    ./planner_load [connections] [seconds] [uri] [recording] [--threads=N]
+//           defaults 16 connections, 10 s, ws://127.0.0.1:4567, one client thread
+//           per hardware thread (at most one per connection)
+//
+// + every connection sends a telemetry frame, waits for the control reply and sends
+//   the next one (closed loop, one frame in flight per connection) - frames come
+//   from the RECORDING (./path_planning --record=<file>, the frames of its first
+//   connection) or a built-in start frame of the simulator
+// + the connections are sharded across client threads with a uWS::Hub each, so the
+//   client keeps up with a planner on several event loops
+// + the clock starts when all connections are open, ticks are counted for SECONDS
+//   from there
+// + reports ticks (telemetry -> control round trips) per second, total and per
+//   connection
+// -------------------------------------------------------------------------------------
+
+#include <uWS/uWS.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "recording.h"
+
+using namespace std;
+
+// first frame the simulator sends: car at the start position, no previous path
+static const char *START_FRAME =
+  "42[\"telemetry\",{\"x\":909.48,\"y\":1128.67,\"yaw\":0,\"speed\":0,\"s\":124.8336,\"d\":6.164833,"
+  "\"previous_path_x\":[],\"previous_path_y\":[],\"end_path_s\":0,\"end_path_d\":0,"
+  "\"sensor_fusion\":[[0,1036.5,1144.6,21.3,0.2,250.2,6.1],[1,775.8,1421.6,0,0,6719.2,-280.0],"
+  "[2,775.8,1425.2,0,0,6716.6,-282.5],[3,775.8,1429,0,0,6713.9,-285.1],[4,960.1,1136.4,19.8,0,176.7,2.2],"
+  "[5,989.8,1128.9,20.4,0.1,205.4,10.1],[6,1084.3,1136.9,18.7,0.1,299.6,1.9]]}]";
+
+
+// -------------------------------------------------------------------------------------
+// struct LoadRun
+//
+// + state shared by the client threads: connections open, start of the measurement
+//   (steady clock ns, 0 = not all open yet)
+// -------------------------------------------------------------------------------------
+
+struct LoadRun {
+
+  LoadRun(int connections, double seconds, const vector<string> &frames)
+    : connections(connections), seconds(seconds), frames(frames), open_num(0), start_ns(0) {}
+
+  static long now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  const int             connections;
+  const double          seconds;
+  const vector<string> &frames;
+  atomic<int>           open_num;
+  atomic<long>          start_ns;
+};
+
+
+// client thread: connections FIRST.. of TICKS on a hub of its own
+static void run_client(LoadRun &run, const string &uri, int first, int num, vector<long> &ticks) {
+
+  uWS::Hub h;
+  int      local_open = 0;
+
+  h.onConnection([&](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    // connection index in the user data, closed loop starts with the first frame
+    ws.setUserData(reinterpret_cast<void *>(long(first+local_open++)));
+    if (++run.open_num==run.connections) run.start_ns = LoadRun::now_ns();
+    ws.send(run.frames[0].data(),run.frames[0].length(),uWS::OpCode::TEXT);
+  });
+
+  h.onMessage([&](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode opCode) {
+
+    long id    = reinterpret_cast<long>(ws.getUserData());
+    long start = run.start_ns;
+
+    // only count once every connection is up, until SECONDS are over
+    if (start) {
+      if ((LoadRun::now_ns()-start)*1e-9>=run.seconds) {
+        ws.close();
+        return;
+      }
+      ticks[id]++;
+    }
+
+    const string &frame = run.frames[ticks[id]%run.frames.size()];
+    ws.send(frame.data(),frame.length(),uWS::OpCode::TEXT);
+  });
+
+  h.onError([&](void *user) {
+    cerr << "connection failed: " << uri << endl;
+    exit(-1);
+  });
+
+  for (int i=0;i<num;++i) h.connect(uri,nullptr);
+
+  // returns when the shard's connections are closed
+  h.run();
+}
+
+int main(int argc, char **argv) {
+
+  // positional: connections, seconds, uri, recording - options anywhere
+  vector<string> args;
+  int            threads = thread::hardware_concurrency();
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if (arg.compare(0,10,"--threads=")==0) threads = atoi(arg.c_str()+10);
+    else                                   args.push_back(arg);
+  }
+  int    connections = (args.size()>0) ? atoi(args[0].c_str()) : 16;
+  double seconds     = (args.size()>1) ? atof(args[1].c_str()) : 10.0;
+  string uri         = (args.size()>2) ? args[2] : "ws://127.0.0.1:4567";
+  threads = min(max(threads,1),max(connections,1));
+
+  vector<string> frames;
+  if (args.size()>3) read_recording(args[3],frames);
+  if (frames.empty()) frames.push_back(START_FRAME);
+
+  // connections split evenly, one tick counter per connection (written by its
+  // thread only)
+  LoadRun        run(connections,seconds,frames);
+  vector<long>   ticks(connections,0);
+  vector<thread> clients;
+  for (int t=0;t<threads;++t) {
+    int first = connections*t/threads;
+    int num   = connections*(t+1)/threads-first;
+    clients.emplace_back(run_client,ref(run),cref(uri),first,num,ref(ticks));
+  }
+  for (thread &c : clients) c.join();
+  cout << "all connections closed" << endl;
+
+  long total = 0;
+  long min_t = -1;
+  long max_t = 0;
+  for (long t : ticks) {
+    total += t;
+    min_t  = (min_t<0 || t<min_t) ? t : min_t;
+    max_t  = (t>max_t) ? t : max_t;
+  }
+
+  cout << "connections:      " << connections << " on " << threads << " client threads" << endl;
+  cout << "ticks:            " << total << " in " << seconds << " s" << endl;
+  cout << "ticks per second: " << total/seconds << endl;
+  cout << "per connection:   " << total/seconds/connections << " ticks/s (min " << min_t
+       << ", max " << max_t << " ticks)" << endl;
+}
@@ -0,0 +1,221 @@
+// -------------------------------------------------------------------------------------
+// planner_replay - offline replay of recorded telemetry through the planner
+//
+// + build:  g++ -O2 -std=c++11 planner_replay.cpp -lpthread -o planner_replay
+// + run:    ./planner_replay <recording> [map] [--repeat=N] [--behavior=cost]
+//                            [--lanes=N] [--workers=N] [--budget=<ms>] [--trajectory=jmt]
+//                            [--config=<file>] [--tiles=N] [--deadline-share=<f>]
+//                            [--reference=waypoints] [--stats]
+//           map = binary map file (./map_compiler) or waypoint CSV, defaults to
+//           ../data/highway_map.csv, planner options as for
+//           ./path_planning
+//
+// + RECORDING = telemetry frames as written by ./path_planning --record=<file>, one
+//   42["telemetry",{...}] frame per line, tagged with its connection (recording.h)
+// + every frame goes the same way as in the server (parse, Planner::step,
+//   write_control), back to back without the simulator - one planner session per
+//   recorded connection, so lane and velocity carry over from frame to frame of a
+//   vehicle; the sessions replay one after the other
+// + --config=<file> replays on a RuntimePlanner with the parameters of the file
+//   (tuning runs), otherwise on the constexpr tuned Planner
+// + --tiles=N replays on a tiled route (N waypoints per tile), every tick on the
+//   window around the vehicle
+// + reports per tick latency (p50, p99, max) and messages per second, --stats adds
+//   the stage timers of the ticks (tick_stats.h)
+// + the tick budget is the one of the recorded frame, degraded ticks and deadline
+//   misses are reported (--deadline-share=0 degrades every tick after the first)
+// -------------------------------------------------------------------------------------
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "map.h"
+#include "map_file.h"
+#include "tiled_map.h"
+#include "telemetry.h"
+#include "planner.h"
+#include "control.h"
+#include "tick_stats.h"
+#include "recording.h"
+
+using namespace std;
+
+int main(int argc, char **argv) {
+
+  string recording;
+  string map_file_ = "../data/highway_map.csv";
+  int    repeat    = 1;
+  bool   use_cost  = false;
+  int    lanes     = 3;
+  int    workers   = -1;
+  double budget    = 5.0;
+  TrajectoryBackend backend = TRAJECTORY_SPLINE;
+  PlannerParams     params;
+  bool              tuned   = false;
+  int               tile_waypoints = 0;
+  bool              stats          = false;
+  double            deadline_share = DEADLINE_SHARE;
+  bool              use_line       = true;
+
+  int positional = 0;
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if      (arg.compare(0,9,"--repeat=")==0)   repeat    = max(1,atoi(arg.c_str()+9));
+    else if (arg=="--behavior=cost")            use_cost  = true;
+    else if (arg.compare(0,8,"--lanes=")==0)    lanes     = max(1,atoi(arg.c_str()+8));
+    else if (arg.compare(0,10,"--workers=")==0) workers   = atoi(arg.c_str()+10);
+    else if (arg.compare(0,9,"--budget=")==0)   budget    = atof(arg.c_str()+9);
+    else if (arg=="--trajectory=jmt")           backend   = TRAJECTORY_JMT;
+    else if (arg.compare(0,8,"--tiles=")==0)    tile_waypoints = atoi(arg.c_str()+8);
+    else if (arg=="--stats")                    stats     = true;
+    else if (arg=="--reference=waypoints")      use_line  = false;
+    else if (arg.compare(0,17,"--deadline-share=")==0) deadline_share = atof(arg.c_str()+17);
+    else if (arg.compare(0,9,"--config=")==0) {
+      if (!read_planner_params(arg.c_str()+9,params)) return -1;
+      tuned = true;
+    }
+    else if (positional==0)                     recording = arg, ++positional;
+    else if (positional==1)                     map_file_ = arg, ++positional;
+  }
+  if (recording.empty()) {
+    cerr << "usage: " << argv[0] << " <recording> [map] [--repeat=N] [--behavior=cost]"
+         << " [--lanes=N] [--workers=N] [--budget=<ms>] [--trajectory=jmt] [--config=<file>]"
+         << " [--tiles=N] [--deadline-share=<f>] [--reference=waypoints] [--stats]" << endl;
+    return -1;
+  }
+  if (workers<0) workers = thread::hardware_concurrency();
+
+  vector<vector<string>> sessions;
+  if (!read_recording_sessions(recording,sessions)) {
+    cerr << "no frames in " << recording << endl;
+    return -1;
+  }
+  size_t frame_num = 0;
+  for (const vector<string> &frames : sessions) frame_num += frames.size();
+
+  // binary map file or waypoint CSV, max s derived from the waypoints
+  unique_ptr<HighwayMap> map_ptr;
+  unique_ptr<TiledMap>   tiles;
+  unique_ptr<MapWindow>  window;
+  if (tile_waypoints>0) {
+    tiles = load_tiled_map(map_file_,tile_waypoints);
+    if (!tiles) return -1;
+  }
+  else {
+    map_ptr = load_map(map_file_);
+    if (!map_ptr) return -1;
+  }
+  const HighwayMap &map = tiles ? tiles->route() : *map_ptr;
+
+  // spline reference line of the whole loop, as in the server (a tiled route only
+  // if it is shorter than a window)
+  unique_ptr<ReferenceLine> ref_line;
+  bool                      own_window = map.max_s<=MAP_TILE_BEHIND+MAP_TILE_AHEAD;
+  if (use_line && (!tiles || own_window)) ref_line.reset(new ReferenceLine(map));
+
+  unique_ptr<TaskPool>     pool;
+  unique_ptr<CostBehavior> cost;
+  if (use_cost) {
+    pool.reset(new TaskPool(max(workers-1,0)));
+    cost.reset(new CostBehavior(lanes,pool.get(),budget));
+  }
+
+  Telemetry telemetry;
+  string    msg;
+  msg.reserve(4096);
+
+  vector<double> latency;
+  latency.reserve(frame_num*repeat);
+
+  size_t planned  = 0;
+  size_t degraded = 0;
+  size_t misses   = 0;
+  size_t rebuilds = 0;
+  auto   start   = chrono::steady_clock::now();
+
+  for (const vector<string> &frames : sessions) {
+
+    // planning context of the connection, as in the server
+    Planner                    planner(map,cost.get(),backend);
+    unique_ptr<RuntimePlanner> tuned_planner;
+    if (tuned) tuned_planner.reset(new RuntimePlanner(map,cost.get(),backend,RuntimePlannerConfig(params)));
+    planner.deadline_share = deadline_share;
+    planner.set_map(map,ref_line.get());
+    if (tuned_planner) {
+      tuned_planner->deadline_share = deadline_share;
+      tuned_planner->set_map(map,ref_line.get());
+    }
+    if (tiles) window.reset(new MapWindow(*tiles));
+
+    for (int r=0;r<repeat;++r) {
+      for (const string &frame : frames) {
+
+        auto t0 = chrono::steady_clock::now();
+
+        STAGE_BEGIN(parse_start);
+        TelemetryStatus status = TelemetryParser::parse(frame.data(),frame.size(),telemetry);
+        STAGE_END(parse_start,STAGE_PARSE);
+
+        if (status==TELEMETRY_OK) {
+          STAGE_BEGIN(tick_start);
+          if (window) {
+            const HighwayMap    &tick_map  = window->at(telemetry.car_s);
+            const ReferenceLine *tick_line = window->whole_route() ? ref_line.get() : nullptr;
+            planner.set_map(tick_map,tick_line);
+            if (tuned_planner) tuned_planner->set_map(tick_map,tick_line);
+          }
+          const Trajectory &trajectory = tuned_planner ? tuned_planner->step(telemetry) : planner.step(telemetry);
+          STAGE_BEGIN(serialize_start);
+          write_control(msg,trajectory.next_x_vals,trajectory.next_y_vals);
+          STAGE_END(serialize_start,STAGE_SERIALIZE);
+          STAGE_END(tick_start,STAGE_TICK);
+          ++planned;
+          if (tuned_planner ? tuned_planner->degraded : planner.degraded) ++degraded;
+        }
+
+        auto t1 = chrono::steady_clock::now();
+        latency.push_back(chrono::duration<double,micro>(t1-t0).count());
+      }
+    }
+    misses += tuned_planner ? tuned_planner->deadline_misses : planner.deadline_misses;
+    if (window) rebuilds += window->rebuilds;
+  }
+
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now()-start).count();
+
+  // percentiles, nearest rank
+  sort(latency.begin(),latency.end());
+  size_t n   = latency.size();
+  double p50 = latency[min(n-1,size_t(n*0.50))];
+  double p99 = latency[min(n-1,size_t(n*0.99))];
+
+  cout << "frames:           " << n << " (" << planned << " planned, " << sessions.size() << " connection(s), "
+       << repeat << " pass(es))" << endl;
+  cout << "latency p50:      " << p50 << " us" << endl;
+  cout << "latency p99:      " << p99 << " us" << endl;
+  cout << "latency max:      " << latency[n-1] << " us" << endl;
+  cout << "messages per sec: " << n/elapsed << endl;
+  cout << "degraded ticks:   " << degraded << ", " << misses << " deadline misses" << endl;
+  if (stats) {
+    StageSummary sums[STAGE_NUM];
+    stage_summaries(sums);
+    cout << "stage          count      mean us     p50 us     p99 us     max us" << endl;
+    for (int st=0;st<STAGE_NUM;++st) {
+      const StageSummary &sum = sums[st];
+      if (!sum.count) continue;
+      printf("%-12s %7llu %12.3f %10.3f %10.3f %10.3f\n",TICK_STAGE_NAMES[st],(unsigned long long)sum.count,
+             1e-3*sum.sum_ns/sum.count,1e-3*sum.quantile_ns[0],1e-3*sum.quantile_ns[2],1e-3*sum.max_ns);
+    }
+  }
+  if (tiles) {
+    TileStats st = tiles->stats();
+    cout << "map windows:      " << rebuilds << " built, " << st.resident << " tiles resident, "
+         << st.loads << " loaded on demand, " << st.prefetched << " prefetched" << endl;
+  }
+}
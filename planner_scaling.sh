@@ -0,0 +1,34 @@
+#!/bin/bash
+# ---------------------------------------------------------------------------------------
+# planner_scaling.sh - throughput scaling of the planner from 1 to N event loops
+#
+# + build the two programs into the build directory, from the directory of
+#   main.cpp (Eigen-3.3 next to it as in the simulator project, uWS installed):
+#     g++ -O2 -std=c++11 main.cpp -luWS -lssl -lcrypto -lz -lpthread -lrt -o build/path_planning
+#     g++ -O2 -std=c++11 planner_load.cpp -luWS -lssl -lcrypto -lz -lpthread -o build/planner_load
+# + run from the build directory (the planner reads ../data/highway_map.csv):
+#     ../planner_scaling.sh [max_threads] [connections] [seconds] [client_threads]
+# + starts ./path_planning --threads=T for T = 1..max_threads, drives it with
+#   ./planner_load on CLIENT_THREADS client threads (default one per hardware
+#   thread, so the client is not the bottleneck) and prints ticks per second per
+#   thread count
+# ---------------------------------------------------------------------------------------
+
+MAX_THREADS=${1:-$(nproc)}
+CONNECTIONS=${2:-64}
+SECONDS_RUN=${3:-10}
+CLIENT_THREADS=${4:-$(nproc)}
+
+printf "%8s %16s\n" "threads" "ticks/s"
+
+for ((T=1; T<=MAX_THREADS; T++)); do
+  ./path_planning --threads=$T > /dev/null &
+  PLANNER=$!
+  sleep 1
+
+  RATE=$(./planner_load $CONNECTIONS $SECONDS_RUN --threads=$CLIENT_THREADS | awk '/ticks per second/ {print $4}')
+  printf "%8d %16s\n" $T "$RATE"
+
+  kill $PLANNER
+  wait $PLANNER 2> /dev/null
+done
@@ -0,0 +1,196 @@
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "map.h"
+#include "planner_config.h"
+#include "telemetry.h"
+
+// rate estimates: weight of the newest tick, limits of the estimated acceleration
+// along the road and of the lateral speed
+const double PREDICTION_ALPHA     = 0.5;
+const double PREDICTION_ACC_MAX   = 10.0;  // m/s^2
+const double PREDICTION_D_DOT_MAX = 3.0;   // m/s
+
+// never stops: no deceleration
+const double PREDICTION_NO_STOP = 1e30;
+
+
+// -------------------------------------------------------------------------------------
+// class PredictionTable
+//
+// + prediction of every tracked vehicle over the planning horizon, built once per
+//   tick: row k = time k x DT after the telemetry, column = fusion index - the rows
+//   FIRST..LAST (the planner: end of the previous path up to DISTANCE_NUM, the part
+//   of the horizon still to be planned)
+// + predict_xy adds x/y of the rows (batch getXY) for checks against trajectory
+//   points, done once per tick for all candidates of the cost planner
+//     s(t) = s + v*t + a/2*t^2   (constant acceleration, stops at v = 0)
+//     d(t) = d + d_dot*t         (constant lateral speed, at most one lane width)
+// + v = speed from vx/vy, a and d_dot estimated from the previous ticks: per vehicle
+//   (by sensor fusion id) the speed, d and the rates of the last tick are kept, the
+//   rates are the differences over the simulator time between the ticks, smoothed
+//   (PREDICTION_ALPHA) and limited - a vehicle seen the first time is predicted with
+//   constant velocity, as is every vehicle while no time passed
+// + SoA per vehicle, the rows are filled by one branch free loop over the vehicles
+//   per time step (auto-vectorized), the buffers keep their capacity between ticks
+// -------------------------------------------------------------------------------------
+
+class PredictionTable {
+
+ public:
+
+  PredictionTable() : n(0), first(0), last(-1), dt(0), sorted(false) {}
+
+  // sensor fusion of the tick, ELAPSED = simulator time since the previous update
+  void update(const Telemetry &t, double elapsed) {
+
+    n = t.fusion_size();
+
+    id.resize(n);
+    s0.resize(n);
+    d0.resize(n);
+    v.resize(n);
+    a.resize(n);
+    d_dot.resize(n);
+    t_stop.resize(n);
+
+    sorted = false;
+    for (int i=0;i<n;++i) {
+
+      const double *car = t.fusion(i);
+
+      double vx = car[SF_VX];
+      double vy = car[SF_VY];
+
+      id[i] = int(car[SF_ID]);
+      s0[i] = car[SF_S];
+      d0[i] = car[SF_D];
+      v[i]  = sqrt(vx*vx+vy*vy);
+
+      // history of the vehicle: same fusion index as last tick, else looked up by id
+      int k = (i<(int)last_id.size() && last_id[i]==id[i]) ? i : lookup(id[i]);
+      if (k<0) {
+        a[i]     = 0;
+        d_dot[i] = 0;
+      }
+      else if (elapsed>0) {
+        a[i]     = limit(last_a[k]+PREDICTION_ALPHA*((v[i]-last_v[k])/elapsed-last_a[k]),PREDICTION_ACC_MAX);
+        d_dot[i] = limit(last_d_dot[k]+PREDICTION_ALPHA*((d0[i]-last_d[k])/elapsed-last_d_dot[k]),PREDICTION_D_DOT_MAX);
+      }
+      else {
+        a[i]     = last_a[k];
+        d_dot[i] = last_d_dot[k];
+      }
+      t_stop[i] = (a[i]<0) ? -v[i]/a[i] : PREDICTION_NO_STOP;
+    }
+
+    last_id.assign(id.begin(),id.end());
+    last_v.assign(v.begin(),v.end());
+    last_d.assign(d0.begin(),d0.end());
+    last_a.assign(a.begin(),a.end());
+    last_d_dot.assign(d_dot.begin(),d_dot.end());
+  }
+
+  // rows FROM..TO, DT apart - d moves at most LANE_WIDTH from the current lane
+  void predict(int from, int to, double step_dt, double lane_width = LANE_WIDTH) {
+
+    first = from;
+    last  = std::max(from,to);
+    dt    = step_dt;
+    s.resize((last-first+1)*n);
+    d.resize((last-first+1)*n);
+
+    // plain pointers: the row stores cannot alias the per vehicle terms
+    const double *p_s0 = s0.data(), *p_d0 = d0.data(), *p_v = v.data(), *p_a = a.data();
+    const double *p_d_dot = d_dot.data(), *p_t_stop = t_stop.data();
+
+    for (int k=first;k<=last;++k) {
+      double  tk    = k*dt;
+      double *s_row = s.data()+(k-first)*n;
+      double *d_row = d.data()+(k-first)*n;
+      for (int i=0;i<n;++i) {
+        double ts  = std::min(tk,p_t_stop[i]);
+        double off = std::max(-lane_width,std::min(p_d_dot[i]*tk,lane_width));
+        s_row[i]   = p_s0[i]+ts*(p_v[i]+0.5*p_a[i]*ts);
+        d_row[i]   = p_d0[i]+off;
+      }
+    }
+  }
+
+  // x/y of the predicted rows on MAP
+  void predict_xy(const HighwayMap &map) {
+    x.resize(s.size());
+    y.resize(s.size());
+    map.getXY(s.data(),d.data(),x.data(),y.data(),s.size());
+  }
+
+  int vehicles()   const { return n; }
+  int first_step() const { return first; }
+  int last_step()  const { return last; }
+  double step_dt()   const { return dt; }
+
+  // predicted s/d of all vehicles at STEP (first_step()..last_step()), by fusion index
+  const double *s_at(int step) const { return s.data()+(step-first)*n; }
+  const double *d_at(int step) const { return d.data()+(step-first)*n; }
+  const double *x_at(int step) const { return x.data()+(step-first)*n; }
+  const double *y_at(int step) const { return y.data()+(step-first)*n; }
+
+  // predicted speed of vehicle I at STEP
+  double speed(int i, int step) const {
+    double ts = std::min(step*dt,t_stop[i]);
+    return v[i]+a[i]*ts;
+  }
+
+  // per vehicle of the tick (fusion order): id, state at the telemetry, rates
+  std::vector<int>    id;
+  std::vector<double> s0;
+  std::vector<double> d0;
+  std::vector<double> v;
+  std::vector<double> a;
+  std::vector<double> d_dot;
+
+ private:
+
+  static double limit(double x, double x_max) { return std::max(-x_max,std::min(x,x_max)); }
+
+  // index of ID in the history, -1 if it was not seen last tick
+  int lookup(int vehicle) {
+    if (!sorted) {
+      by_id.resize(last_id.size());
+      for (int k=0;k<(int)by_id.size();++k) by_id[k] = k;
+      std::sort(by_id.begin(),by_id.end(),[this](int x, int y) { return last_id[x]<last_id[y]; });
+      sorted = true;
+    }
+    std::vector<int>::iterator it = std::lower_bound(by_id.begin(),by_id.end(),vehicle,
+                                                     [this](int k, int value) { return last_id[k]<value; });
+    return (it!=by_id.end() && last_id[*it]==vehicle) ? *it : -1;
+  }
+
+  int    n;
+  int    first;
+  int    last;
+  double dt;
+
+  // time at which a decelerating vehicle stands still
+  std::vector<double> t_stop;
+
+  // rows first..last x vehicles
+  std::vector<double> s;
+  std::vector<double> d;
+  std::vector<double> x;
+  std::vector<double> y;
+
+  // history: vehicles of the last tick, by fusion index there
+  std::vector<int>    last_id;
+  std::vector<double> last_v;
+  std::vector<double> last_d;
+  std::vector<double> last_a;
+  std::vector<double> last_d_dot;
+  std::vector<int>    by_id;
+  bool                sorted;
+};
+
+#endif /* PREDICTION_H */
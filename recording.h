@@ -0,0 +1,67 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stdlib.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// -------------------------------------------------------------------------------------
+// recording files (./path_planning --record=<file>)
+//
+// + one socket.io event frame per line, tagged with the connection it came in on:
+//     <connection> 42["telemetry",{...}]
+//   connections are numbered in the order they connected to the server
+// + untagged lines (42["telemetry",...] at the start of the line) are one session,
+//   connection 0 - recordings of a single simulator
+// + read_recording_sessions: the frames of every connection in the order of the
+//   file, one session per connection; read_recording: the first session only (tools
+//   that drive one planner, or several with the same frames)
+// -------------------------------------------------------------------------------------
+
+// frame of a recorded LINE, its connection in CONNECTION - false if the line has no
+// frame
+inline bool recorded_frame(const std::string &line, int &connection, std::string &frame) {
+  size_t k = 0;
+  while (k<line.size() && line[k]>='0' && line[k]<='9') ++k;
+  size_t start = 0;
+  connection   = 0;
+  if (k>0 && k<line.size() && line[k]==' ') {
+    connection = atoi(line.c_str());
+    start      = k+1;
+  }
+  if (line.size()-start<=2) return false;
+  frame.assign(line,start,std::string::npos);
+  return true;
+}
+
+// frames of FILE by connection, in the order the connections appear
+inline bool read_recording_sessions(const std::string &file, std::vector<std::vector<std::string> > &sessions,
+                                    std::vector<int> *connections = nullptr) {
+  std::ifstream    in(file.c_str());
+  std::vector<int> ids;
+  std::string      line, frame;
+  int              connection;
+  while (std::getline(in,line)) {
+    if (!recorded_frame(line,connection,frame)) continue;
+    int s = 0;
+    while (s<(int)ids.size() && ids[s]!=connection) ++s;
+    if (s==(int)ids.size()) {
+      ids.push_back(connection);
+      sessions.emplace_back();
+    }
+    sessions[s].push_back(frame);
+  }
+  if (connections) *connections = ids;
+  return !sessions.empty();
+}
+
+// frames of the first session of FILE
+inline bool read_recording(const std::string &file, std::vector<std::string> &frames) {
+  std::vector<std::vector<std::string> > sessions;
+  if (!read_recording_sessions(file,sessions)) return false;
+  frames.swap(sessions[0]);
+  return true;
+}
+
+#endif /* RECORDING_H */
@@ -0,0 +1,257 @@
+#ifndef REFERENCE_LINE_H
+#define REFERENCE_LINE_H
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "map.h"
+
+// arc length table: spline parameter at REF_ARC_STEPS equal parts of every segment
+const int    REF_ARC_STEPS   = 8;
+
+// XY -> Frenet: Newton iterations for the closest point, parameter step to stop at
+const int    REF_NEWTON_ITER = 8;
+const double REF_NEWTON_TOL  = 1e-9;
+
+
+// -------------------------------------------------------------------------------------
+// class ReferenceLine
+//
+// + smooth reference line of a closed loop map, built once at startup: periodic
+//   cubic splines x(u), y(u) through all waypoints, u = waypoint s - the loop
+//   closes at max_s with continuous heading and curvature, no kinks at the
+//   waypoints (the piecewise linear getXY has one at every waypoint)
+// + arc length reparameterization: per segment the spline parameter at
+//   REF_ARC_STEPS equal parts of the segment's arc length (Gauss-Legendre), so s
+//   runs uniformly along the curve between the waypoints and hits every waypoint
+//   at its map s - the same s as the telemetry
+// + xy: Frenet -> XY, segment lookup (binary search) + cubic, d along the right hand
+//   normal (same side as the map's dx,dy) - no transcendental calls, batch version
+//   over SoA spans
+// + frenet: XY -> Frenet, closest waypoint of the map (grid / HINT) as start, Newton
+//   iterations on the closest point of the spline, across segment boundaries
+// + replaces the LocalReference fit of every JMT trajectory and the spline fit of
+//   the spline backend (it samples the offset curve); a section map (window of a
+//   tiled route) has no closed loop, trajectories on it keep the local fits
+// -------------------------------------------------------------------------------------
+
+class ReferenceLine {
+
+ public:
+
+  explicit ReferenceLine(const HighwayMap &map) : map(map), n(map.size()) {
+
+    h.resize(n);
+    for (int i=0;i<n;++i) h[i] = (i+1<n) ? map.s[i+1]-map.s[i] : map.max_s-map.s[i]+map.s[0];
+
+    // second derivatives of the periodic splines: cyclic tridiagonal system
+    std::vector<double> mx(n), my(n);
+    std::vector<double> rx(n), ry(n);
+    for (int i=0;i<n;++i) {
+      int p = (i+n-1)%n, q = (i+1)%n;
+      rx[i] = 6*((map.x[q]-map.x[i])/h[i]-(map.x[i]-map.x[p])/h[p]);
+      ry[i] = 6*((map.y[q]-map.y[i])/h[i]-(map.y[i]-map.y[p])/h[p]);
+    }
+    solve_cyclic(rx,ry,mx,my);
+
+    // per segment: P(t) = a + b t + c t^2 + d t^3, t in [0,h]
+    ax.resize(n); bx.resize(n); cx.resize(n); dx.resize(n);
+    ay.resize(n); by.resize(n); cy.resize(n); dy.resize(n);
+    for (int i=0;i<n;++i) {
+      int q = (i+1)%n;
+      ax[i] = map.x[i];
+      bx[i] = (map.x[q]-map.x[i])/h[i]-h[i]*(2*mx[i]+mx[q])/6;
+      cx[i] = mx[i]/2;
+      dx[i] = (mx[q]-mx[i])/(6*h[i]);
+      ay[i] = map.y[i];
+      by[i] = (map.y[q]-map.y[i])/h[i]-h[i]*(2*my[i]+my[q])/6;
+      cy[i] = my[i]/2;
+      dy[i] = (my[q]-my[i])/(6*h[i]);
+    }
+
+    // arc length table: parameter at k/REF_ARC_STEPS of the segment's arc length
+    arc_t.resize(n*(REF_ARC_STEPS+1));
+    for (int i=0;i<n;++i) {
+      double *tab   = &arc_t[i*(REF_ARC_STEPS+1)];
+      double  total = arc(i,h[i]);
+      tab[0]             = 0;
+      tab[REF_ARC_STEPS] = h[i];
+      for (int k=1;k<REF_ARC_STEPS;++k) {
+        double target = total*k/REF_ARC_STEPS;
+        double t      = h[i]*k/REF_ARC_STEPS;
+        for (int it=0;it<REF_NEWTON_ITER;++it) {
+          double px, py, tx, ty;
+          point(i,t,px,py,tx,ty);
+          double step = (arc(i,t)-target)/sqrt(tx*tx+ty*ty);
+          t = std::max(tab[k-1],std::min(t-step,h[i]));
+          if (fabs(step)<REF_NEWTON_TOL) break;
+        }
+        tab[k] = t;
+      }
+    }
+  }
+
+  // Frenet -> XY
+  void xy(double s, double d, double &x_out, double &y_out) const {
+    double s_wrap = map.wrap_s(s);
+    int    i      = map.segment(s_wrap);
+    double px, py, tx, ty;
+    point(i,param(i,s_wrap-map.s[i]),px,py,tx,ty);
+    xy_kernel(px,py,tx,ty,d,x_out,y_out);
+  }
+
+  // batch version over SoA spans: s[],d[] -> x[],y[] (caller provided, n entries, in
+  // place allowed)
+  void xy(const double *s_in, const double *d, double *x_out, double *y_out, int num) const {
+
+    double px[MAP_BATCH], py[MAP_BATCH], tx[MAP_BATCH], ty[MAP_BATCH];
+
+    for (int b=0;b<num;b+=MAP_BATCH) {
+
+      int m = std::min(num-b,MAP_BATCH);
+
+      for (int i=0;i<m;++i) {
+        double s_wrap = map.wrap_s(s_in[b+i]);
+        int    seg    = map.segment(s_wrap);
+        point(seg,param(seg,s_wrap-map.s[seg]),px[i],py[i],tx[i],ty[i]);
+      }
+
+      const double *d_b = d+b;
+      double       *x_b = x_out+b;
+      double       *y_b = y_out+b;
+      for (int i=0;i<m;++i) xy_kernel(px[i],py[i],tx[i],ty[i],d_b[i],x_b[i],y_b[i]);
+    }
+  }
+
+  // XY -> Frenet, s in [0,max_s) - HINT (in/out) as for HighwayMap::ClosestWaypoint
+  void frenet(double x_in, double y_in, double &s_out, double &d_out, int *hint = nullptr) const {
+
+    int    i = map.ClosestWaypoint(x_in,y_in,hint);
+    double t = 0;
+    double px, py, tx, ty;
+
+    // closest point: (P(t)-q).P'(t) = 0
+    for (int it=0;it<REF_NEWTON_ITER;++it) {
+      point(i,t,px,py,tx,ty);
+      double rx  = px-x_in;
+      double ry  = py-y_in;
+      double g   = rx*tx+ry*ty;
+      double t2  = tx*tx+ty*ty;
+      double H   = t2+rx*(2*cx[i]+6*dx[i]*t)+ry*(2*cy[i]+6*dy[i]*t);
+      double step = g/((H>0) ? H : t2);
+      t -= step;
+      while (t<0)    { i = (i+n-1)%n; t += h[i]; }
+      while (t>h[i]) { t -= h[i];     i = (i+1)%n; }
+      if (fabs(step)<REF_NEWTON_TOL) break;
+    }
+    point(i,t,px,py,tx,ty);
+
+    d_out = ((x_in-px)*ty-(y_in-py)*tx)/sqrt(tx*tx+ty*ty);
+    s_out = map.wrap_s(map.s[i]+offset(i,t));
+  }
+
+ private:
+
+  // position and tangent (not normalized) of segment I at parameter T
+  void point(int i, double t, double &px, double &py, double &tx, double &ty) const {
+    px = ((dx[i]*t+cx[i])*t+bx[i])*t+ax[i];
+    py = ((dy[i]*t+cy[i])*t+by[i])*t+ay[i];
+    tx = (3*dx[i]*t+2*cx[i])*t+bx[i];
+    ty = (3*dy[i]*t+2*cy[i])*t+by[i];
+  }
+
+  static void xy_kernel(double px, double py, double tx, double ty, double d, double &x_out, double &y_out) {
+    double tn = sqrt(tx*tx+ty*ty);
+    x_out = px+d*ty/tn;
+    y_out = py-d*tx/tn;
+  }
+
+  // s offset in segment I -> spline parameter
+  double param(int i, double s_off) const {
+    const double *tab = &arc_t[i*(REF_ARC_STEPS+1)];
+    double        f   = std::max(0.0,s_off/h[i]*REF_ARC_STEPS);
+    int           k   = std::min(int(f),REF_ARC_STEPS-1);
+    return tab[k]+(f-k)*(tab[k+1]-tab[k]);
+  }
+
+  // spline parameter in segment I -> s offset (inverse of param)
+  double offset(int i, double t) const {
+    const double *tab = &arc_t[i*(REF_ARC_STEPS+1)];
+    int           k   = 0;
+    while (k+1<REF_ARC_STEPS && tab[k+1]<=t) ++k;
+    return (k+(t-tab[k])/(tab[k+1]-tab[k]))*h[i]/REF_ARC_STEPS;
+  }
+
+  // arc length of segment I from 0 to T, 5 point Gauss-Legendre
+  double arc(int i, double t) const {
+    static const double GL_X[] = { 0.0, 0.5384693101056831, -0.5384693101056831, 0.9061798459386640, -0.9061798459386640 };
+    static const double GL_W[] = { 0.5688888888888889, 0.4786286704993665, 0.4786286704993665, 0.2369268850561891, 0.2369268850561891 };
+    double sum = 0;
+    for (int k=0;k<5;++k) {
+      double u = 0.5*t*(GL_X[k]+1);
+      double px, py, tx, ty;
+      point(i,u,px,py,tx,ty);
+      sum += GL_W[k]*sqrt(tx*tx+ty*ty);
+    }
+    return 0.5*t*sum;
+  }
+
+  // cyclic tridiagonal system of the periodic splines (Sherman-Morrison), two right
+  // hand sides RX/RY -> MX/MY
+  void solve_cyclic(const std::vector<double> &rx, const std::vector<double> &ry, std::vector<double> &mx, std::vector<double> &my) const {
+
+    // row i: h[i-1] m[i-1] + 2 (h[i-1]+h[i]) m[i] + h[i] m[i+1], corners h[n-1]
+    std::vector<double> lo(n), diag(n), up(n), u(n, 0), z(n);
+    for (int i=0;i<n;++i) {
+      int p = (i+n-1)%n;
+      lo[i]   = h[p];
+      diag[i] = 2*(h[p]+h[i]);
+      up[i]   = h[i];
+    }
+    double corner = h[n-1];
+    double gamma  = -diag[0];
+    diag[0]   -= gamma;
+    diag[n-1] -= corner*corner/gamma;
+    u[0]       = gamma;
+    u[n-1]     = corner;
+
+    solve_tridiagonal(lo,diag,up,rx,mx);
+    solve_tridiagonal(lo,diag,up,ry,my);
+    solve_tridiagonal(lo,diag,up,u,z);
+
+    double den = 1+z[0]+corner*z[n-1]/gamma;
+    double fx  = (mx[0]+corner*mx[n-1]/gamma)/den;
+    double fy  = (my[0]+corner*my[n-1]/gamma)/den;
+    for (int i=0;i<n;++i) {
+      mx[i] -= fx*z[i];
+      my[i] -= fy*z[i];
+    }
+  }
+
+  // Thomas algorithm, LO[0] and UP[n-1] unused
+  void solve_tridiagonal(const std::vector<double> &lo, const std::vector<double> &diag, const std::vector<double> &up,
+                         const std::vector<double> &r, std::vector<double> &x) const {
+    std::vector<double> c(n);
+    double              b = diag[0];
+    x[0] = r[0]/b;
+    for (int i=1;i<n;++i) {
+      c[i] = up[i-1]/b;
+      b    = diag[i]-lo[i]*c[i];
+      x[i] = (r[i]-lo[i]*x[i-1])/b;
+    }
+    for (int i=n-2;i>=0;--i) x[i] -= c[i+1]*x[i+1];
+  }
+
+  const HighwayMap &map;
+  int               n;
+
+  // segment lengths in s, cubic coefficients per segment
+  std::vector<double> h;
+  std::vector<double> ax, bx, cx, dx;
+  std::vector<double> ay, by, cy, dy;
+
+  // spline parameter at equal arc length steps, REF_ARC_STEPS+1 per segment
+  std::vector<double> arc_t;
+};
+
+#endif /* REFERENCE_LINE_H */
@@ -0,0 +1,62 @@
+#ifndef RIGID_TRANSFORM_H
+#define RIGID_TRANSFORM_H
+
+#include <math.h>
+
+// -------------------------------------------------------------------------------------
+// struct RigidTransform
+//
+// + 2D rigid transform of a frame at (x,y) with heading yaw: apply = frame -> world
+//   (rotate by yaw, then shift), inverse = world -> frame (shift, then rotate by
+//   -yaw) - the vehicle frame of the spline trajectory
+// + cos/sin of the heading are computed once when the transform is built, the point
+//   transforms are multiply/add only
+// + batch versions over SoA spans (in place allowed), branch free, auto-vectorized
+// + same operations in the same order as the original per point code with
+//   cos(0-yaw)/sin(0-yaw) => bit-identical results
+// -------------------------------------------------------------------------------------
+
+struct RigidTransform {
+
+  RigidTransform() : x(0), y(0), c(1), s(0) {}
+  RigidTransform(double x, double y, double yaw) : x(x), y(y), c(cos(yaw)), s(sin(yaw)) {}
+
+  // frame -> world
+  void apply(double px, double py, double &wx, double &wy) const {
+    wx = (px*c-py*s)+x;
+    wy = (px*s+py*c)+y;
+  }
+
+  // world -> frame
+  void inverse(double wx, double wy, double &px, double &py) const {
+    double shift_x = wx-x;
+    double shift_y = wy-y;
+    px = shift_x*c+shift_y*s;
+    py = shift_y*c-shift_x*s;
+  }
+
+  void apply(const double *px, const double *py, double *wx, double *wy, int n) const {
+    for (int i=0;i<n;++i) {
+      double a = px[i], b = py[i];
+      wx[i] = (a*c-b*s)+x;
+      wy[i] = (a*s+b*c)+y;
+    }
+  }
+
+  void inverse(const double *wx, const double *wy, double *px, double *py, int n) const {
+    for (int i=0;i<n;++i) {
+      double shift_x = wx[i]-x;
+      double shift_y = wy[i]-y;
+      px[i] = shift_x*c+shift_y*s;
+      py[i] = shift_y*c-shift_x*s;
+    }
+  }
+
+  // origin and heading (cos/sin) of the frame
+  double x;
+  double y;
+  double c;
+  double s;
+};
+
+#endif /* RIGID_TRANSFORM_H */
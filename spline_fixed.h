@@ -0,0 +1,108 @@
+#ifndef SPLINE_FIXED_H
+#define SPLINE_FIXED_H
+
+#include <assert.h>
+#include <vector>
+
+// -------------------------------------------------------------------------------------
+// class FixedSpline
+//
+// + natural cubic spline through up to N points, same interface as tk::spline
+//   (set_points + operator()) but all coefficients live in inline storage, so a
+//   spline kept in the planning context is refitted every tick without a malloc
+//
+// + x values must be strictly increasing (same precondition as tk::spline)
+// + outside [x0,xn] the spline is extrapolated linearly (natural boundary, the
+//   second derivative is 0 at both ends)
+// -------------------------------------------------------------------------------------
+
+template <int N>
+class FixedSpline {
+
+ public:
+
+  FixedSpline() : n(0) {}
+
+  void set_points(const std::vector<double> &x, const std::vector<double> &y) {
+    set_points(x.data(),y.data(),x.size());
+  }
+
+  void set_points(const double *x, const double *y, int num) {
+
+    assert(num>=2 && num<=N);
+    n = num;
+
+    for (int i=0;i<n;++i) {
+      m_x[i] = x[i];
+      m_y[i] = y[i];
+    }
+
+    // tridiagonal system for the second derivative terms c (Thomas algorithm)
+    double h[N], mu[N], z[N];
+
+    for (int i=0;i<n-1;++i) {
+      h[i] = m_x[i+1]-m_x[i];
+      assert(h[i]>0);
+    }
+
+    mu[0] = 0;
+    z[0]  = 0;
+    for (int i=1;i<n-1;++i) {
+      double rhs = 3*(m_y[i+1]-m_y[i])/h[i]-3*(m_y[i]-m_y[i-1])/h[i-1];
+      double l   = 2*(m_x[i+1]-m_x[i-1])-h[i-1]*mu[i-1];
+      mu[i] = h[i]/l;
+      z[i]  = (rhs-h[i-1]*z[i-1])/l;
+    }
+
+    // back substitution, natural boundary c[n-1] = 0
+    m_c[n-1] = 0;
+    for (int i=n-2;i>=0;--i) {
+      m_c[i] = z[i]-mu[i]*m_c[i+1];
+      m_b[i] = (m_y[i+1]-m_y[i])/h[i]-h[i]*(m_c[i+1]+2*m_c[i])/3;
+      m_d[i] = (m_c[i+1]-m_c[i])/(3*h[i]);
+    }
+
+    // slope at the right end for the linear extrapolation
+    m_b[n-1] = m_b[n-2]+2*m_c[n-2]*h[n-2]+3*m_d[n-2]*h[n-2]*h[n-2];
+    m_d[n-1] = 0;
+  }
+
+  double operator()(double x) const {
+
+    // left of the first point => linear with the slope at x0 (c[0] = 0)
+    if (x<m_x[0]) return m_y[0]+m_b[0]*(x-m_x[0]);
+
+    // right of the last point => linear with the slope at xn
+    if (x>=m_x[n-1]) return m_y[n-1]+m_b[n-1]*(x-m_x[n-1]);
+
+    int i = 0;
+    while (x>=m_x[i+1]) ++i;
+
+    double dx = x-m_x[i];
+    return ((m_d[i]*dx+m_c[i])*dx+m_b[i])*dx+m_y[i];
+  }
+
+  // first derivative
+  double deriv(double x) const {
+
+    if (x<m_x[0])      return m_b[0];
+    if (x>=m_x[n-1])   return m_b[n-1];
+
+    int i = 0;
+    while (x>=m_x[i+1]) ++i;
+
+    double dx = x-m_x[i];
+    return (3*m_d[i]*dx+2*m_c[i])*dx+m_b[i];
+  }
+
+ private:
+
+  int    n;
+  double m_x[N];
+  double m_y[N];
+  double m_b[N];
+  double m_c[N];
+  double m_d[N];
+};
+
+#endif /* SPLINE_FIXED_H */
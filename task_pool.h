@@ -0,0 +1,136 @@
+#ifndef TASK_POOL_H
+#define TASK_POOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// -------------------------------------------------------------------------------------
+// class TaskPool
+//
+// + fixed set of worker threads shared by all planners (event loops)
+// + run(n,fn) calls fn(0..n-1) on the workers and the calling thread and returns
+//   when all calls are done - the caller always takes part, so a busy or empty pool
+//   (0 workers) still makes progress
+// + several event loops may call run() at the same time, the batches are served in
+//   order of arrival
+// + the queue links the batches (on the callers' stacks) through Batch::link, so
+//   run() does not allocate
+// -------------------------------------------------------------------------------------
+
+class TaskPool {
+
+ public:
+
+  TaskPool(int workers) : stop(false), head(nullptr), tail(nullptr) {
+    for (int i=0;i<workers;++i) threads.push_back(std::thread([this] { work(); }));
+  }
+
+  ~TaskPool() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads) t.join();
+  }
+
+  int workers() const { return threads.size(); }
+
+  void run(int n, const std::function<void(int)> &fn) {
+
+    if (n<=0) return;
+
+    Batch batch(n,fn);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (tail) tail->link = &batch;
+      else      head       = &batch;
+      tail = &batch;
+    }
+    wake.notify_all();
+
+    // take part until all tasks are handed out, then wait for the workers
+    int i;
+    while ((i = next_task(&batch))>=0) {
+      fn(i);
+      finish(&batch);
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    batch.finished.wait(guard,[&batch] { return batch.done==batch.n; });
+  }
+
+ private:
+
+  // one run() call, lives on the stack of the caller - only touched under the lock
+  // and removed from the queue as soon as its last task is handed out
+  struct Batch {
+    Batch(int n, const std::function<void(int)> &fn) : n(n), next(0), done(0), fn(fn), link(nullptr) {}
+    int                              n;
+    int                              next;
+    int                              done;
+    const std::function<void(int)>  &fn;
+    std::condition_variable          finished;
+    Batch                           *link;      // next batch in the queue
+  };
+
+  // next task index of BATCH, -1 if all are handed out
+  int next_task(Batch *batch) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (batch->next>=batch->n) return -1;
+    int i = batch->next++;
+    if (batch->next==batch->n) pop(batch);
+    return i;
+  }
+
+  void finish(Batch *batch) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (++batch->done==batch->n) batch->finished.notify_all();
+  }
+
+  // unlinks BATCH from the queue
+  void pop(Batch *batch) {
+    Batch *prev = nullptr;
+    for (Batch *b=head;b;prev=b,b=b->link) {
+      if (b==batch) {
+        if (prev) prev->link = b->link;
+        else      head       = b->link;
+        if (tail==b) tail = prev;
+        return;
+      }
+    }
+  }
+
+  void work() {
+    for (;;) {
+
+      Batch *batch;
+      int    i;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard,[this] { return stop || head; });
+        if (stop) return;
+
+        batch = head;
+        i     = batch->next++;
+        if (batch->next==batch->n) pop(batch);
+      }
+
+      batch->fn(i);
+      finish(batch);
+    }
+  }
+
+  bool                     stop;
+  std::mutex               lock;
+  std::condition_variable  wake;
+  Batch                   *head;      // queued batches, oldest first
+  Batch                   *tail;
+  std::vector<std::thread> threads;
+};
+
+#endif /* TASK_POOL_H */
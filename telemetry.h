@@ -0,0 +1,326 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+// sensor fusion fields per car, [id, x, y, vx, vy, s, d]
+enum { SF_ID, SF_X, SF_Y, SF_VX, SF_VY, SF_S, SF_D, SF_FIELDS };
+
+// parser result
+enum TelemetryStatus {
+  TELEMETRY_OK,      // telemetry event decoded
+  TELEMETRY_MANUAL,  // event without data (manual driving)
+  TELEMETRY_OTHER,   // some other event
+  TELEMETRY_ERROR    // not a socket.io event or malformed json
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct Telemetry
+//
+// + decoded "telemetry" event, kept in the planning context and refilled every
+//   message - the vectors keep their capacity, no allocation after the first ticks
+// + sensor fusion is a flat table, SF_FIELDS values per car
+// -------------------------------------------------------------------------------------
+
+struct Telemetry {
+
+  // Main car's localization Data
+  double car_x;
+  double car_y;
+  double car_s;
+  double car_d;
+  double car_yaw;
+  double car_speed;
+
+  // Previous path data given to the Planner
+  std::vector<double> previous_path_x;
+  std::vector<double> previous_path_y;
+  // Previous path's end s and d values
+  double end_path_s;
+  double end_path_d;
+
+  // Sensor Fusion Data, a list of all other cars on the same side of the road.
+  std::vector<double> sensor_fusion;
+
+  int           fusion_size()  const { return sensor_fusion.size()/SF_FIELDS; }
+  const double *fusion(int i)  const { return &sensor_fusion[i*SF_FIELDS]; }
+};
+
+
+// -------------------------------------------------------------------------------------
+// class TelemetryParser
+//
+// + pull parser for the socket.io frame 42["telemetry",{...}] reading straight from
+//   the websocket buffer (data,length) into a Telemetry struct - no copy of the
+//   payload, no DOM, no null terminator needed
+// + plain decimals are converted on a fast path, all other numbers with strtod on a
+//   small stack copy of the token only - the values are the same as the ones of
+//   json::parse either way
+// + unknown keys are skipped, so new simulator fields don't break the parser
+// -------------------------------------------------------------------------------------
+
+class TelemetryParser {
+
+ public:
+
+  static TelemetryStatus parse(const char *data, size_t length, Telemetry &t) {
+    TelemetryParser p(data,length);
+    return p.frame(t);
+  }
+
+ private:
+
+  TelemetryParser(const char *data, size_t length) : p(data), end(data+length) {}
+
+  TelemetryStatus frame(Telemetry &t) {
+
+    // "42" - websocket message + event
+    if (end-p<2 || p[0]!='4' || p[1]!='2') return TELEMETRY_ERROR;
+    p += 2;
+
+    if (!expect('[')) return TELEMETRY_ERROR;
+
+    const char *event;
+    size_t      event_len;
+    if (!string_token(event,event_len)) return TELEMETRY_ERROR;
+
+    bool is_telemetry = (event_len==9 && memcmp(event,"telemetry",9)==0);
+
+    // event without data
+    if (!expect(',')) return TELEMETRY_MANUAL;
+    if (literal("null")) return TELEMETRY_MANUAL;
+
+    if (!is_telemetry) return TELEMETRY_OTHER;
+
+    t.previous_path_x.clear();
+    t.previous_path_y.clear();
+    t.sensor_fusion.clear();
+
+    if (!object(t)) return TELEMETRY_ERROR;
+
+    return TELEMETRY_OK;
+  }
+
+  // data object of the telemetry event
+  bool object(Telemetry &t) {
+
+    if (!expect('{')) return false;
+    if (expect('}')) return true;
+
+    do {
+      const char *key;
+      size_t      key_len;
+      if (!string_token(key,key_len) || !expect(':')) return false;
+
+      bool ok;
+      if      (is(key,key_len,"x"))               ok = number(t.car_x);
+      else if (is(key,key_len,"y"))               ok = number(t.car_y);
+      else if (is(key,key_len,"s"))               ok = number(t.car_s);
+      else if (is(key,key_len,"d"))               ok = number(t.car_d);
+      else if (is(key,key_len,"yaw"))             ok = number(t.car_yaw);
+      else if (is(key,key_len,"speed"))           ok = number(t.car_speed);
+      else if (is(key,key_len,"previous_path_x")) ok = number_array(t.previous_path_x);
+      else if (is(key,key_len,"previous_path_y")) ok = number_array(t.previous_path_y);
+      else if (is(key,key_len,"end_path_s"))      ok = number(t.end_path_s);
+      else if (is(key,key_len,"end_path_d"))      ok = number(t.end_path_d);
+      else if (is(key,key_len,"sensor_fusion"))   ok = fusion_table(t.sensor_fusion);
+      else                                        ok = skip_value();
+      if (!ok) return false;
+
+    } while (expect(','));
+
+    return expect('}');
+  }
+
+  // [[id,x,y,vx,vy,s,d],...] - extra fields per car are dropped
+  bool fusion_table(std::vector<double> &table) {
+
+    if (!expect('[')) return false;
+    if (expect(']')) return true;
+
+    do {
+      if (!expect('[')) return false;
+      int k = 0;
+      if (!expect(']')) {
+        do {
+          double v;
+          if (!number(v)) return false;
+          if (k<SF_FIELDS) table.push_back(v);
+          ++k;
+        } while (expect(','));
+        if (!expect(']')) return false;
+      }
+      if (k<SF_FIELDS) return false;
+    } while (expect(','));
+
+    return expect(']');
+  }
+
+  bool number_array(std::vector<double> &values) {
+
+    if (!expect('[')) return false;
+    if (expect(']')) return true;
+
+    do {
+      double v;
+      if (!number(v)) return false;
+      values.push_back(v);
+    } while (expect(','));
+
+    return expect(']');
+  }
+
+  bool number(double &value) {
+
+    skip_ws();
+
+    // token end
+    size_t len = 0;
+    while (p+len<end && p[len] && strchr("+-.0123456789eE",p[len])) ++len;
+    if (len==0) return false;
+
+    if (!fast_number(p,len,value)) {
+
+      // copy of the token only, strtod needs a terminator
+      char buf[64];
+      if (len>=sizeof(buf)) return false;
+      memcpy(buf,p,len);
+      buf[len] = 0;
+
+      char *stop;
+      value = strtod(buf,&stop);
+      if (stop!=buf+len) return false;
+    }
+
+    p += len;
+    return true;
+  }
+
+  // -----------------------------------------------------------------------------------
+  // fast path for plain decimals: mantissa < 2^53 and a power of ten <= 1e22 are both
+  // exact doubles, so one multiplication/division gives the correctly rounded value
+  // (same result as strtod). Everything else goes to strtod.
+  // -----------------------------------------------------------------------------------
+
+  static bool fast_number(const char *str, size_t len, double &value) {
+
+    static const double pow10[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                    1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                    1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char *c   = str;
+    const char *end = str+len;
+
+    bool negative = (*c=='-');
+    if (negative) ++c;
+
+    unsigned long long mantissa = 0;
+    int                digits   = 0;
+    int                exp10    = 0;
+
+    for (;c<end && *c>='0' && *c<='9';++c,++digits) mantissa = mantissa*10+(*c-'0');
+    if (digits==0) return false;
+
+    if (c<end && *c=='.') {
+      ++c;
+      const char *frac = c;
+      for (;c<end && *c>='0' && *c<='9';++c,++digits) mantissa = mantissa*10+(*c-'0');
+      if (c==frac) return false;
+      exp10 = -int(c-frac);
+    }
+
+    // exponent or anything unusual => strtod
+    if (c!=end || digits>15 || exp10<-22) return false;
+
+    value = double(mantissa)/pow10[-exp10];
+    if (negative) value = -value;
+    return true;
+  }
+
+  // string without decoding escapes (keys and event names are plain ascii)
+  bool string_token(const char *&str, size_t &len) {
+
+    if (!expect('"')) return false;
+    str = p;
+    while (p<end && *p!='"') {
+      // escape: skip the escaped byte, a truncated one is a parse error
+      if (*p=='\\' && ++p==end) return false;
+      ++p;
+    }
+    if (p>=end) return false;
+    len = p-str;
+    ++p;
+    return true;
+  }
+
+  bool skip_value() {
+
+    skip_ws();
+    if (p>=end) return false;
+
+    const char *str;
+    size_t      len;
+    double      v;
+
+    switch (*p) {
+      case '"': return string_token(str,len);
+      case '[': return skip_nested('[',']');
+      case '{': return skip_nested('{','}');
+      case 't': return literal("true");
+      case 'f': return literal("false");
+      case 'n': return literal("null");
+      default:  return number(v);
+    }
+  }
+
+  bool skip_nested(char open, char close) {
+
+    int depth = 0;
+    while (p<end) {
+      char c = *p;
+      if (c=='"') {
+        const char *str;
+        size_t      len;
+        if (!string_token(str,len)) return false;
+        continue;
+      }
+      ++p;
+      if      (c==open)  ++depth;
+      else if (c==close && --depth==0) return true;
+    }
+    return false;
+  }
+
+  bool literal(const char *lit) {
+    skip_ws();
+    size_t len = strlen(lit);
+    if (size_t(end-p)<len || memcmp(p,lit,len)!=0) return false;
+    p += len;
+    return true;
+  }
+
+  bool expect(char c) {
+    skip_ws();
+    if (p<end && *p==c) {
+      ++p;
+      return true;
+    }
+    return false;
+  }
+
+  void skip_ws() {
+    while (p<end && (*p==' ' || *p=='\t' || *p=='\n' || *p=='\r')) ++p;
+  }
+
+  static bool is(const char *key, size_t len, const char *name) {
+    return strlen(name)==len && memcmp(key,name,len)==0;
+  }
+
+  const char *p;
+  const char *end;
+};
+
+#endif /* TELEMETRY_H */
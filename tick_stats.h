@@ -0,0 +1,339 @@
+#ifndef TICK_STATS_H
+#define TICK_STATS_H
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// -------------------------------------------------------------------------------------
+// stages of a planning tick
+//
+// + nested: check_lane runs inside behavior, fit and sample inside behavior (cost
+//   planner, one record per candidate) or the trajectory of the rule planner
+// -------------------------------------------------------------------------------------
+
+enum TickStage {
+  STAGE_TICK,        // planning tick, step to send
+  STAGE_PARSE,       // telemetry decoding
+  STAGE_PREDICT,     // prediction table of the tracked vehicles
+  STAGE_FUSION,      // sensor fusion table
+  STAGE_BEHAVIOR,    // lane / velocity decision (rule analysis or candidate search)
+  STAGE_CHECK_LANE,  // one check_lane call
+  STAGE_FIT,         // spline fit / JMT solve of one trajectory
+  STAGE_SAMPLE,      // trajectory sampling
+  STAGE_SERIALIZE,   // control message
+  STAGE_SEND,        // websocket send
+  STAGE_NUM
+};
+
+const char *const TICK_STAGE_NAMES[STAGE_NUM] = {
+  "tick", "parse", "predict", "fusion", "behavior", "check_lane", "fit", "sample", "serialize", "send"
+};
+
+// -------------------------------------------------------------------------------------
+// event counters of the ticks
+// -------------------------------------------------------------------------------------
+
+enum TickCounter {
+  COUNTER_TICKS,          // planner steps
+  COUNTER_DEGRADED,       // steps in the cheap mode (deadline estimate over budget)
+  COUNTER_DEADLINE_MISS,  // steps longer than the tick budget
+  COUNTER_COALESCED,      // telemetry frames replaced by a newer one before planning
+  COUNTER_NUM
+};
+
+const char *const TICK_COUNTER_NAMES[COUNTER_NUM] = {
+  "ticks", "degraded", "deadline_misses", "coalesced"
+};
+
+// log-linear histogram: values below 2 x STATS_SUB exact, above STATS_SUB buckets per
+// power of two (max. relative error 1/STATS_SUB) - ns up to ~2^40 (18 min)
+const int STATS_SUB_BITS = 4;
+const int STATS_SUB      = 1 << STATS_SUB_BITS;
+const int STATS_BUCKETS  = 38*STATS_SUB;
+
+// percentiles of the reports
+const double STATS_QUANTILES[] = { 0.5, 0.9, 0.99, 0.999 };
+const int    STATS_QUANTILE_NUM = sizeof(STATS_QUANTILES)/sizeof(STATS_QUANTILES[0]);
+
+typedef std::chrono::steady_clock StageClock;
+
+
+// -------------------------------------------------------------------------------------
+// histogram buckets
+// -------------------------------------------------------------------------------------
+
+inline int stats_bucket(uint64_t ns) {
+  if (ns<2*STATS_SUB) return ns;
+  int msb   = 63-__builtin_clzll(ns);
+  int shift = msb-STATS_SUB_BITS;
+  int idx   = (shift+1)*STATS_SUB+int(ns>>shift)-STATS_SUB;
+  return std::min(idx,STATS_BUCKETS-1);
+}
+
+// highest value of bucket IDX
+inline uint64_t stats_bucket_max(int idx) {
+  if (idx<2*STATS_SUB) return idx;
+  int shift = idx/STATS_SUB-1;
+  return ((uint64_t(idx%STATS_SUB+STATS_SUB+1)) << shift)-1;
+}
+
+
+// -------------------------------------------------------------------------------------
+// struct StageHistogram
+//
+// + latency histogram of one stage on one thread: written by that thread only
+//   (relaxed load + store, no locked instruction), read by the reporter at any time
+// -------------------------------------------------------------------------------------
+
+struct StageHistogram {
+
+  StageHistogram() : sum_ns(0), max_ns(0) {
+    for (int i=0;i<STATS_BUCKETS;++i) counts[i].store(0,std::memory_order_relaxed);
+  }
+
+  void record(uint64_t ns) {
+    std::atomic<uint64_t> &c = counts[stats_bucket(ns)];
+    c.store(c.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+    sum_ns.store(sum_ns.load(std::memory_order_relaxed)+ns,std::memory_order_relaxed);
+    if (ns>max_ns.load(std::memory_order_relaxed)) max_ns.store(ns,std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> counts[STATS_BUCKETS];
+  std::atomic<uint64_t> sum_ns;
+  std::atomic<uint64_t> max_ns;
+};
+
+struct ThreadStats {
+
+  ThreadStats() {
+    for (int i=0;i<COUNTER_NUM;++i) counters[i].store(0,std::memory_order_relaxed);
+  }
+
+  StageHistogram        stages[STAGE_NUM];
+  std::atomic<uint64_t> counters[COUNTER_NUM];
+};
+
+
+// -------------------------------------------------------------------------------------
+// registry of the per thread histograms
+//
+// + every thread recording a stage gets its own ThreadStats on the first record
+//   (the only locked step), they are kept after the thread ends so the counts stay
+//   in the report
+// -------------------------------------------------------------------------------------
+
+struct StatsRegistry {
+  std::mutex                                  lock;
+  std::vector<std::unique_ptr<ThreadStats> >  threads;
+};
+
+inline StatsRegistry &stats_registry() {
+  static StatsRegistry registry;
+  return registry;
+}
+
+inline ThreadStats &thread_stats() {
+  static thread_local ThreadStats *stats = nullptr;
+  if (!stats) {
+    StatsRegistry    &r = stats_registry();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.threads.push_back(std::unique_ptr<ThreadStats>(new ThreadStats()));
+    stats = r.threads.back().get();
+  }
+  return *stats;
+}
+
+inline void stage_record(TickStage stage, StageClock::time_point start) {
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(StageClock::now()-start).count();
+  thread_stats().stages[stage].record(ns);
+}
+
+inline void counter_add(TickCounter counter) {
+  std::atomic<uint64_t> &c = thread_stats().counters[counter];
+  c.store(c.load(std::memory_order_relaxed)+1,std::memory_order_relaxed);
+}
+
+// records the lifetime of the scope
+struct StageTimer {
+  StageTimer(TickStage stage) : stage(stage), start(StageClock::now()) {}
+  ~StageTimer() { stage_record(stage,start); }
+
+  TickStage              stage;
+  StageClock::time_point start;
+};
+
+
+// -------------------------------------------------------------------------------------
+// instrumentation macros
+//
+// + STAGE_SCOPE(stage)      - time the rest of the enclosing scope
+// + STAGE_BEGIN(name)       - start a clock NAME
+// + STAGE_END(name,stage)   - record the time since STAGE_BEGIN(name)
+// + STATS_COUNT(counter)    - count one event
+// + compiled with -DPLANNER_NO_STATS all of them expand to nothing, the reports
+//   stay empty
+// -------------------------------------------------------------------------------------
+
+#define STATS_CONCAT2(a,b) a##b
+#define STATS_CONCAT(a,b)  STATS_CONCAT2(a,b)
+
+#ifndef PLANNER_NO_STATS
+#define STAGE_SCOPE(stage)    StageTimer STATS_CONCAT(stage_timer_,__LINE__)(stage)
+#define STAGE_BEGIN(name)     StageClock::time_point name = StageClock::now()
+#define STAGE_END(name,stage) stage_record(stage,name)
+#define STATS_COUNT(counter)  counter_add(counter)
+#else
+#define STAGE_SCOPE(stage)
+#define STAGE_BEGIN(name)
+#define STAGE_END(name,stage)
+#define STATS_COUNT(counter)
+#endif
+
+
+// -------------------------------------------------------------------------------------
+// struct StageSummary / function stage_summaries
+//
+// + all threads merged per stage: count, mean, max and STATS_QUANTILES in ns
+//   (bucket upper bound, nearest rank)
+// -------------------------------------------------------------------------------------
+
+struct StageSummary {
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+  uint64_t quantile_ns[STATS_QUANTILE_NUM];
+};
+
+inline void stage_summaries(StageSummary (&out)[STAGE_NUM]) {
+
+  StatsRegistry    &r = stats_registry();
+  std::lock_guard<std::mutex> guard(r.lock);
+
+  std::vector<uint64_t> counts(STATS_BUCKETS);
+  for (int st=0;st<STAGE_NUM;++st) {
+
+    StageSummary &sum = out[st];
+    sum.count  = 0;
+    sum.sum_ns = 0;
+    sum.max_ns = 0;
+    std::fill(counts.begin(),counts.end(),0);
+
+    for (const std::unique_ptr<ThreadStats> &t : r.threads) {
+      const StageHistogram &h = t->stages[st];
+      for (int i=0;i<STATS_BUCKETS;++i) counts[i] += h.counts[i].load(std::memory_order_relaxed);
+      sum.sum_ns += h.sum_ns.load(std::memory_order_relaxed);
+      sum.max_ns  = std::max(sum.max_ns,h.max_ns.load(std::memory_order_relaxed));
+    }
+    for (int i=0;i<STATS_BUCKETS;++i) sum.count += counts[i];
+
+    int      idx  = 0;
+    uint64_t seen = 0;
+    for (int q=0;q<STATS_QUANTILE_NUM;++q) {
+      uint64_t rank = uint64_t(ceil(STATS_QUANTILES[q]*sum.count));
+      while (idx<STATS_BUCKETS-1 && seen+counts[idx]<std::max<uint64_t>(rank,1)) seen += counts[idx++];
+      sum.quantile_ns[q] = sum.count ? std::min(stats_bucket_max(idx),sum.max_ns) : 0;
+    }
+  }
+}
+
+// all threads merged
+inline void counter_totals(uint64_t (&out)[COUNTER_NUM]) {
+
+  StatsRegistry    &r = stats_registry();
+  std::lock_guard<std::mutex> guard(r.lock);
+
+  for (int c=0;c<COUNTER_NUM;++c) {
+    out[c] = 0;
+    for (const std::unique_ptr<ThreadStats> &t : r.threads) out[c] += t->counters[c].load(std::memory_order_relaxed);
+  }
+}
+
+
+// -------------------------------------------------------------------------------------
+// reports: JSON (GET /stats) and Prometheus text format (GET /metrics), times in us
+// resp. seconds
+// -------------------------------------------------------------------------------------
+
+inline void stats_json(std::string &out) {
+
+  StageSummary sums[STAGE_NUM];
+  stage_summaries(sums);
+
+  char buf[256];
+  out.clear();
+#ifdef PLANNER_NO_STATS
+  out += "{\"enabled\":false,\"stages\":{";
+#else
+  out += "{\"enabled\":true,\"stages\":{";
+#endif
+  for (int st=0;st<STAGE_NUM;++st) {
+    const StageSummary &s = sums[st];
+    snprintf(buf,sizeof(buf),"%s\"%s\":{\"count\":%llu,\"mean_us\":%.3f,\"max_us\":%.3f",
+             st ? "," : "",TICK_STAGE_NAMES[st],(unsigned long long)s.count,
+             s.count ? 1e-3*s.sum_ns/s.count : 0.0,1e-3*s.max_ns);
+    out += buf;
+    for (int q=0;q<STATS_QUANTILE_NUM;++q) {
+      snprintf(buf,sizeof(buf),",\"p%g_us\":%.3f",100*STATS_QUANTILES[q],1e-3*s.quantile_ns[q]);
+      out += buf;
+    }
+    out += "}";
+  }
+
+  uint64_t counters[COUNTER_NUM];
+  counter_totals(counters);
+  out += "},\"counters\":{";
+  for (int c=0;c<COUNTER_NUM;++c) {
+    snprintf(buf,sizeof(buf),"%s\"%s\":%llu",c ? "," : "",TICK_COUNTER_NAMES[c],(unsigned long long)counters[c]);
+    out += buf;
+  }
+  out += "}}";
+}
+
+inline void stats_prometheus(std::string &out) {
+
+  StageSummary sums[STAGE_NUM];
+  stage_summaries(sums);
+
+  char buf[256];
+  out.clear();
+  out += "# HELP planner_stage_seconds Latency of the planning tick stages.\n";
+  out += "# TYPE planner_stage_seconds summary\n";
+  for (int st=0;st<STAGE_NUM;++st) {
+    const StageSummary &s    = sums[st];
+    const char         *name = TICK_STAGE_NAMES[st];
+    for (int q=0;q<STATS_QUANTILE_NUM;++q) {
+      snprintf(buf,sizeof(buf),"planner_stage_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+               name,STATS_QUANTILES[q],1e-9*s.quantile_ns[q]);
+      out += buf;
+    }
+    snprintf(buf,sizeof(buf),"planner_stage_seconds_sum{stage=\"%s\"} %.9f\n",name,1e-9*s.sum_ns);
+    out += buf;
+    snprintf(buf,sizeof(buf),"planner_stage_seconds_count{stage=\"%s\"} %llu\n",name,(unsigned long long)s.count);
+    out += buf;
+  }
+  out += "# HELP planner_stage_max_seconds Slowest run of the planning tick stages.\n";
+  out += "# TYPE planner_stage_max_seconds gauge\n";
+  for (int st=0;st<STAGE_NUM;++st) {
+    snprintf(buf,sizeof(buf),"planner_stage_max_seconds{stage=\"%s\"} %.9f\n",TICK_STAGE_NAMES[st],
+             1e-9*sums[st].max_ns);
+    out += buf;
+  }
+
+  uint64_t counters[COUNTER_NUM];
+  counter_totals(counters);
+  for (int c=0;c<COUNTER_NUM;++c) {
+    snprintf(buf,sizeof(buf),"# TYPE planner_%s_total counter\nplanner_%s_total %llu\n",TICK_COUNTER_NAMES[c],
+             TICK_COUNTER_NAMES[c],(unsigned long long)counters[c]);
+    out += buf;
+  }
+}
+
+#endif /* TICK_STATS_H */
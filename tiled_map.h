@@ -0,0 +1,424 @@
+#ifndef TILED_MAP_H
+#define TILED_MAP_H
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "map.h"
+#include "map_file.h"
+
+// tiles of a route and the window of road kept around a vehicle
+const int    MAP_TILE_WAYPOINTS = 256;                // waypoints per tile
+const size_t MAP_TILE_CAP       = size_t(256) << 20;  // bytes of tiles resident
+const double MAP_TILE_BEHIND    = 300.0;              // m of road behind car_s in the window
+const double MAP_TILE_AHEAD     = 1000.0;             // m ahead, rebuilt at half of it left
+const double MAP_TILE_PREFETCH  = 3.0;                // tiles prefetched up to x ahead
+
+// arrays of a tile: waypoints and segment tables, MAP_X..MAP_SEG_NY of map_file.h
+const int MAP_TILE_ARRAYS = MAP_SEG_NY+1;
+
+
+// -------------------------------------------------------------------------------------
+// struct MapTile
+//
+// + waypoints [first,first+n) of the route with their segment tables, copied out of
+//   the route - SoA, MAP_TILE_ARRAYS arrays of n values
+// -------------------------------------------------------------------------------------
+
+struct MapTile {
+
+  const double *array(int a) const { return values.data()+size_t(a)*n; }
+  size_t        bytes() const      { return values.size()*sizeof(double); }
+
+  int                 first;
+  int                 n;
+  std::vector<double> values;
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct TileStats
+// -------------------------------------------------------------------------------------
+
+struct TileStats {
+  int    resident;    // tiles in the cache
+  size_t bytes;       // their size
+  long   loads;       // tiles loaded on demand (the tick waited for them)
+  long   prefetched;  // tiles loaded by the prefetch thread
+  long   hits;        // tile requests served from the cache
+  long   evictions;   // tiles dropped for the cap
+};
+
+
+// -------------------------------------------------------------------------------------
+// class TiledMap
+//
+// + a route larger than memory split into tiles of TILE_WAYPOINTS consecutive
+//   waypoints (= s ranges), shared by all sessions (thread safe)
+// + the route is a binary map file mapped without the checksum pass (map_file.h,
+//   structure checks only) - a tile is copied out of the mapping and the mapping's
+//   pages of the tile are dropped again (MADV_DONTNEED), so only the tile cache
+//   stays resident. A CSV route is parsed as a whole, tiling only bounds the
+//   per session windows then.
+// + tile cache: LRU under CAP bytes, tiles behind all vehicles age out first
+// + prefetch: a background thread loads queued tiles, the tick only copies
+//   resident ones
+// -------------------------------------------------------------------------------------
+
+class TiledMap {
+
+ public:
+
+  TiledMap(std::unique_ptr<HighwayMap> route_map, bool mapped, int tile_waypoints = MAP_TILE_WAYPOINTS,
+           size_t cap = MAP_TILE_CAP)
+    : route_map(std::move(route_map)), mapped(mapped), tile_waypoints(std::max(tile_waypoints,2)), cap(cap),
+      bytes(0), loads(0), prefetched(0), hits(0), evictions(0), stop(false) {
+
+    tables = this->route_map->tables();
+
+    // s range of every tile: first waypoint
+    int n = tables.x.size();
+    for (int i=0;i<n;i+=this->tile_waypoints) tile_s.push_back(tables.s[i]);
+
+    worker = std::thread(&TiledMap::run,this);
+  }
+
+  ~TiledMap() {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      stop = true;
+    }
+    wake.notify_all();
+    worker.join();
+  }
+
+  TiledMap(const TiledMap &) = delete;
+  TiledMap &operator=(const TiledMap &) = delete;
+
+  // whole route (views into the mapping): max_s, wrap_s - the tick uses a MapWindow
+  const HighwayMap &route() const { return *route_map; }
+  const MapTables  &route_tables() const { return tables; }
+
+  int tiles() const { return tile_s.size(); }
+
+  // first s of tile K
+  double tile_begin(int k) const { return tile_s[k]; }
+
+  // tile of route s S (wrapped), before the first waypoint = last tile (closing segment)
+  int tile_of(double s) const {
+    int k = int(std::upper_bound(tile_s.begin(),tile_s.end(),route_map->wrap_s(s))-tile_s.begin())-1;
+    return (k<0) ? tiles()-1 : k;
+  }
+
+  // tile K, loaded on demand if not resident
+  std::shared_ptr<const MapTile> tile(int k) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      auto it = cache.find(k);
+      if (it!=cache.end()) {
+        ++hits;
+        lru.splice(lru.begin(),lru,it->second.pos);
+        return it->second.tile;
+      }
+    }
+    std::shared_ptr<const MapTile> t = load(k);
+    std::lock_guard<std::mutex> guard(lock);
+    ++loads;
+    return insert(k,t);
+  }
+
+  // queue tile K for the prefetch thread, nothing if resident or queued
+  void prefetch(int k) {
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (cache.count(k) || std::find(queue.begin(),queue.end(),k)!=queue.end()) return;
+      queue.push_back(k);
+    }
+    wake.notify_one();
+  }
+
+  TileStats stats() const {
+    std::lock_guard<std::mutex> guard(lock);
+    TileStats st = { int(cache.size()), bytes, loads, prefetched, hits, evictions };
+    return st;
+  }
+
+ private:
+
+  struct Entry {
+    std::shared_ptr<const MapTile> tile;
+    std::list<int>::iterator       pos;
+  };
+
+  // copy tile K out of the route, drop the route's pages of it
+  std::shared_ptr<const MapTile> load(int k) const {
+
+    std::shared_ptr<MapTile> t(new MapTile());
+    t->first = k*tile_waypoints;
+    t->n     = std::min(tile_waypoints,tables.x.size()-t->first);
+    t->values.resize(size_t(MAP_TILE_ARRAYS)*t->n);
+
+    const MapArray<double> *src[MAP_TILE_ARRAYS] = {
+      &tables.x, &tables.y, &tables.s, &tables.dx, &tables.dy,
+      &tables.seg_acc, &tables.seg_cos, &tables.seg_sin, &tables.seg_nx, &tables.seg_ny };
+
+    for (int a=0;a<MAP_TILE_ARRAYS;++a) {
+      const double *p = src[a]->data()+t->first;
+      std::copy(p,p+t->n,t->values.begin()+size_t(a)*t->n);
+      if (mapped) release(p,t->n);
+    }
+    return t;
+  }
+
+  // whole pages of N values at P, the file is mapped read-only => dropped pages are
+  // read again on the next access
+  static void release(const double *p, int n) {
+    uintptr_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t lo   = (uintptr_t(p)+page-1)/page*page;
+    uintptr_t hi   = uintptr_t(p+n)/page*page;
+    if (hi>lo) madvise(reinterpret_cast<void *>(lo),hi-lo,MADV_DONTNEED);
+  }
+
+  // under the lock: add tile K (unless another thread was faster), evict to the cap
+  std::shared_ptr<const MapTile> insert(int k, const std::shared_ptr<const MapTile> &t) {
+
+    auto it = cache.find(k);
+    if (it!=cache.end()) return it->second.tile;
+
+    lru.push_front(k);
+    Entry &e = cache[k];
+    e.tile   = t;
+    e.pos    = lru.begin();
+    bytes   += t->bytes();
+
+    // least recently used first, never the tile just added
+    while (bytes>cap && lru.size()>1) {
+      auto victim = cache.find(lru.back());
+      bytes -= victim->second.tile->bytes();
+      cache.erase(victim);
+      lru.pop_back();
+      ++evictions;
+    }
+    return t;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> guard(lock);
+    for (;;) {
+      wake.wait(guard,[this] { return stop || !queue.empty(); });
+      if (stop) return;
+
+      int k = queue.front();
+      queue.pop_front();
+      if (cache.count(k)) continue;
+
+      guard.unlock();
+      std::shared_ptr<const MapTile> t = load(k);
+      guard.lock();
+
+      insert(k,t);
+      ++prefetched;
+    }
+  }
+
+  // route
+  std::unique_ptr<HighwayMap> route_map;
+  MapTables                   tables;
+  bool                        mapped;
+  int                         tile_waypoints;
+  std::vector<double>         tile_s;
+
+  // tile cache
+  size_t                         cap;
+  mutable std::mutex             lock;
+  std::unordered_map<int,Entry>  cache;
+  std::list<int>                 lru;
+  size_t                         bytes;
+  long                           loads;
+  long                           prefetched;
+  long                           hits;
+  long                           evictions;
+
+  // prefetch thread
+  std::deque<int>         queue;
+  std::condition_variable wake;
+  bool                    stop;
+  std::thread             worker;
+};
+
+
+// -------------------------------------------------------------------------------------
+// function load_tiled_map
+//
+// + binary map file (mapped, tiles dropped from memory after copying) or waypoint
+//   CSV (fallback, parsed as a whole)
+// + RETURN: the tiled map, nullptr (with a message on cerr) if there is none
+// -------------------------------------------------------------------------------------
+
+inline std::unique_ptr<TiledMap> load_tiled_map(const std::string &map_file, int tile_waypoints = MAP_TILE_WAYPOINTS,
+                                                size_t cap = MAP_TILE_CAP) {
+
+  bool                        mapped = is_map_file(map_file);
+  std::unique_ptr<HighwayMap> route  = mapped ? load_map_file(map_file,false) : load_map(map_file);
+  if (!route) return nullptr;
+  return std::unique_ptr<TiledMap>(new TiledMap(std::move(route),mapped,tile_waypoints,cap));
+}
+
+
+// -------------------------------------------------------------------------------------
+// class MapWindow
+//
+// + the road around one vehicle (session): the tiles from BEHIND m behind to AHEAD m
+//   ahead of car_s joined into a section HighwayMap (see HighwayMap), rebuilt when
+//   less than half of BEHIND / AHEAD is left - tile boundaries and the route's wrap
+//   point are inside the window, getXY / getFrenet don't see them
+// + the window's s is the route's s, unwrapped past the wrap point; getFrenet gives
+//   the same s as on the whole route
+// + a route shorter than the window (the simulator track) is its own window
+// + tiles up to MAP_TILE_PREFETCH x AHEAD are queued for the prefetch thread
+//   whenever the vehicle enters a new tile
+// + a rebuild copies the resident tiles and indexes them (allocates), between
+//   rebuilds at() is a range check
+// -------------------------------------------------------------------------------------
+
+class MapWindow {
+
+ public:
+
+  MapWindow(TiledMap &tiles, double behind = MAP_TILE_BEHIND, double ahead = MAP_TILE_AHEAD)
+    : rebuilds(0), tiles(tiles), behind(behind), ahead(ahead), whole(false), lo(0), hi(0), current(-1) {}
+
+  // map around route s CAR_S, valid until the next call
+  const HighwayMap &at(double car_s) {
+
+    const HighwayMap &route = tiles.route();
+    double            s     = route.wrap_s(car_s);
+
+    if (!whole && (!map || !covers(s,route.max_s))) build(s);
+
+    int k = tiles.tile_of(s);
+    if (k!=current) {
+      current  = k;
+      int last = tiles.tile_of(s+MAP_TILE_PREFETCH*ahead);
+      for (int i=0;i<=tiles.tiles();++i) {
+        tiles.prefetch(k);
+        if (k==last) break;
+        k = (k+1)%tiles.tiles();
+      }
+    }
+    return whole ? route : *map;
+  }
+
+  // the route is its own window (at() returns the route)
+  bool whole_route() const { return whole; }
+
+  long rebuilds;   // windows built
+
+ private:
+
+  // S on the lap of the window: [lo,lo+max_s)
+  bool covers(double s, double max_s) const {
+    double u = lo+fmod(s-lo+max_s,max_s);
+    return u-behind/2>=lo && u+ahead/2<=hi;
+  }
+
+  void build(double s) {
+
+    const HighwayMap &route = tiles.route();
+    double            max_s = route.max_s;
+    int               count = tiles.tiles();
+
+    // tiles from s-behind on until one ends past s+ahead, W = wraps of the route
+    double from = s-behind;
+    double to   = s+ahead;
+    int    w    = int(floor(from/max_s));
+    int    k    = tiles.tile_of(from);
+    if (tiles.tile_begin(k)>from-w*max_s) --w;   // closing segment of the previous lap
+
+    std::vector<int> ks;
+    std::vector<int> laps;
+    for (;;) {
+      ks.push_back(k);
+      laps.push_back(w);
+      double end = ((k+1<count) ? tiles.tile_begin(k+1) : max_s)+w*max_s;
+      if (end>=to) break;
+
+      // window around the whole loop: the route itself is the window
+      if (int(ks.size())==count) {
+        whole = true;
+        map.reset();
+        return;
+      }
+      if (++k==count) {
+        k = 0;
+        ++w;
+      }
+    }
+
+    std::vector<std::shared_ptr<const MapTile> > parts;
+    int                                          total = 0;
+    for (int p=0;p<int(ks.size());++p) {
+      parts.push_back(tiles.tile(ks[p]));
+      total += parts.back()->n;
+    }
+
+    // join, s relative to the lap of the first tile
+    std::shared_ptr<std::vector<double> > values(new std::vector<double>(size_t(MAP_TILE_ARRAYS)*total));
+    int off = 0;
+    for (int p=0;p<int(parts.size());++p) {
+      const MapTile &t = *parts[p];
+      for (int a=0;a<MAP_TILE_ARRAYS;++a) {
+        std::copy(t.array(a),t.array(a)+t.n,values->begin()+size_t(a)*total+off);
+      }
+      double shift = (laps[p]-laps[0])*max_s;
+      if (shift!=0) {
+        double *ws = values->data()+size_t(MAP_S)*total+off;
+        for (int i=0;i<t.n;++i) ws[i] += shift;
+      }
+      off += t.n;
+    }
+
+    const double *d[MAP_TILE_ARRAYS];
+    for (int a=0;a<MAP_TILE_ARRAYS;++a) d[a] = values->data()+size_t(a)*total;
+
+    MapTables t   = tiles.route_tables();
+    t.x           = MapArray<double>(d[MAP_X],total);
+    t.y           = MapArray<double>(d[MAP_Y],total);
+    t.s           = MapArray<double>(d[MAP_S],total);
+    t.dx          = MapArray<double>(d[MAP_DX],total);
+    t.dy          = MapArray<double>(d[MAP_DY],total);
+    t.seg_acc     = MapArray<double>(d[MAP_SEG_ACC],total);
+    t.seg_cos     = MapArray<double>(d[MAP_SEG_COS],total);
+    t.seg_sin     = MapArray<double>(d[MAP_SEG_SIN],total);
+    t.seg_nx      = MapArray<double>(d[MAP_SEG_NX],total);
+    t.seg_ny      = MapArray<double>(d[MAP_SEG_NY],total);
+
+    map.reset(new HighwayMap(t,values,true));
+    ++rebuilds;
+
+    // covered range: first waypoint to the end of the last tile
+    lo = t.s[0];
+    hi = ((k+1<count) ? tiles.tile_begin(k+1) : max_s)+(w-laps[0])*max_s;
+  }
+
+  TiledMap                    &tiles;
+  double                       behind;
+  double                       ahead;
+  std::unique_ptr<HighwayMap>  map;
+  bool                         whole;
+  double                       lo;
+  double                       hi;
+  int                          current;
+};
+
+#endif /* TILED_MAP_H */
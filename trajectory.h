@@ -0,0 +1,532 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <math.h>
+#include <vector>
+#include "jmt.h"
+#include "map.h"
+#include "planner_config.h"
+#include "reference_line.h"
+#include "rigid_transform.h"
+#include "spline_fixed.h"
+#include "telemetry.h"
+#include "tick_stats.h"
+
+// ------------------------------------------------------------------------
+// New constants
+// + planner state (lane, velocity) is per session, see Planner
+// + tuning (velocity, distances, sampling, lane width) in planner_config.h
+// ------------------------------------------------------------------------
+
+// constants
+const int PREVIOUS_SIZE_LIMIT    = 2;
+const int PTS_NUM                = 5;    // spline points: 2 from previous path + 3 ahead
+const double MPH_TO_MS           = 2.24; // mph per m/s (rounded)
+
+// JMT backend: speed change with JMT_ACC on average, lane change over 2 x spacing at
+// the average speed, both limited to [JMT_T_MIN,JMT_T_MAX] s
+const double JMT_ACC             = 8.0;
+const double JMT_T_MIN           = 0.5;
+const double JMT_T_MAX           = 10.0;
+
+// previous path end within this distance (m) of the last point sent = same path
+const double START_TOLERANCE     = 0.01;
+
+// trajectory generation (--trajectory=spline|jmt)
+enum TrajectoryBackend {
+  TRAJECTORY_SPLINE,  // spline in the vehicle frame, triangle linearization
+  TRAJECTORY_JMT      // quintic s(t),d(t), sampled at exact time steps
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct TrajectoryPlan
+//
+// + everything needed to sample more points of a trajectory: the maneuver (backend,
+//   lane, velocity, spacing), the curve (spline + vehicle frame, or the JMTs + the
+//   reference line) and how far it has been sampled
+// + LAST = last point sampled, the previous path ends there as long as the simulator
+//   drives this plan
+// + the JMT is mapped to x,y on the global reference line of the map (LINE) if the
+//   planner has one, else on a local reference line fitted around the start
+// + spline backend with a LINE: no spline fit, the curve is the offset curve of the
+//   line - lateral quintic JD over the s run from START_S, X_ADD_ON = s run sampled
+// -------------------------------------------------------------------------------------
+
+struct TrajectoryPlan {
+
+  TrajectoryPlan() : valid(false), line(nullptr) {}
+
+  bool              valid;
+  TrajectoryBackend backend;
+  int               lane;
+  double            velocity;
+  double            spacing;
+  double            last_x;
+  double            last_y;
+
+  // spline: vehicle frame at the reference point, x of the last point and step per point
+  // (on a LINE: s at the reference point, s run of the last point, arc length per point)
+  FixedSpline<PTS_NUM> spline;
+  RigidTransform       frame;
+  double               start_s;
+  double               x_add_on;
+  double               target_step;
+
+  // JMT: polynomials, reference line (global or local), number of points sampled
+  Jmt                  js;
+  Jmt                  jd;
+  const ReferenceLine *line;
+  LocalReference       ref;
+  int                  steps;
+};
+
+
+// -------------------------------------------------------------------------------------
+// struct Trajectory
+//
+// + path sent to the simulator, a point every POINTS_PER_SEC seconds
+// + END = Frenet state at the last point (JMT backend only), the start state of the
+//   next tick
+// + PLAN = the curve of the new points, see extend_trajectory
+// -------------------------------------------------------------------------------------
+
+struct Trajectory {
+
+  Trajectory() {
+    next_x_vals.reserve(DISTANCE_NUM);
+    next_y_vals.reserve(DISTANCE_NUM);
+  }
+
+  std::vector<double> next_x_vals;
+  std::vector<double> next_y_vals;
+  FrenetState         end;
+  TrajectoryPlan      plan;
+};
+
+
+// -------------------------------------------------------------------------------------
+// function sample_trajectory
+//
+// + appends NUM points of PLAN to OUT and advances the plan
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+inline void sample_trajectory(const Config &config, const HighwayMap &map, TrajectoryPlan &plan, int num,
+                              Trajectory &out) {
+
+  STAGE_SCOPE(STAGE_SAMPLE);
+
+  std::vector<double> &next_x_vals = out.next_x_vals;
+  std::vector<double> &next_y_vals = out.next_y_vals;
+
+  if (plan.backend==TRAJECTORY_JMT) {
+
+    double dt = plan.steps*config.points_per_sec();
+    if (plan.line) {
+      // s,d of the new points appended in place, then one batch conversion
+      int     base = next_x_vals.size();
+      next_x_vals.resize(base+num);
+      next_y_vals.resize(base+num);
+      double *ps   = next_x_vals.data()+base;
+      double *pd   = next_y_vals.data()+base;
+      for (int i=0;i<num;++i) {
+        dt    = (++plan.steps)*config.points_per_sec();
+        ps[i] = plan.js.pos(dt);
+        pd[i] = plan.jd.pos(dt);
+      }
+      plan.line->xy(ps,pd,ps,pd,num);
+    }
+    else {
+      for (int i=0;i<num;++i) {
+        dt = (++plan.steps)*config.points_per_sec();
+        double x, y;
+        plan.ref.xy(plan.js.pos(dt),plan.jd.pos(dt),x,y);
+        next_x_vals.push_back(x);
+        next_y_vals.push_back(y);
+      }
+    }
+
+    out.end.s      = map.wrap_s(plan.js.pos(dt));
+    out.end.s_dot  = plan.js.vel(dt);
+    out.end.s_ddot = plan.js.acc(dt);
+    out.end.d      = plan.jd.pos(dt);
+    out.end.d_dot  = plan.jd.vel(dt);
+    out.end.d_ddot = plan.jd.acc(dt);
+  }
+  else if (plan.line) {
+
+    //
+    // Create Trajectory - offset curve of the reference line, a point every TARGET_STEP
+    // of arc length: the offset curve is longer / shorter than the line (d x curvature,
+    // lateral motion), the s step is scaled by the chord of the point before - the
+    // first one measured once per call
+    //
+    double last_x = plan.last_x;
+    double last_y = plan.last_y;
+    double x, y;
+    plan.line->xy(plan.start_s+plan.x_add_on+plan.target_step,plan.jd.pos(plan.x_add_on+plan.target_step),x,y);
+    double scale  = plan.target_step/std::max(distance(last_x,last_y,x,y),1e-6);
+
+    for (int i=0;i<num;++i) {
+
+      double u = plan.x_add_on+scale*plan.target_step;
+      plan.line->xy(plan.start_s+u,plan.jd.pos(u),x,y);
+      next_x_vals.push_back(x);
+      next_y_vals.push_back(y);
+      scale *= plan.target_step/std::max(distance(last_x,last_y,x,y),1e-6);
+      // new start
+      plan.x_add_on = u;
+      last_x        = x;
+      last_y        = y;
+    }
+  }
+  else {
+
+    //
+    // Create Trajectory - spline points in the vehicle frame, appended in place
+    //
+    int     base = next_x_vals.size();
+    next_x_vals.resize(base+num);
+    next_y_vals.resize(base+num);
+    double *px   = next_x_vals.data()+base;
+    double *py   = next_y_vals.data()+base;
+
+    for (int i=0;i<num;++i) {
+
+      double x_point = plan.x_add_on+plan.target_step;
+      px[i] = x_point;
+      py[i] = plan.spline(x_point);
+      // new start
+      plan.x_add_on = x_point;
+    }
+
+    // Transfrom from vehicle coord. to simulator coord.
+    plan.frame.apply(px,py,px,py,num);
+  }
+
+  if (!next_x_vals.empty()) {
+    plan.last_x = next_x_vals.back();
+    plan.last_y = next_y_vals.back();
+  }
+}
+
+
+// -------------------------------------------------------------------------------------
+// function build_trajectory
+//
+// + previous path + spline through its end and 3 points SPACING apart in the middle
+//   of LANE, sampled for VELOCITY (mph) up to DISTANCE_NUM points
+// + CAR_S = s at the end of the previous path (car s without one)
+// + scratch (spline points) lives on the stack, the spline in OUT's plan - callable
+//   from several threads for different candidates of the same tick
+// + the 3 points ahead on the piecewise linear map - with a reference line the
+//   backend samples its offset curve instead, see build_trajectory_line
+// + CONFIG = tuning policy, see planner_config.h
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+inline void build_trajectory(const Config &config, const HighwayMap &map, const Telemetry &t, double car_s,
+                             int lane, double velocity, double spacing, Trajectory &out) {
+
+  const std::vector<double> &previous_path_x = t.previous_path_x;
+  const std::vector<double> &previous_path_y = t.previous_path_y;
+
+  int prev_size = previous_path_x.size();
+
+  std::vector<double> &next_x_vals = out.next_x_vals;
+  std::vector<double> &next_y_vals = out.next_y_vals;
+  next_x_vals.clear();
+  next_y_vals.clear();
+
+  // wavepoint list (x,y)
+  double ptsx[PTS_NUM];
+  double ptsy[PTS_NUM];
+
+  // vehicle frame: start reference of vehicle, cos/sin of the yaw once per build
+  TrajectoryPlan &plan  = out.plan;
+  RigidTransform &frame = plan.frame;
+
+  //  check if list size
+  if (prev_size < PREVIOUS_SIZE_LIMIT) {
+
+    frame = RigidTransform(t.car_x,t.car_y,deg2rad(t.car_yaw));
+
+    // take 2 points for path - kind of linarization (car_x + previous_x calculated from past linear)
+    ptsx[0] = t.car_x-frame.c;
+    ptsy[0] = t.car_y-frame.s;
+    ptsx[1] = t.car_x;
+    ptsy[1] = t.car_y;
+  }
+  else {
+
+    // take reference from last entry of list
+    double ref_x = previous_path_x[prev_size-1];
+    double ref_y = previous_path_y[prev_size-1];
+    // one more from past
+    double ref_x_prev = previous_path_x[prev_size-2];
+    double ref_y_prev = previous_path_y[prev_size-2];
+
+    // calculate yaw
+    frame = RigidTransform(ref_x,ref_y,atan2(ref_y-ref_y_prev,ref_x-ref_x_prev));
+
+    ptsx[0] = ref_x_prev;
+    ptsy[0] = ref_y_prev;
+    ptsx[1] = ref_x;
+    ptsy[1] = ref_y;
+  }
+
+  //
+  // Add Fenet line of 3 x SPACING - lane selects middle of lane
+  //
+  STAGE_BEGIN(fit_start);
+  for (int i=1;i<=3;++i) map.getXY(car_s+spacing*i,config.lane_center(lane),ptsx[1+i],ptsy[1+i]);
+
+  //
+  // Transform to vehicles coordinate system - see MPC
+  //
+  frame.inverse(ptsx,ptsy,ptsx,ptsy,PTS_NUM);
+
+  //
+  // Create a spline wavepoints ptsx/y
+  //
+  FixedSpline<PTS_NUM> &s = plan.spline;
+  s.set_points(ptsx,ptsy,PTS_NUM);
+  STAGE_END(fit_start,STAGE_FIT);
+
+  //
+  // Create/reuse path based on previous - it only unses points which have not used in simulator
+  // org. list size = 50, simulator used (simulated) 5 points => previous list size = 45
+  //
+  for (int i=0;i<prev_size; ++i) {
+
+    next_x_vals.push_back(previous_path_x[i]);
+    next_y_vals.push_back(previous_path_y[i]);
+  }
+
+  //
+  // Calculate how to breakup spline for trajectory - triangle linearization
+  //
+  double target_x    = config.ref_distance(); // x horizon
+  double target_y    = s(target_x);
+  double target_dist = sqrt((target_x*target_x)+(target_y*target_y));
+  // calc. of the following loop moved for perf.
+  double N           = (target_dist/(config.points_per_sec()*velocity/MPH_TO_MS)); // note 2.24 factor for m/s vs. mph
+
+  plan.valid       = true;
+  plan.backend     = TRAJECTORY_SPLINE;
+  plan.lane        = lane;
+  plan.velocity    = velocity;
+  plan.spacing     = spacing;
+  plan.line        = nullptr;
+  plan.x_add_on    = 0;
+  plan.target_step = (target_x)/N;
+
+  sample_trajectory(config,map,plan,std::max(config.distance_num()-prev_size,0),out);
+}
+
+
+// -------------------------------------------------------------------------------------
+// function line_start_state
+//
+// + d of the end of the previous path of T on the reference LINE, its rates from the
+//   last 3 points (DT apart) - the car without a previous path; S = s on the line
+// + the start of build_trajectory_line, projected once per tick for all candidates
+// -------------------------------------------------------------------------------------
+
+inline void line_start_state(const ReferenceLine &line, const Telemetry &t, double dt, FrenetState &st) {
+
+  const std::vector<double> &px = t.previous_path_x;
+  const std::vector<double> &py = t.previous_path_y;
+  int                        n  = px.size();
+
+  if (n<PREVIOUS_SIZE_LIMIT) {
+    line.frenet(t.car_x,t.car_y,st.s,st.d);
+    st.d_dot  = 0;
+    st.d_ddot = 0;
+    return;
+  }
+
+  int    m    = std::min(n,3);
+  int    hint = -1;
+  double d[3];
+  for (int k=0;k<m;++k) line.frenet(px[n-m+k],py[n-m+k],st.s,d[k],&hint);
+  st.d      = d[m-1];
+  st.d_ddot = (m==3) ? (d[2]-2*d[1]+d[0])/(dt*dt) : 0;
+  st.d_dot  = (d[m-1]-d[m-2])/dt+0.5*st.d_ddot*dt;
+}
+
+
+// -------------------------------------------------------------------------------------
+// function build_trajectory_line
+//
+// + spline backend on the global reference LINE: previous path + the offset curve of
+//   the line, sampled for VELOCITY (mph) - no spline fit per tick and candidate
+// + d(s) = quintic from START (state on the line, see line_start_state) to the middle
+//   of LANE within 2 x SPACING as the JMT backend: slope and curvature of d continue
+//   those of the previous path, so the lateral motion stays smooth when the maneuver
+//   is built again every tick
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+inline void build_trajectory_line(const Config &config, const HighwayMap &map, const Telemetry &t,
+                                  const FrenetState &start, int lane, double velocity, double spacing,
+                                  Trajectory &out, const ReferenceLine *line) {
+
+  const std::vector<double> &previous_path_x = t.previous_path_x;
+  const std::vector<double> &previous_path_y = t.previous_path_y;
+
+  int prev_size = previous_path_x.size();
+
+  out.next_x_vals.assign(previous_path_x.begin(),previous_path_x.end());
+  out.next_y_vals.assign(previous_path_y.begin(),previous_path_y.end());
+
+  double v = std::max(start.s_dot,1e-3);
+
+  TrajectoryPlan &plan = out.plan;
+  plan.valid       = true;
+  plan.backend     = TRAJECTORY_SPLINE;
+  plan.lane        = lane;
+  plan.velocity    = velocity;
+  plan.spacing     = spacing;
+  plan.line        = line;
+  plan.start_s     = start.s;
+  plan.x_add_on    = 0;
+  plan.target_step = config.points_per_sec()*velocity/MPH_TO_MS;
+  plan.last_x      = (prev_size<PREVIOUS_SIZE_LIMIT) ? t.car_x : previous_path_x[prev_size-1];
+  plan.last_y      = (prev_size<PREVIOUS_SIZE_LIMIT) ? t.car_y : previous_path_y[prev_size-1];
+  STAGE_BEGIN(fit_start);
+  plan.jd.solve(start.d,start.d_dot/v,start.d_ddot/(v*v),config.lane_center(lane),0,0,2*spacing);
+  STAGE_END(fit_start,STAGE_FIT);
+
+  sample_trajectory(config,map,plan,std::max(config.distance_num()-prev_size,0),out);
+}
+
+
+// -------------------------------------------------------------------------------------
+// function build_trajectory_jmt
+//
+// + previous path + quintic JMT in s and d from START (state at the end of the
+//   previous path) to VELOCITY (mph) in the middle of LANE, zero acceleration
+// + s reaches VELOCITY after Ts (speed change at JMT_ACC), d the lane after Td (from
+//   SPACING), constant velocity afterwards
+// + the new points are the JMT at exact POINTS_PER_SEC steps, so the spacing along
+//   s is the planned speed - x,y from the global reference LINE, without one from a
+//   local spline reference line fitted here (no kinks either way)
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+inline void build_trajectory_jmt(const Config &config, const HighwayMap &map, const Telemetry &t,
+                                 const FrenetState &start, int lane, double velocity, double spacing,
+                                 Trajectory &out, const ReferenceLine *line = nullptr) {
+
+  const std::vector<double> &previous_path_x = t.previous_path_x;
+  const std::vector<double> &previous_path_y = t.previous_path_y;
+
+  int prev_size = previous_path_x.size();
+
+  out.next_x_vals.assign(previous_path_x.begin(),previous_path_x.end());
+  out.next_y_vals.assign(previous_path_y.begin(),previous_path_y.end());
+
+  double v1  = velocity/MPH_TO_MS;
+  double avg = std::max(0.5*(start.s_dot+v1),1.0);
+  double Ts  = std::min(std::max(fabs(v1-start.s_dot)/JMT_ACC,JMT_T_MIN),JMT_T_MAX);
+  double Td  = std::min(std::max(2*spacing/avg,JMT_T_MIN),JMT_T_MAX);
+
+  TrajectoryPlan &plan = out.plan;
+  plan.valid    = true;
+  plan.backend  = TRAJECTORY_JMT;
+  plan.lane     = lane;
+  plan.velocity = velocity;
+  plan.spacing  = spacing;
+  plan.steps    = 0;
+  plan.line     = line;
+  STAGE_BEGIN(fit_start);
+  plan.js.solve(start.s,start.s_dot,start.s_ddot,start.s+0.5*(start.s_dot+v1)*Ts,v1,0,Ts);
+  plan.jd.solve(start.d,start.d_dot,start.d_ddot,config.lane_center(lane),0,0,Td);
+  if (!line) plan.ref.build(map,start.s);
+  STAGE_END(fit_start,STAGE_FIT);
+
+  out.end = start;
+  sample_trajectory(config,map,plan,std::max(config.distance_num()-prev_size,0),out);
+}
+
+
+// -------------------------------------------------------------------------------------
+// function build_trajectory (backend)
+//
+// + START.s = s at the end of the previous path, the rest of START is used by the
+//   JMT backend only
+// + LINE = global reference line of MAP, nullptr if it has none
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+inline void build_trajectory(const Config &config, TrajectoryBackend backend, const HighwayMap &map,
+                             const Telemetry &t, const FrenetState &start, int lane, double velocity,
+                             double spacing, Trajectory &out, const ReferenceLine *line = nullptr) {
+  if      (backend==TRAJECTORY_JMT) build_trajectory_jmt(config,map,t,start,lane,velocity,spacing,out,line);
+  else if (line)                    build_trajectory_line(config,map,t,start,lane,velocity,spacing,out,line);
+  else                              build_trajectory(config,map,t,start.s,lane,velocity,spacing,out);
+}
+
+
+// -------------------------------------------------------------------------------------
+// function continues_plan
+//
+// + true if the previous path of T is the tail of PLAN (the simulator consumed
+//   points from its front only)
+// -------------------------------------------------------------------------------------
+
+inline bool continues_plan(const TrajectoryPlan &plan, const Telemetry &t) {
+
+  const std::vector<double> &px = t.previous_path_x;
+  const std::vector<double> &py = t.previous_path_y;
+  int                        n  = px.size();
+
+  return plan.valid && n>=PREVIOUS_SIZE_LIMIT &&
+         distance(px[n-1],py[n-1],plan.last_x,plan.last_y)<START_TOLERANCE;
+}
+
+
+// -------------------------------------------------------------------------------------
+// function can_extend / extend_trajectory
+//
+// + the maneuver of the tick (BACKEND, LANE, VELOCITY, SPACING) is the one of PLAN
+//   and the previous path continues it: the previous path stays as it is and only
+//   the consumed points are sampled from the cached curve - no spline fit, no JMT
+//   solve, no reference line
+// + the new points must stay within REF_DISTANCE (vehicle frame x for the spline, s
+//   on the reference line, s for the JMT) of the point the plan was built at, so the
+//   curve is never sampled far from its knots - beyond that the maneuver is built
+//   again
+// -------------------------------------------------------------------------------------
+
+template <class Config>
+inline bool can_extend(const Config &config, const TrajectoryPlan &plan, const Telemetry &t,
+                       TrajectoryBackend backend, int lane, double velocity, double spacing) {
+
+  if (!continues_plan(plan,t)) return false;
+  if (plan.backend!=backend || plan.lane!=lane || plan.velocity!=velocity || plan.spacing!=spacing) return false;
+
+  int num = std::max(config.distance_num()-(int)t.previous_path_x.size(),0);
+  if (backend==TRAJECTORY_JMT) {
+    return plan.js.pos((plan.steps+num)*config.points_per_sec())-plan.js.c[0]<=config.ref_distance();
+  }
+  return plan.x_add_on+num*plan.target_step<=config.ref_distance();
+}
+
+template <class Config>
+inline void extend_trajectory(const Config &config, const HighwayMap &map, const TrajectoryPlan &plan,
+                              const Telemetry &t, Trajectory &out) {
+
+  const std::vector<double> &previous_path_x = t.previous_path_x;
+  const std::vector<double> &previous_path_y = t.previous_path_y;
+
+  out.next_x_vals.assign(previous_path_x.begin(),previous_path_x.end());
+  out.next_y_vals.assign(previous_path_y.begin(),previous_path_y.end());
+  if (&out.plan!=&plan) out.plan = plan;
+
+  sample_trajectory(config,map,out.plan,std::max(config.distance_num()-(int)previous_path_x.size(),0),out);
+}
+
+#endif /* TRAJECTORY_H */
@@ -0,0 +1,392 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "telemetry.h"
+#include "tick_stats.h"
+
+// fixed record layout: path points per direction, sensor fusion cars - longer paths
+// and more cars are cut off by the writer
+const int TRANSPORT_PATH_MAX   = 256;
+const int TRANSPORT_FUSION_MAX = 128;
+
+// records per ring (power of two) - a simulator keeps one telemetry record in flight
+const int SHM_RING_SLOTS = 4;
+
+// shared memory region: magic and layout version, checked by the client
+const uint32_t SHM_MAGIC   = 0x50504c4e;  // "PPLN"
+const uint32_t SHM_VERSION = 1;
+
+// waiting for the other side: busy polls, then yields, then sleeps of SHM_IDLE_US
+const int SHM_SPIN        = 4096;
+const int SHM_YIELDS      = 1024;
+const int SHM_IDLE_US     = 50;
+
+
+// -------------------------------------------------------------------------------------
+// struct TelemetryRecord, struct TrajectoryRecord
+//
+// + fixed layout binary versions of the telemetry event and the control reply, no
+//   pointers - copied as they are through the shared memory ring (same host, same
+//   byte order)
+// + SEQ: set by the simulator per telemetry record, the reply carries the SEQ of the
+//   telemetry it was planned on
+// -------------------------------------------------------------------------------------
+
+struct TelemetryRecord {
+
+  uint64_t seq;
+  int32_t  path_size;    // previous path points
+  int32_t  fusion_size;  // sensor fusion cars
+
+  double car_x;
+  double car_y;
+  double car_s;
+  double car_d;
+  double car_yaw;
+  double car_speed;
+  double end_path_s;
+  double end_path_d;
+
+  double previous_path_x[TRANSPORT_PATH_MAX];
+  double previous_path_y[TRANSPORT_PATH_MAX];
+  double sensor_fusion[TRANSPORT_FUSION_MAX*SF_FIELDS];
+};
+
+struct TrajectoryRecord {
+
+  uint64_t seq;
+  int32_t  size;
+  int32_t  reserved;
+
+  double next_x[TRANSPORT_PATH_MAX];
+  double next_y[TRANSPORT_PATH_MAX];
+};
+
+static_assert(std::is_standard_layout<TelemetryRecord>::value && std::is_trivial<TelemetryRecord>::value,
+              "telemetry record must be plain data");
+static_assert(std::is_standard_layout<TrajectoryRecord>::value && std::is_trivial<TrajectoryRecord>::value,
+              "trajectory record must be plain data");
+
+// Telemetry -> record
+inline void write_record(const Telemetry &t, uint64_t seq, TelemetryRecord &r) {
+  r.seq         = seq;
+  r.path_size   = std::min((int)t.previous_path_x.size(),TRANSPORT_PATH_MAX);
+  r.fusion_size = std::min(t.fusion_size(),TRANSPORT_FUSION_MAX);
+  r.car_x       = t.car_x;
+  r.car_y       = t.car_y;
+  r.car_s       = t.car_s;
+  r.car_d       = t.car_d;
+  r.car_yaw     = t.car_yaw;
+  r.car_speed   = t.car_speed;
+  r.end_path_s  = t.end_path_s;
+  r.end_path_d  = t.end_path_d;
+  memcpy(r.previous_path_x,t.previous_path_x.data(),r.path_size*sizeof(double));
+  memcpy(r.previous_path_y,t.previous_path_y.data(),r.path_size*sizeof(double));
+  memcpy(r.sensor_fusion,t.sensor_fusion.data(),r.fusion_size*SF_FIELDS*sizeof(double));
+}
+
+// record -> Telemetry, the vectors keep their capacity
+inline void read_record(const TelemetryRecord &r, Telemetry &t) {
+  int path_size   = std::max(0,std::min((int)r.path_size,TRANSPORT_PATH_MAX));
+  int fusion_size = std::max(0,std::min((int)r.fusion_size,TRANSPORT_FUSION_MAX));
+  t.car_x      = r.car_x;
+  t.car_y      = r.car_y;
+  t.car_s      = r.car_s;
+  t.car_d      = r.car_d;
+  t.car_yaw    = r.car_yaw;
+  t.car_speed  = r.car_speed;
+  t.end_path_s = r.end_path_s;
+  t.end_path_d = r.end_path_d;
+  t.previous_path_x.assign(r.previous_path_x,r.previous_path_x+path_size);
+  t.previous_path_y.assign(r.previous_path_y,r.previous_path_y+path_size);
+  t.sensor_fusion.assign(r.sensor_fusion,r.sensor_fusion+fusion_size*SF_FIELDS);
+}
+
+// trajectory -> record
+inline void write_record(const std::vector<double> &next_x, const std::vector<double> &next_y, uint64_t seq,
+                         TrajectoryRecord &r) {
+  r.seq      = seq;
+  r.size     = std::min((int)std::min(next_x.size(),next_y.size()),TRANSPORT_PATH_MAX);
+  r.reserved = 0;
+  memcpy(r.next_x,next_x.data(),r.size*sizeof(double));
+  memcpy(r.next_y,next_y.data(),r.size*sizeof(double));
+}
+
+// record -> trajectory
+inline void read_record(const TrajectoryRecord &r, std::vector<double> &next_x, std::vector<double> &next_y) {
+  int size = std::max(0,std::min((int)r.size,TRANSPORT_PATH_MAX));
+  next_x.assign(r.next_x,r.next_x+size);
+  next_y.assign(r.next_y,r.next_y+size);
+}
+
+
+// -------------------------------------------------------------------------------------
+// class SpscRing
+//
+// + single producer / single consumer ring of N records T, lock-free, lives in the
+//   shared memory region (no pointers, lock-free atomics are address free)
+// + HEAD = records published by the producer, TAIL = records released by the
+//   consumer, both only grow - the producer owns HEAD, the consumer TAIL, each side
+//   reads the other one with acquire and caches it, so the index cache lines only
+//   move between the cores when the cached value runs out
+// + records are written and read in place: claim / publish on the producer side,
+//   front / release on the consumer side
+// -------------------------------------------------------------------------------------
+
+template <class T, int N>
+class SpscRing {
+
+  static_assert(N>0 && (N&(N-1))==0, "ring size must be a power of two");
+
+ public:
+
+  SpscRing() : head(0), tail_cache(0), tail(0), head_cache(0) {}
+
+  // producer: free slot to fill, nullptr if the ring is full
+  T *claim() {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    if (h-tail_cache>=N) {
+      tail_cache = tail.load(std::memory_order_acquire);
+      if (h-tail_cache>=N) return nullptr;
+    }
+    return &slots[h&(N-1)];
+  }
+
+  // producer: the claimed slot is visible to the consumer
+  void publish() {
+    head.store(head.load(std::memory_order_relaxed)+1,std::memory_order_release);
+  }
+
+  // consumer: oldest published record, nullptr if the ring is empty
+  const T *front() {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    if (t==head_cache) {
+      head_cache = head.load(std::memory_order_acquire);
+      if (t==head_cache) return nullptr;
+    }
+    return &slots[t&(N-1)];
+  }
+
+  // consumer: done with the front record, the slot goes back to the producer
+  void release() {
+    tail.store(tail.load(std::memory_order_relaxed)+1,std::memory_order_release);
+  }
+
+  // consumer: records published and not released
+  int size() const {
+    return int(head.load(std::memory_order_acquire)-tail.load(std::memory_order_relaxed));
+  }
+
+ private:
+
+  // producer cache line
+  alignas(64) std::atomic<uint64_t> head;
+  uint64_t                          tail_cache;
+
+  // consumer cache line
+  alignas(64) std::atomic<uint64_t> tail;
+  uint64_t                          head_cache;
+
+  alignas(64) T slots[N];
+};
+
+
+// -------------------------------------------------------------------------------------
+// function wait_for
+//
+// + polls READY until it returns a record: busy for SHM_SPIN polls, then yielding,
+//   then sleeping SHM_IDLE_US between the polls - an active session is answered from
+//   the busy phase, an idle one costs no core
+// + no busy phase on a single hardware thread, the other side could not run
+// + nullptr when STOP (if any) is set
+// -------------------------------------------------------------------------------------
+
+template <class Ready>
+auto wait_for(Ready ready, const std::atomic<bool> *stop = nullptr) -> decltype(ready()) {
+  static const int spin = (std::thread::hardware_concurrency()>1) ? SHM_SPIN : 0;
+  for (int i=0;;++i) {
+    auto r = ready();
+    if (r) return r;
+    if (stop && stop->load(std::memory_order_relaxed)) return nullptr;
+    if (i<spin) {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#endif
+    }
+    else if (i<spin+SHM_YIELDS) std::this_thread::yield();
+    else                            std::this_thread::sleep_for(std::chrono::microseconds(SHM_IDLE_US));
+  }
+}
+
+
+// -------------------------------------------------------------------------------------
+// class ShmChannel
+//
+// + one simulator session over POSIX shared memory (shm_open + mmap): a telemetry
+//   ring simulator -> planner and a trajectory ring planner -> simulator, the
+//   simulator is the producer of the one and the consumer of the other
+// + create: planner side, new region NAME ("/name"), unlinked again when the channel
+//   is destroyed; open: simulator side, region of a running planner - checks magic,
+//   version and record sizes
+// + errors are reported on cerr, the factories return nullptr
+// -------------------------------------------------------------------------------------
+
+class ShmChannel {
+
+  struct Region {
+    std::atomic<uint32_t> magic;  // set last by create
+    uint32_t              version;
+    uint32_t              telemetry_bytes;
+    uint32_t              trajectory_bytes;
+
+    SpscRing<TelemetryRecord,SHM_RING_SLOTS>  telemetry;
+    SpscRing<TrajectoryRecord,SHM_RING_SLOTS> trajectory;
+  };
+
+ public:
+
+  typedef SpscRing<TelemetryRecord,SHM_RING_SLOTS>  TelemetryRing;
+  typedef SpscRing<TrajectoryRecord,SHM_RING_SLOTS> TrajectoryRing;
+
+  static std::unique_ptr<ShmChannel> create(const std::string &name) {
+    shm_unlink(name.c_str());
+    int fd = shm_open(name.c_str(),O_CREAT|O_EXCL|O_RDWR,0600);
+    if (fd<0 || ftruncate(fd,sizeof(Region))!=0) {
+      std::cerr << "shared memory " << name << ": " << strerror(errno) << std::endl;
+      if (fd>=0) { close(fd); shm_unlink(name.c_str()); }
+      return nullptr;
+    }
+    std::unique_ptr<ShmChannel> ch = map_region(name,fd,true);
+    if (!ch) return nullptr;
+
+    Region *r = new (ch->region) Region;
+    r->version          = SHM_VERSION;
+    r->telemetry_bytes  = sizeof(TelemetryRecord);
+    r->trajectory_bytes = sizeof(TrajectoryRecord);
+    r->magic.store(SHM_MAGIC,std::memory_order_release);
+    return ch;
+  }
+
+  static std::unique_ptr<ShmChannel> open(const std::string &name) {
+    int fd = shm_open(name.c_str(),O_RDWR,0600);
+    struct stat st;
+    if (fd<0 || fstat(fd,&st)!=0) {
+      std::cerr << "shared memory " << name << ": " << strerror(errno) << std::endl;
+      if (fd>=0) close(fd);
+      return nullptr;
+    }
+    if (st.st_size<(off_t)sizeof(Region)) {
+      std::cerr << "shared memory " << name << ": region too small" << std::endl;
+      close(fd);
+      return nullptr;
+    }
+    std::unique_ptr<ShmChannel> ch = map_region(name,fd,false);
+    if (!ch) return nullptr;
+
+    Region *r = ch->region;
+    if (r->magic.load(std::memory_order_acquire)!=SHM_MAGIC ||
+        r->version!=SHM_VERSION || r->telemetry_bytes!=sizeof(TelemetryRecord) ||
+        r->trajectory_bytes!=sizeof(TrajectoryRecord)) {
+      std::cerr << "shared memory " << name << ": not a planner channel of this version" << std::endl;
+      return nullptr;
+    }
+    return ch;
+  }
+
+  ~ShmChannel() {
+    munmap(region,sizeof(Region));
+    if (owner) shm_unlink(name.c_str());
+  }
+
+  TelemetryRing  &telemetry()  { return region->telemetry; }
+  TrajectoryRing &trajectory() { return region->trajectory; }
+
+ private:
+
+  ShmChannel(const std::string &name, Region *region, bool owner) : name(name), region(region), owner(owner) {}
+
+  static std::unique_ptr<ShmChannel> map_region(const std::string &name, int fd, bool owner) {
+    void *p = mmap(nullptr,sizeof(Region),PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+    close(fd);
+    if (p==MAP_FAILED) {
+      std::cerr << "shared memory " << name << ": " << strerror(errno) << std::endl;
+      if (owner) shm_unlink(name.c_str());
+      return nullptr;
+    }
+    return std::unique_ptr<ShmChannel>(new ShmChannel(name,static_cast<Region *>(p),owner));
+  }
+
+  std::string  name;
+  Region *region;
+  bool    owner;
+};
+
+
+// -------------------------------------------------------------------------------------
+// function serve_channel
+//
+// + planner side of a shared memory session, the counterpart of the websocket
+//   message handler: waits for telemetry, decodes it into TELEMETRY, STEP() plans on
+//   it (returns the Trajectory) and the reply goes back with the telemetry's seq -
+//   stage timers parse, tick, serialize, send as on the websocket path
+// + telemetry records queued behind a newer one are dropped unplanned (counter
+//   coalesced), like frames coalesced by the TickQueue
+// + returns when STOP is set (runs forever without)
+// -------------------------------------------------------------------------------------
+
+template <class Step>
+void serve_channel(ShmChannel &channel, Telemetry &telemetry, Step step, const std::atomic<bool> *stop = nullptr) {
+
+  ShmChannel::TelemetryRing  &in_ring  = channel.telemetry();
+  ShmChannel::TrajectoryRing &out_ring = channel.trajectory();
+
+  for (;;) {
+
+    const TelemetryRecord *in = wait_for([&in_ring]() { return in_ring.front(); },stop);
+    if (!in) return;
+    while (in_ring.size()>1) {
+      in_ring.release();
+      in = in_ring.front();
+      STATS_COUNT(COUNTER_COALESCED);
+    }
+
+    STAGE_BEGIN(parse_start);
+    uint64_t seq = in->seq;
+    read_record(*in,telemetry);
+    in_ring.release();
+    STAGE_END(parse_start,STAGE_PARSE);
+
+    STAGE_BEGIN(tick_start);
+    const auto &trajectory = step();
+
+    TrajectoryRecord *out = wait_for([&out_ring]() { return out_ring.claim(); },stop);
+    if (!out) return;
+    STAGE_BEGIN(serialize_start);
+    write_record(trajectory.next_x_vals,trajectory.next_y_vals,seq,*out);
+    STAGE_END(serialize_start,STAGE_SERIALIZE);
+
+    STAGE_BEGIN(send_start);
+    out_ring.publish();
+    STAGE_END(send_start,STAGE_SEND);
+    STAGE_END(tick_start,STAGE_TICK);
+  }
+}
+
+#endif /* TRANSPORT_H */
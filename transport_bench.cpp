@@ -0,0 +1,273 @@
+// -------------------------------------------------------------------------------------
+// transport_bench - round trip latency of the planner transports side by side
+//
+// + build:  g++ -O2 -std=c++11 transport_bench.cpp -luWS -lssl -lcrypto -lz -lpthread -lrt -o transport_bench
+// + run:    ./transport_bench [ticks] [recording] [--map=<file>] [--port=N] [--echo]
+//           defaults 10000 ticks, ../data/highway_map.csv, port 4568
+//
+// + one simulator session per backend, closed loop (one telemetry in flight), the
+//   planner side on a thread of its own, the simulator side on the main thread:
+//   - websocket: 42["telemetry",{...}] text frames over a loopback connection, the
+//     planner side parses, plans, writes the control frame and sends it (the
+//     message handler of ./path_planning with --coalesce=0)
+//   - shm: TelemetryRecord / TrajectoryRecord through a ShmChannel (transport.h),
+//     the planner side is serve_channel as with ./path_planning --shm=<name>
+// + frames from the RECORDING (./path_planning --record=<file>, the frames of its
+//   first connection) or the simulator's start frame, the same sequence for both backends - the simulator
+//   side sends the text frames as they are and writes the records from the decoded
+//   frames, replies are not decoded
+// + every backend plans on a fresh Planner (spline, reference line); --echo replies
+//   with the previous path instead of planning, the round trip is then transport
+//   only
+// + reports round trip p50, p99, max and mean per backend, the first
+//   TRANSPORT_WARMUP ticks left out
+// -------------------------------------------------------------------------------------
+
+#include <uWS/uWS.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "map.h"
+#include "map_file.h"
+#include "reference_line.h"
+#include "telemetry.h"
+#include "planner.h"
+#include "control.h"
+#include "transport.h"
+#include "recording.h"
+
+using namespace std;
+
+// round trips before the latencies are recorded
+const int TRANSPORT_WARMUP = 100;
+
+// first frame the simulator sends: car at the start position, no previous path
+static const char *START_FRAME =
+  "42[\"telemetry\",{\"x\":909.48,\"y\":1128.67,\"yaw\":0,\"speed\":0,\"s\":124.8336,\"d\":6.164833,"
+  "\"previous_path_x\":[],\"previous_path_y\":[],\"end_path_s\":0,\"end_path_d\":0,"
+  "\"sensor_fusion\":[[0,1036.5,1144.6,21.3,0.2,250.2,6.1],[1,775.8,1421.6,0,0,6719.2,-280.0],"
+  "[2,775.8,1425.2,0,0,6716.6,-282.5],[3,775.8,1429,0,0,6713.9,-285.1],[4,960.1,1136.4,19.8,0,176.7,2.2],"
+  "[5,989.8,1128.9,20.4,0.1,205.4,10.1],[6,1084.3,1136.9,18.7,0.1,299.6,1.9]]}]";
+
+
+// -------------------------------------------------------------------------------------
+// struct BenchSession
+//
+// + planner side of one backend: Planner, decoded telemetry, reply buffers
+// -------------------------------------------------------------------------------------
+
+struct BenchSession {
+
+  BenchSession(const HighwayMap &map, const ReferenceLine *line, bool echo) : planner(map), echo(echo) {
+    planner.set_map(map,line);
+    telemetry.previous_path_x.reserve(TRANSPORT_PATH_MAX);
+    telemetry.previous_path_y.reserve(TRANSPORT_PATH_MAX);
+    telemetry.sensor_fusion.reserve(64*SF_FIELDS);
+    msg.reserve(4096);
+  }
+
+  const Trajectory &step() {
+    if (!echo) return planner.step(telemetry);
+    reply.next_x_vals = telemetry.previous_path_x;
+    reply.next_y_vals = telemetry.previous_path_y;
+    return reply;
+  }
+
+  Planner    planner;
+  bool       echo;
+  Telemetry  telemetry;
+  Trajectory reply;
+  string     msg;
+};
+
+
+// websocket: TICKS round trips of FRAMES through a loopback connection on PORT
+static bool run_websocket(const vector<string> &frames, int ticks, int port, BenchSession &session,
+                          vector<double> &rtt) {
+
+  // planner side
+  promise<bool> listening;
+  thread server([&session,&listening,port]() {
+    uWS::Hub sh;
+    sh.onMessage([&session](uWS::WebSocket<uWS::SERVER> ws, char *data, size_t length, uWS::OpCode opCode) {
+      if (TelemetryParser::parse(data,length,session.telemetry)!=TELEMETRY_OK) return;
+      const Trajectory &trajectory = session.step();
+      write_control(session.msg,trajectory.next_x_vals,trajectory.next_y_vals);
+      ws.send(session.msg.data(),session.msg.length(),uWS::OpCode::TEXT);
+    });
+    // one session: the loop ends with it
+    sh.onDisconnection([&sh](uWS::WebSocket<uWS::SERVER> ws, int code, char *message, size_t length) {
+      sh.getDefaultGroup<uWS::SERVER>().close();
+    });
+    bool ok = sh.listen(port);
+    listening.set_value(ok);
+    if (ok) sh.run();
+  });
+  if (!listening.get_future().get()) {
+    cerr << "failed to listen to port " << port << endl;
+    server.join();
+    return false;
+  }
+
+  // simulator side
+  uWS::Hub h;
+  int      sent   = 0;
+  bool     failed = false;
+  auto     t0     = chrono::steady_clock::now();
+
+  h.onConnection([&](uWS::WebSocket<uWS::CLIENT> ws, uWS::HttpRequest req) {
+    t0 = chrono::steady_clock::now();
+    ws.send(frames[0].data(),frames[0].length(),uWS::OpCode::TEXT);
+  });
+
+  h.onMessage([&](uWS::WebSocket<uWS::CLIENT> ws, char *data, size_t length, uWS::OpCode opCode) {
+    auto t1 = chrono::steady_clock::now();
+    if (sent++>=TRANSPORT_WARMUP) rtt.push_back(chrono::duration<double,micro>(t1-t0).count());
+    if (sent==ticks) {
+      ws.close();
+      return;
+    }
+    const string &frame = frames[sent%frames.size()];
+    t0 = chrono::steady_clock::now();
+    ws.send(frame.data(),frame.length(),uWS::OpCode::TEXT);
+  });
+
+  h.onError([&](void *user) {
+    cerr << "connection to port " << port << " failed" << endl;
+    failed = true;
+  });
+
+  h.connect("ws://127.0.0.1:"+to_string(port),nullptr);
+  h.run();
+
+  if (failed) {
+    // nobody connected, the planner side is still listening
+    server.detach();
+    return false;
+  }
+  server.join();
+  return true;
+}
+
+// shared memory: TICKS round trips of TELEMETRY through a ShmChannel
+static bool run_shm(const vector<Telemetry> &telemetry, int ticks, BenchSession &session, vector<double> &rtt) {
+
+  string name = "/transport_bench_"+to_string(getpid());
+
+  // planner side creates the channel, the simulator side maps it on its own
+  unique_ptr<ShmChannel> channel = ShmChannel::create(name);
+  if (!channel) return false;
+  unique_ptr<ShmChannel> sim = ShmChannel::open(name);
+  if (!sim) return false;
+
+  atomic<bool> stop(false);
+  thread server([&channel,&session,&stop]() {
+    serve_channel(*channel,session.telemetry,[&session]() -> const Trajectory & { return session.step(); },&stop);
+  });
+
+  ShmChannel::TelemetryRing  &out_ring = sim->telemetry();
+  ShmChannel::TrajectoryRing &in_ring  = sim->trajectory();
+  bool                        ok       = true;
+
+  for (int k=0;k<ticks;++k) {
+
+    auto t0 = chrono::steady_clock::now();
+
+    TelemetryRecord *out = wait_for([&out_ring]() { return out_ring.claim(); });
+    write_record(telemetry[k%telemetry.size()],k,*out);
+    out_ring.publish();
+
+    const TrajectoryRecord *in = wait_for([&in_ring]() { return in_ring.front(); });
+    if (in->seq!=uint64_t(k)) ok = false;
+    in_ring.release();
+
+    auto t1 = chrono::steady_clock::now();
+    if (k>=TRANSPORT_WARMUP) rtt.push_back(chrono::duration<double,micro>(t1-t0).count());
+  }
+
+  stop = true;
+  server.join();
+  if (!ok) cerr << "shm: reply out of sequence" << endl;
+  return ok;
+}
+
+static void report(const char *backend, vector<double> &rtt) {
+  if (rtt.empty()) {
+    printf("%-10s %8s\n",backend,"-");
+    return;
+  }
+  sort(rtt.begin(),rtt.end());
+  size_t n    = rtt.size();
+  double mean = 0;
+  for (double r : rtt) mean += r;
+  mean /= n;
+  printf("%-10s %8zu %10.2f %10.2f %10.2f %10.2f\n",backend,n,
+         rtt[min(n-1,size_t(n*0.50))],rtt[min(n-1,size_t(n*0.99))],rtt[n-1],mean);
+}
+
+int main(int argc, char **argv) {
+
+  int    ticks     = 10000;
+  string recording;
+  string map_file_ = "../data/highway_map.csv";
+  int    port      = 4568;
+  bool   echo      = false;
+  int    positional = 0;
+  for (int i=1;i<argc;++i) {
+    string arg = argv[i];
+    if (arg.compare(0,6,"--map=")==0)       map_file_ = arg.c_str()+6;
+    else if (arg.compare(0,7,"--port=")==0) port      = atoi(arg.c_str()+7);
+    else if (arg=="--echo")                 echo      = true;
+    else if (positional++==0)               ticks     = atoi(arg.c_str());
+    else                                    recording = arg;
+  }
+  ticks = max(ticks,TRANSPORT_WARMUP+1);
+
+  vector<string> frames;
+  if (!recording.empty()) read_recording(recording,frames);
+  if (frames.empty()) frames.push_back(START_FRAME);
+
+  // the same frames decoded for the records, frames without telemetry dropped
+  vector<string>    sent;
+  vector<Telemetry> telemetry;
+  for (const string &frame : frames) {
+    Telemetry t;
+    if (TelemetryParser::parse(frame.data(),frame.size(),t)!=TELEMETRY_OK) continue;
+    sent.push_back(frame);
+    telemetry.push_back(t);
+  }
+  if (telemetry.empty()) {
+    cerr << "no telemetry frames in " << recording << endl;
+    return -1;
+  }
+
+  unique_ptr<HighwayMap> map = load_map(map_file_);
+  if (!map) return -1;
+  ReferenceLine line(*map);
+
+  vector<double> ws_rtt, shm_rtt;
+  ws_rtt.reserve(ticks);
+  shm_rtt.reserve(ticks);
+
+  BenchSession ws_session(*map,&line,echo);
+  bool         ws_ok = run_websocket(sent,ticks,port,ws_session,ws_rtt);
+
+  BenchSession shm_session(*map,&line,echo);
+  bool         shm_ok = run_shm(telemetry,ticks,shm_session,shm_rtt);
+
+  cout << "round trips: " << ticks << " per backend (" << TRANSPORT_WARMUP << " warmup), "
+       << (echo ? "echo" : "planning") << ", " << sent.size() << " frame(s)" << endl;
+  printf("%-10s %8s %10s %10s %10s %10s\n","backend","ticks","p50 us","p99 us","max us","mean us");
+  report("websocket",ws_rtt);
+  report("shm",shm_rtt);
+
+  return (ws_ok && shm_ok) ? 0 : 1;
+}